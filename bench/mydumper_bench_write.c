@@ -0,0 +1,513 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+
+/*
+  Offline micro-benchmarks of the row encoding hot path. Synthetic rows are
+  sent through the same functions that mydumper uses, the writers included,
+  which get them from a mask_reader instead of a result, so no server is
+  needed.
+
+  Usage: mydumper_bench_write [rows]
+*/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <dlfcn.h>
+#include <mysql.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#include "common.h"
+#include "mydumper_start_dump.h"
+#include "mydumper_common.h"
+#include "mydumper_write.h"
+#include "mydumper_masquerade.h"
+#include "mydumper_database.h"
+#include "logging.h"
+#include "mydumper_global.h"
+
+#ifndef MYSQL_TYPE_JSON
+#define MYSQL_TYPE_JSON 245
+#endif
+
+/* Defined in mydumper.c which is not linked into the benchmark */
+const char DIRECTORY[] = "export";
+gchar *output_directory = NULL;
+gchar *output_directory_param = NULL;
+gchar *dump_directory = NULL;
+gboolean daemon_mode = FALSE;
+gchar *disk_limits=NULL;
+gboolean stream = FALSE;
+gboolean no_delete = FALSE;
+gboolean shutdown_triggered = FALSE;
+guint errors;
+
+#define BENCH_POOL_ROWS 1024
+
+#ifdef RTLD_NEXT
+/* Every allocation done in the process, glib included, goes through here.
+   The real functions are looked up with dlsym, which can allocate itself, so
+   the allocations done before that are served from bootstrap. */
+static void *(*real_malloc)(size_t)=NULL;
+static void *(*real_calloc)(size_t, size_t)=NULL;
+static void *(*real_realloc)(void *, size_t)=NULL;
+static void (*real_free)(void *)=NULL;
+static gboolean allocator_loading = FALSE;
+static guint64 allocations = 0;
+static gchar bootstrap[16384];
+static gsize bootstrap_used = 0;
+
+static void *bootstrap_alloc(size_t size){
+  void *p=NULL;
+  size=(size + 15) & ~(size_t)15;
+  if (bootstrap_used + size > sizeof(bootstrap))
+    return NULL;
+  p=bootstrap + bootstrap_used;
+  bootstrap_used+=size;
+  return p;
+}
+
+static gboolean is_bootstrap(void *ptr){
+  return (gchar *)ptr >= bootstrap && (gchar *)ptr < bootstrap + sizeof(bootstrap);
+}
+
+static void load_allocator(){
+  allocator_loading=TRUE;
+  real_malloc=dlsym(RTLD_NEXT, "malloc");
+  real_calloc=dlsym(RTLD_NEXT, "calloc");
+  real_realloc=dlsym(RTLD_NEXT, "realloc");
+  real_free=dlsym(RTLD_NEXT, "free");
+  allocator_loading=FALSE;
+}
+
+void *malloc(size_t size){
+  if (real_malloc == NULL){
+    if (allocator_loading)
+      return bootstrap_alloc(size);
+    load_allocator();
+  }
+  allocations++;
+  return real_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size){
+  if (real_calloc == NULL){
+    // bootstrap is static, so it is already zeroed
+    if (allocator_loading)
+      return bootstrap_alloc(nmemb * size);
+    load_allocator();
+  }
+  allocations++;
+  return real_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size){
+  if (real_realloc == NULL){
+    if (allocator_loading)
+      return bootstrap_alloc(size);
+    load_allocator();
+  }
+  allocations++;
+  if (is_bootstrap(ptr)){
+    void *p=real_malloc(size);
+    if (p != NULL)
+      memcpy(p, ptr, MIN(size, (gsize)(bootstrap + sizeof(bootstrap) - (gchar *)ptr)));
+    return p;
+  }
+  return real_realloc(ptr, size);
+}
+
+void free(void *ptr){
+  if (ptr == NULL || is_bootstrap(ptr))
+    return;
+  if (real_free == NULL)
+    load_allocator();
+  real_free(ptr);
+}
+#define ALLOCATIONS allocations
+#else
+#define ALLOCATIONS 0
+#endif
+
+struct bench_dataset {
+  const gchar *name;
+  guint num_fields;
+  MYSQL_FIELD *fields;
+  MYSQL_ROW rows[BENCH_POOL_ROWS];
+  gulong *lengths[BENCH_POOL_ROWS];
+};
+
+// Hands the rows of the pool to the mask_reader as if they were coming from
+// the server, until rows of them were returned
+struct bench_source {
+  struct bench_dataset *ds;
+  guint64 next;
+  guint64 rows;
+};
+
+struct bench_result {
+  guint64 rows;
+  guint64 bytes;
+  guint64 allocations;
+  gint64 elapsed;
+};
+
+static MYSQL *conn = NULL;
+static struct db_table *dbt = NULL;
+static struct thread_data *td = NULL;
+static guint64 bench_rows = 200000;
+
+static gchar *random_text(GRand *r, guint length, gboolean with_escapes){
+  const gchar plain[]="abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789 ";
+  const gchar escapes[]="'\"\\\n\r\t,";
+  gchar *s=g_new(gchar, length + 1);
+  guint i=0;
+  for (i=0; i < length; i++){
+    if (with_escapes && g_rand_int_range(r, 0, 10) == 0)
+      s[i]=escapes[g_rand_int_range(r, 0, sizeof(escapes) - 1)];
+    else
+      s[i]=plain[g_rand_int_range(r, 0, sizeof(plain) - 1)];
+  }
+  s[length]='\0';
+  return s;
+}
+
+static gchar *random_blob(GRand *r, guint length){
+  gchar *s=g_new(gchar, length + 1);
+  guint i=0;
+  for (i=0; i < length; i++)
+    s[i]=(gchar)g_rand_int_range(r, 0, 256);
+  s[length]='\0';
+  return s;
+}
+
+static gchar *random_json(GRand *r){
+  gchar *text=random_text(r, 48, FALSE);
+  gchar *s=g_strdup_printf("{\"id\": %d, \"name\": \"%s\", \"tags\": [\"a\", \"b\\\"c\"], \"score\": %d.%d}",
+                           g_rand_int(r), text, g_rand_int_range(r, 0, 1000), g_rand_int_range(r, 0, 100));
+  g_free(text);
+  return s;
+}
+
+static void set_field(MYSQL_FIELD *field, gchar *name, enum enum_field_types type){
+  field->name=name;
+  field->type=type;
+  field->flags=(type == MYSQL_TYPE_LONG || type == MYSQL_TYPE_LONGLONG) ? NUM_FLAG : 0;
+}
+
+static struct bench_dataset *new_dataset(const gchar *name, guint num_fields, enum enum_field_types *types){
+  struct bench_dataset *ds=g_new0(struct bench_dataset, 1);
+  guint i=0;
+  ds->name=name;
+  ds->num_fields=num_fields;
+  ds->fields=g_new0(MYSQL_FIELD, num_fields);
+  for (i=0; i < num_fields; i++)
+    set_field(&(ds->fields[i]), g_strdup_printf("c%u", i), types[i]);
+  for (i=0; i < BENCH_POOL_ROWS; i++){
+    ds->rows[i]=g_new0(gchar *, num_fields);
+    ds->lengths[i]=g_new0(gulong, num_fields);
+  }
+  return ds;
+}
+
+static void set_value(struct bench_dataset *ds, guint row, guint column, gchar *value, gulong length){
+  ds->rows[row][column]=value;
+  ds->lengths[row][column]=value == NULL ? 0 : length;
+}
+
+static GList *build_datasets(){
+  GList *datasets=NULL;
+  GRand *r=g_rand_new_with_seed(42);
+  struct bench_dataset *ds=NULL;
+  gchar *s=NULL;
+  guint i=0, j=0;
+
+  enum enum_field_types numeric[]={MYSQL_TYPE_LONG, MYSQL_TYPE_LONGLONG, MYSQL_TYPE_LONG, MYSQL_TYPE_LONGLONG, MYSQL_TYPE_LONG, MYSQL_TYPE_LONG};
+  ds=new_dataset("numeric", 6, numeric);
+  for (i=0; i < BENCH_POOL_ROWS; i++)
+    for (j=0; j < ds->num_fields; j++){
+      s=g_strdup_printf("%d", g_rand_int(r));
+      set_value(ds, i, j, s, strlen(s));
+    }
+  datasets=g_list_append(datasets, ds);
+
+  enum enum_field_types short_text[]={MYSQL_TYPE_LONG, MYSQL_TYPE_VAR_STRING, MYSQL_TYPE_VAR_STRING, MYSQL_TYPE_VAR_STRING, MYSQL_TYPE_VAR_STRING};
+  ds=new_dataset("short_text", 5, short_text);
+  for (i=0; i < BENCH_POOL_ROWS; i++){
+    s=g_strdup_printf("%u", i);
+    set_value(ds, i, 0, s, strlen(s));
+    for (j=1; j < ds->num_fields; j++)
+      set_value(ds, i, j, random_text(r, g_rand_int_range(r, 4, 32), FALSE), 0);
+  }
+  datasets=g_list_append(datasets, ds);
+
+  enum enum_field_types long_text[]={MYSQL_TYPE_LONG, MYSQL_TYPE_VAR_STRING, MYSQL_TYPE_VAR_STRING};
+  ds=new_dataset("long_text_escapes", 3, long_text);
+  for (i=0; i < BENCH_POOL_ROWS; i++){
+    s=g_strdup_printf("%u", i);
+    set_value(ds, i, 0, s, strlen(s));
+    for (j=1; j < ds->num_fields; j++)
+      set_value(ds, i, j, random_text(r, g_rand_int_range(r, 1024, 4096), TRUE), 0);
+  }
+  datasets=g_list_append(datasets, ds);
+
+  enum enum_field_types blob[]={MYSQL_TYPE_LONG, MYSQL_TYPE_BLOB};
+  ds=new_dataset("blob", 2, blob);
+  for (i=0; i < BENCH_POOL_ROWS; i++){
+    s=g_strdup_printf("%u", i);
+    set_value(ds, i, 0, s, strlen(s));
+    set_value(ds, i, 1, random_blob(r, 4096), 4096);
+  }
+  datasets=g_list_append(datasets, ds);
+
+  enum enum_field_types json[]={MYSQL_TYPE_LONG, MYSQL_TYPE_JSON};
+  ds=new_dataset("json", 2, json);
+  for (i=0; i < BENCH_POOL_ROWS; i++){
+    s=g_strdup_printf("%u", i);
+    set_value(ds, i, 0, s, strlen(s));
+    set_value(ds, i, 1, random_json(r), 0);
+  }
+  datasets=g_list_append(datasets, ds);
+
+  enum enum_field_types null_heavy[]={MYSQL_TYPE_LONG, MYSQL_TYPE_VAR_STRING, MYSQL_TYPE_LONG, MYSQL_TYPE_VAR_STRING, MYSQL_TYPE_LONG, MYSQL_TYPE_VAR_STRING, MYSQL_TYPE_LONG, MYSQL_TYPE_VAR_STRING};
+  ds=new_dataset("null_heavy", 8, null_heavy);
+  for (i=0; i < BENCH_POOL_ROWS; i++)
+    for (j=0; j < ds->num_fields; j++){
+      if (g_rand_int_range(r, 0, 10) < 8)
+        set_value(ds, i, j, NULL, 0);
+      else if (ds->fields[j].type == MYSQL_TYPE_LONG){
+        s=g_strdup_printf("%d", g_rand_int(r));
+        set_value(ds, i, j, s, strlen(s));
+      }else
+        set_value(ds, i, j, random_text(r, 16, FALSE), 0);
+    }
+  datasets=g_list_append(datasets, ds);
+
+  // Text lengths were left to 0 to be computed here
+  GList *l=NULL;
+  for (l=datasets; l != NULL; l=l->next){
+    ds=l->data;
+    for (i=0; i < BENCH_POOL_ROWS; i++)
+      for (j=0; j < ds->num_fields; j++)
+        if (ds->rows[i][j] != NULL && ds->lengths[i][j] == 0)
+          ds->lengths[i][j]=strlen(ds->rows[i][j]);
+  }
+  g_rand_free(r);
+  return datasets;
+}
+
+static void set_sql_mode(){
+  load_data=FALSE;
+  fields_enclosed_by=(gchar *)"\"";
+  fields_escaped_by=(gchar *)"\\";
+  fields_terminated_by=(gchar *)",";
+  lines_starting_by=(gchar *)"(";
+  lines_terminated_by=(gchar *)")\n";
+  statement_terminated_by=(gchar *)";\n";
+}
+
+static void set_load_data_mode(){
+  load_data=TRUE;
+  fields_enclosed_by=(gchar *)"";
+  fields_escaped_by=(gchar *)"\\\\";
+  fields_terminated_by=(gchar *)"\t";
+  lines_starting_by=(gchar *)"";
+  lines_terminated_by=(gchar *)"\n";
+  statement_terminated_by=(gchar *)"";
+}
+
+static void set_compression(gboolean compress){
+  if (compress){
+    m_open=(void *) &gzopen;
+    m_close=(void *) &gzclose;
+    m_write=(void *) &gzwrite;
+    compress_extension=(gchar *)".gz";
+  }else{
+    m_open=&g_fopen;
+    m_close=(void *) &fclose;
+    m_write=(void *) &write_file;
+    compress_extension=(gchar *)"";
+  }
+}
+
+static void start_result(struct bench_result *result){
+  result->rows=0;
+  result->bytes=0;
+  result->allocations=ALLOCATIONS;
+  result->elapsed=g_get_monotonic_time();
+}
+
+static void end_result(struct bench_result *result){
+  result->elapsed=g_get_monotonic_time() - result->elapsed;
+  result->allocations=ALLOCATIONS - result->allocations;
+}
+
+static void bench_escape(struct bench_dataset *ds, struct bench_result *result){
+  GString *escaped=g_string_sized_new(3000);
+  guint64 n=0;
+  guint i=0;
+  set_sql_mode();
+  start_result(result);
+  for (n=0; n < bench_rows; n++){
+    MYSQL_ROW row=ds->rows[n % BENCH_POOL_ROWS];
+    gulong *lengths=ds->lengths[n % BENCH_POOL_ROWS];
+    for (i=0; i < ds->num_fields; i++){
+      if (row[i] == NULL || ds->fields[i].flags & NUM_FLAG)
+        continue;
+      g_string_set_size(escaped, lengths[i] * 2 + 1);
+      result->bytes+=m_real_escape_string(conn, escaped->str, row[i], lengths[i]);
+    }
+    result->rows++;
+  }
+  end_result(result);
+  g_string_free(escaped, TRUE);
+}
+
+static void bench_encode(struct bench_dataset *ds, struct bench_result *result, gboolean ld){
+  GString *escaped=g_string_sized_new(3000);
+  GString *statement_row=g_string_sized_new(0);
+  guint64 n=0;
+  if (ld)
+    set_load_data_mode();
+  else
+    set_sql_mode();
+  start_result(result);
+  for (n=0; n < bench_rows; n++){
+    g_string_set_size(statement_row, 0);
+    write_row_into_string(conn, ds->rows[n % BENCH_POOL_ROWS], ds->fields, ds->lengths[n % BENCH_POOL_ROWS], ds->num_fields,
+                          escaped, statement_row, ld ? write_load_data_column_into_string : write_sql_column_into_string);
+    result->bytes+=statement_row->len;
+    result->rows++;
+  }
+  end_result(result);
+  g_string_free(escaped, TRUE);
+  g_string_free(statement_row, TRUE);
+}
+
+static MYSQL_ROW bench_fetch_row(gpointer data, gulong **lengths){
+  struct bench_source *source=data;
+  guint i=0;
+  if (source->next == source->rows)
+    return NULL;
+  i=source->next++ % BENCH_POOL_ROWS;
+  *lengths=source->ds->lengths[i];
+  return source->ds->rows[i];
+}
+
+static void remove_data_file(gchar *filename){
+  if (filename == NULL)
+    return;
+  g_remove(filename);
+  g_free(filename);
+}
+
+/* Runs write_row_into_file_in_sql_mode and
+   write_row_into_file_in_load_data_mode over the pool, writing real data
+   files into dump_directory which are removed afterwards */
+static void bench_writer(struct bench_dataset *ds, struct bench_result *result, gboolean ld, gboolean compress){
+  struct bench_source source={ds, 0, bench_rows};
+  struct mask_reader reader;
+  struct table_job *tj=g_new0(struct table_job, 1);
+  guint64 bytes=td->stats.bytes;
+  if (ld)
+    set_load_data_mode();
+  else
+    set_sql_mode();
+  set_compression(compress);
+  tj->td=td;
+  tj->dbt=dbt;
+  // Built by the writer from the fields of the dataset
+  if (dbt->insert_statement != NULL)
+    g_string_free(dbt->insert_statement, TRUE);
+  dbt->insert_statement=NULL;
+  mask_reader_init_with_source(&reader, ds->fields, ds->num_fields, &bench_fetch_row, &source, NULL);
+  start_result(result);
+  if (ld)
+    result->rows=write_row_into_file_in_load_data_mode(conn, &reader, tj);
+  else
+    result->rows=write_row_into_file_in_sql_mode(conn, &reader, tj);
+  if (tj->sql_file != NULL)
+    close_table_job_file(tj, &(tj->sql_file), tj->sql_filename);
+  if (tj->dat_file != NULL)
+    close_table_job_file(tj, &(tj->dat_file), tj->dat_filename);
+  end_result(result);
+  mask_reader_clear(&reader);
+  result->bytes=td->stats.bytes - bytes;
+  remove_data_file(tj->sql_filename);
+  remove_data_file(tj->dat_filename);
+  g_free(tj);
+}
+
+static void print_result(struct bench_dataset *ds, const gchar *benchmark, struct bench_result *result){
+  gdouble seconds=(gdouble)result->elapsed / G_USEC_PER_SEC;
+  if (seconds <= 0)
+    seconds=1.0 / G_USEC_PER_SEC;
+  printf("%-18s %-22s %14.0f %12.2f %12.2f\n", ds->name, benchmark,
+         result->rows / seconds, result->bytes / seconds / 1024 / 1024,
+         (gdouble)result->allocations / (result->rows ? result->rows : 1));
+}
+
+int main(int argc, char *argv[]){
+  struct bench_result result;
+  GList *datasets=NULL, *l=NULL;
+  if (argc > 1)
+    bench_rows=g_ascii_strtoull(argv[1], NULL, 10);
+  conn=mysql_init(NULL);
+  dump_directory=g_dir_make_tmp("mydumper_bench_XXXXXX", NULL);
+  if (dump_directory == NULL)
+    m_critical("Could not create the temporary directory");
+  // Only the per file message of the writers would show up
+  g_log_set_handler(NULL, G_LOG_LEVEL_MESSAGE, no_log, NULL);
+  dbt=g_new0(struct db_table, 1);
+  dbt->database=g_new0(struct database, 1);
+  dbt->database->name=g_strdup("bench");
+  dbt->database->filename=g_strdup("bench");
+  dbt->table=g_strdup("bench");
+  dbt->table_filename=g_strdup("bench");
+  dbt->chunks_mutex=g_mutex_new();
+  td=g_new0(struct thread_data, 1);
+  td->conf=g_new0(struct configuration, 1);
+  td->statement=g_string_sized_new(2*statement_size);
+  td->statement_row=g_string_sized_new(0);
+  td->escaped=g_string_sized_new(3000);
+  datasets=build_datasets();
+  printf("%-18s %-22s %14s %12s %12s\n", "dataset", "benchmark", "rows/s", "MB/s", "allocs/row");
+  for (l=datasets; l != NULL; l=l->next){
+    struct bench_dataset *ds=l->data;
+    bench_escape(ds, &result);
+    print_result(ds, "m_real_escape_string", &result);
+    bench_encode(ds, &result, FALSE);
+    print_result(ds, "encode_sql", &result);
+    bench_encode(ds, &result, TRUE);
+    print_result(ds, "encode_load_data", &result);
+    bench_writer(ds, &result, FALSE, FALSE);
+    print_result(ds, "write_sql", &result);
+    bench_writer(ds, &result, FALSE, TRUE);
+    print_result(ds, "write_sql_gzip", &result);
+    bench_writer(ds, &result, TRUE, FALSE);
+    print_result(ds, "write_load_data", &result);
+    bench_writer(ds, &result, TRUE, TRUE);
+    print_result(ds, "write_load_data_gzip", &result);
+  }
+  mysql_close(conn);
+  g_rmdir(dump_directory);
+  return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
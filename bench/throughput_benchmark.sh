@@ -0,0 +1,254 @@
+#!/bin/bash
+# End-to-end throughput benchmark for mydumper and myloader.
+#
+# It starts a throwaway mysqld/mariadbd, generates the benchmark tables and
+# runs mydumper/myloader over a matrix of options. Every run is written as one
+# JSON object per line into the report, and compared against the baseline
+# when one is given.
+#
+# Usage: bench/throughput_benchmark.sh [--baseline file] [--save-baseline file] [--report file]
+#
+# Environment:
+#   MYSQLD        mysqld or mariadbd binary, default: the first one in $PATH
+#   ROWS          rows per table, default 200000
+#   SKEW          integer PK gap skew, 1 is uniform, default 1
+#   THREADS       --threads values, default "4 8"
+#   CHUNK_ROWS    --rows values, "" means no row chunking, default "'' 100000"
+#   CHUNK_FILESIZE --chunk-filesize values, default "''"
+#   LOAD_DATA     "'' --load-data"
+#   COMPRESS      "'' --compress"
+#   STREAM        "no yes"
+#   TOLERANCE     wall time regression allowed against the baseline in %, default 10
+#
+# The stream cases report the longest wall time and the added CPU of both
+# processes, and the bytes that went through the pipe.
+
+mydumper_base="."
+mydumper="${mydumper_base}/mydumper"
+myloader="${mydumper_base}/myloader"
+
+ROWS=${ROWS:-200000}
+SKEW=${SKEW:-1}
+THREADS=${THREADS:-"4 8"}
+CHUNK_ROWS=${CHUNK_ROWS:-"'' 100000"}
+CHUNK_FILESIZE=${CHUNK_FILESIZE:-"''"}
+LOAD_DATA=${LOAD_DATA:-"'' --load-data"}
+COMPRESS=${COMPRESS:-"'' --compress"}
+STREAM=${STREAM:-"no yes"}
+TOLERANCE=${TOLERANCE:-10}
+
+report="/tmp/mydumper_throughput.json"
+baseline=""
+save_baseline=""
+while [ $# -gt 0 ]
+do
+  case $1 in
+    --baseline) baseline=$2; shift ;;
+    --save-baseline) save_baseline=$2; shift ;;
+    --report) report=$2; shift ;;
+    *) echo "Unknown option $1"; exit 1 ;;
+  esac
+  shift
+done
+
+work_dir=$(mktemp -d /tmp/mydumper_bench.XXXXXX)
+datadir="${work_dir}/datadir"
+socket="${work_dir}/mysqld.sock"
+dump_dir="${work_dir}/dump"
+# myloader --stream writes the files it receives here, it can not share the
+# directory with mydumper as it would find the files not removed yet
+stream_dir="${work_dir}/stream"
+server_pid=""
+client="mysql --no-defaults -u root -S ${socket}"
+connection="-u root -S ${socket}"
+
+cleanup (){
+  if [ "${server_pid}" != "" ]
+  then
+    kill ${server_pid} 2>/dev/null
+    wait ${server_pid} 2>/dev/null
+  fi
+  rm -rf ${work_dir}
+}
+trap cleanup EXIT
+
+start_server (){
+  if [ "${MYSQLD}" == "" ]
+  then
+    MYSQLD=$(command -v mysqld || command -v mariadbd)
+  fi
+  if [ "${MYSQLD}" == "" ]
+  then
+    echo "mysqld or mariadbd not found, set MYSQLD"
+    exit 1
+  fi
+  mkdir -p ${datadir}
+  if ${MYSQLD} --version | grep -qi mariadb
+  then
+    recursion_variable="max_recursive_iterations"
+    install_db=$(command -v mariadb-install-db || command -v mysql_install_db)
+    ${install_db} --no-defaults --datadir=${datadir} --auth-root-authentication-method=normal > ${work_dir}/init.log 2>&1
+  else
+    recursion_variable="cte_max_recursion_depth"
+    ${MYSQLD} --no-defaults --initialize-insecure --datadir=${datadir} > ${work_dir}/init.log 2>&1
+  fi
+  if (( $? > 0 ))
+  then
+    cat ${work_dir}/init.log
+    exit 1
+  fi
+  ${MYSQLD} --no-defaults --datadir=${datadir} --socket=${socket} --skip-networking \
+    --pid-file=${work_dir}/mysqld.pid --local-infile=1 --max-allowed-packet=1G > ${work_dir}/mysqld.log 2>&1 &
+  server_pid=$!
+  for i in $(seq 1 60)
+  do
+    mysqladmin --no-defaults -u root -S ${socket} ping > /dev/null 2>&1 && return
+    sleep 1
+  done
+  echo "Server did not start"
+  cat ${work_dir}/mysqld.log
+  exit 1
+}
+
+generate_tables (){
+  echo "Generating ${ROWS} rows per table"
+  ${client} <<EOF
+SET SESSION ${recursion_variable}=${ROWS};
+CREATE DATABASE bench;
+USE bench;
+CREATE TABLE seq (n BIGINT PRIMARY KEY);
+INSERT INTO seq WITH RECURSIVE s AS (SELECT 1 AS n UNION ALL SELECT n+1 FROM s WHERE n < ${ROWS}) SELECT n FROM s;
+CREATE TABLE int_pk (id BIGINT PRIMARY KEY, a INT, b VARCHAR(64), c DATETIME);
+INSERT INTO int_pk SELECT n + FLOOR(POW(n / ${ROWS}, ${SKEW}) * ${ROWS} * 10), n % 1000, MD5(n), NOW() - INTERVAL n SECOND FROM seq;
+CREATE TABLE char_pk (id CHAR(32) PRIMARY KEY, a INT, b VARCHAR(255));
+INSERT INTO char_pk SELECT MD5(n), n, REPEAT(SHA1(n), 3) FROM seq;
+CREATE TABLE composite_pk (a INT, b INT, c VARCHAR(64), PRIMARY KEY (a, b));
+INSERT INTO composite_pk SELECT n DIV 100, n % 100, MD5(n) FROM seq;
+CREATE TABLE no_pk (a INT, b VARCHAR(64), c TEXT);
+INSERT INTO no_pk SELECT n, MD5(n), CONCAT('line ''', n, '''\n', SHA1(n)) FROM seq;
+CREATE TABLE partitioned (id BIGINT PRIMARY KEY, a INT, b VARCHAR(64)) PARTITION BY HASH(id) PARTITIONS 8;
+INSERT INTO partitioned SELECT n, n % 1000, MD5(n) FROM seq;
+CREATE TABLE blob_heavy (id BIGINT PRIMARY KEY, b LONGBLOB);
+INSERT INTO blob_heavy SELECT n, REPEAT(UNHEX(SHA2(n, 256)), 32) FROM seq WHERE n % 10 = 0;
+DROP TABLE seq;
+EOF
+  if (( $? > 0 ))
+  then
+    exit 1
+  fi
+  total_rows=$(${client} -N -e "SELECT (SELECT COUNT(*) FROM bench.int_pk) + (SELECT COUNT(*) FROM bench.char_pk) + (SELECT COUNT(*) FROM bench.composite_pk) + (SELECT COUNT(*) FROM bench.no_pk) + (SELECT COUNT(*) FROM bench.partitioned) + (SELECT COUNT(*) FROM bench.blob_heavy)")
+}
+
+# Runs "${@:2}" under /usr/bin/time and writes "wall user sys maxrss_kb" into $1
+timed (){
+  local out=$1
+  shift
+  /usr/bin/time -f "%e %U %S %M" -o ${out} "$@"
+}
+
+sum_time (){
+  awk '{w=($1>w)?$1:w; u+=$2; s+=$3; m=($4>m)?$4:m} END {printf "%s %.2f %.2f %d", w, u, s, m}' "$@"
+}
+
+write_result (){
+  local case_name=$1 tool=$2 times=$3 bytes=$4
+  read wall user sys rss <<< "${times}"
+  local mbps=$(awk -v b=${bytes} -v w=${wall} 'BEGIN {printf "%.2f", (w>0)?b/w/1048576:0}')
+  local rowsps=$(awk -v r=${total_rows} -v w=${wall} 'BEGIN {printf "%.0f", (w>0)?r/w:0}')
+  echo "{\"case\":\"${case_name}\",\"tool\":\"${tool}\",\"wall\":${wall},\"user\":${user},\"sys\":${sys},\"cpu\":$(awk -v u=${user} -v s=${sys} 'BEGIN {print u+s}'),\"max_rss_kb\":${rss},\"bytes\":${bytes},\"mb_per_s\":${mbps},\"rows_per_s\":${rowsps}}" >> ${report}
+  echo "${case_name} ${tool}: ${wall}s ${mbps}MB/s ${rowsps}rows/s cpu ${user}+${sys}s rss ${rss}KB"
+}
+
+drop_bench (){
+  echo "DROP DATABASE IF EXISTS bench_restore" | ${client}
+}
+
+run_case (){
+  local threads=$1 rows=$2 filesize=$3 load_data=$4 compress=$5 stream=$6
+  local mydumper_parameters="${connection} -B bench -o ${dump_dir} --threads ${threads}"
+  local myloader_parameters="${connection} -B bench_restore -d ${dump_dir} --threads ${threads}"
+  [ "${rows}" != "" ] && mydumper_parameters="${mydumper_parameters} --rows ${rows}"
+  [ "${filesize}" != "" ] && mydumper_parameters="${mydumper_parameters} --chunk-filesize ${filesize}"
+  [ "${load_data}" != "" ] && mydumper_parameters="${mydumper_parameters} ${load_data}"
+  [ "${compress}" != "" ] && mydumper_parameters="${mydumper_parameters} ${compress}"
+  local case_name="t${threads}_r${rows:-0}_f${filesize:-0}${load_data:+_ld}${compress:+_c}_${stream}"
+
+  rm -rf ${dump_dir} ${stream_dir}
+  drop_bench
+  if [ "${stream}" == "yes" ]
+  then
+    timed ${work_dir}/stream_dump.time ${mydumper} ${mydumper_parameters} --stream 2>>${work_dir}/mydumper.log | \
+      tee >(wc -c > ${work_dir}/stream.bytes) | \
+      timed ${work_dir}/stream_load.time ${myloader} ${connection} -B bench_restore --threads ${threads} -d ${stream_dir} --stream 2>>${work_dir}/myloader.log
+    local status=("${PIPESTATUS[@]}")
+    if (( status[0] > 0 || status[1] > 0 || status[2] > 0 ))
+    then
+      echo "${case_name} stream failed: ${status[*]}"
+      exit 1
+    fi
+    # tee's process substitution is not waited by the pipeline
+    for i in $(seq 1 50)
+    do
+      [ -s ${work_dir}/stream.bytes ] && break
+      sleep 0.1
+    done
+    local bytes=$(cat ${work_dir}/stream.bytes)
+    rm -f ${work_dir}/stream.bytes
+    write_result ${case_name} stream "$(sum_time ${work_dir}/stream_dump.time ${work_dir}/stream_load.time)" ${bytes:-0}
+  else
+    timed ${work_dir}/dump.time ${mydumper} ${mydumper_parameters} 2>>${work_dir}/mydumper.log || exit 1
+    local bytes=$(du -sb ${dump_dir} | cut -f1)
+    write_result ${case_name} mydumper "$(cat ${work_dir}/dump.time)" ${bytes}
+    timed ${work_dir}/load.time ${myloader} ${myloader_parameters} 2>>${work_dir}/myloader.log || exit 1
+    write_result ${case_name} myloader "$(cat ${work_dir}/load.time)" ${bytes}
+  fi
+}
+
+compare_baseline (){
+  local regressions=0
+  while read line
+  do
+    local key=$(echo "${line}" | sed 's/.*"case":"\([^"]*\)","tool":"\([^"]*\)".*/\1 \2/')
+    local wall=$(echo "${line}" | sed 's/.*"wall":\([0-9.]*\).*/\1/')
+    local base=$(grep "\"case\":\"${key% *}\",\"tool\":\"${key#* }\"" ${baseline} | sed 's/.*"wall":\([0-9.]*\).*/\1/' | head -1)
+    [ "${base}" == "" ] && continue
+    if awk -v w=${wall} -v b=${base} -v t=${TOLERANCE} 'BEGIN {exit !(w > b * (1 + t / 100))}'
+    then
+      echo "REGRESSION ${key}: ${wall}s against ${base}s"
+      regressions=$((regressions + 1))
+    fi
+  done < ${report}
+  echo "${regressions} regressions"
+  # Exit statuses wrap at 256
+  (( regressions > 0 )) && return 1
+  return 0
+}
+
+> ${report}
+start_server
+generate_tables
+
+for threads in ${THREADS}; do
+  for rows in ${CHUNK_ROWS}; do
+    for filesize in ${CHUNK_FILESIZE}; do
+      for load_data in ${LOAD_DATA}; do
+        for compress in ${COMPRESS}; do
+          for stream in ${STREAM}; do
+            eval run_case ${threads} "${rows}" "${filesize}" "${load_data}" "${compress}" ${stream}
+          done
+        done
+      done
+    done
+  done
+done
+
+echo "Report written in ${report}"
+if [ "${save_baseline}" != "" ]
+then
+  cp ${report} ${save_baseline}
+fi
+if [ "${baseline}" != "" ]
+then
+  compare_baseline
+  exit $?
+fi
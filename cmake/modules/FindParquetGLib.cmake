@@ -0,0 +1,34 @@
+#
+#    This program is free software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#    GNU General Public License for more details.
+#
+#    You should have received a copy of the GNU General Public License
+#    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+#        Authors:        David Ducos, Percona (david dot ducos at percona dot com)
+
+if(PARQUET_GLIB_INCLUDE_DIR AND PARQUET_GLIB_LIBRARIES)
+    # Already in cache, be silent
+    set(PARQUET_GLIB_FIND_QUIETLY TRUE)
+endif(PARQUET_GLIB_INCLUDE_DIR AND PARQUET_GLIB_LIBRARIES)
+
+if (NOT WIN32)
+   include(FindPkgConfig)
+   pkg_search_module(PC_ARROW_GLIB REQUIRED arrow-glib)
+   pkg_search_module(PC_PARQUET_GLIB REQUIRED parquet-glib)
+endif(NOT WIN32)
+
+set(PARQUET_GLIB_INCLUDE_DIR ${PC_ARROW_GLIB_INCLUDE_DIRS} ${PC_PARQUET_GLIB_INCLUDE_DIRS})
+
+find_library(ARROW_GLIB_LIBRARY NAMES arrow-glib HINTS ${PC_ARROW_GLIB_LIBDIR} ${PC_ARROW_GLIB_LIBRARY_DIRS})
+find_library(PARQUET_GLIB_LIBRARY NAMES parquet-glib HINTS ${PC_PARQUET_GLIB_LIBDIR} ${PC_PARQUET_GLIB_LIBRARY_DIRS})
+set(PARQUET_GLIB_LIBRARIES ${PARQUET_GLIB_LIBRARY} ${ARROW_GLIB_LIBRARY})
+
+mark_as_advanced(PARQUET_GLIB_INCLUDE_DIR PARQUET_GLIB_LIBRARIES)
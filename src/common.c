@@ -181,7 +181,7 @@ void load_hash_from_key_file(GKeyFile *kf, GHashTable * set_session_hash, const
   g_strfreev(keys);
 }
 
-void load_per_table_info_from_key_file(GKeyFile *kf, struct configuration_per_table * conf_per_table, fun_ptr get_function_pointer_for()){
+void load_per_table_info_from_key_file(GKeyFile *kf, struct configuration_per_table * conf_per_table, struct function_pointer * new_function_pointer(gchar *)){
   gsize len=0,len2=0;
   gchar **groups=g_key_file_get_groups(kf,&len);
   GHashTable *ht=NULL;
@@ -196,10 +196,7 @@ void load_per_table_info_from_key_file(GKeyFile *kf, struct configuration_per_ta
       for (j=0; j < len2; j++){
         if (g_str_has_prefix(keys[j],"`") && g_str_has_suffix(keys[j],"`")){
           value = g_key_file_get_value(kf,groups[i],keys[j],&error);
-          struct function_pointer *fp = g_new0(struct function_pointer, 1);
-          fp->function=get_function_pointer_for(value);
-          fp->memory=g_hash_table_new ( g_str_hash, g_str_equal );
-          g_hash_table_insert(ht,g_strndup(keys[j]+1,strlen(keys[j])-2), fp);
+          g_hash_table_insert(ht,g_strndup(keys[j]+1,strlen(keys[j])-2), new_function_pointer(value));
         }else{
           if (g_strcmp0(keys[j],"where") == 0){
             value = g_key_file_get_value(kf,groups[i],keys[j],&error);
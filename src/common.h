@@ -31,11 +31,27 @@ struct configuration_per_table{
 
 #define STREAM_BUFFER_SIZE 1000000
 #define DEFAULTS_FILE "/etc/mydumper.cnf"
-typedef gchar * (*fun_ptr)(gchar **, GHashTable *);
 
+// --format=binary data files: the magic, then one record per row with the
+// column count as guint16 and, per column, the MYSQL_FIELD type as one byte
+// and the length as guint32, both little endian, followed by the raw value.
+#define BINARY_FORMAT_MAGIC "MYDBIN01"
+#define BINARY_FORMAT_MAGIC_LENGTH 8
+#define BINARY_FORMAT_NULL_LENGTH 0xFFFFFFFF
+// zstd dictionaries are written as database.table.zdict, and schema.zdict for
+// the table schemas
+#define DICTIONARY_EXTENSION "zdict"
+#define SCHEMA_DICTIONARY "schema"
+struct function_pointer;
+struct mask_column;
+typedef void (*fun_ptr)(struct mask_column *, struct function_pointer *);
+
+// min and max are the parameters of the functions that take them, like
+// numeric_range and date_shift
 struct function_pointer{
   fun_ptr function;
-  GHashTable *memory;
+  gint64 min;
+  gint64 max;
 };
 
 char * checksum_table_structure(MYSQL *conn, char *database, char *table, int *errn);
@@ -56,7 +72,7 @@ gchar *replace_escaped_strings(gchar *c);
 void escape_tab_with(gchar *to);
 void load_hash_from_key_file(GKeyFile *kf, GHashTable * set_session_hash, const gchar * group_variables);
 //void load_anonymized_functions_from_key_file(GKeyFile *kf, GHashTable *all_anonymized_function, fun_ptr get_function_pointer_for());
-void load_per_table_info_from_key_file(GKeyFile *kf, struct configuration_per_table * conf_per_table, fun_ptr get_function_pointer_for());
+void load_per_table_info_from_key_file(GKeyFile *kf, struct configuration_per_table * conf_per_table, struct function_pointer * new_function_pointer(gchar *));
 void refresh_set_session_from_hash(GString *ss, GHashTable * set_session_hash);
 void refresh_set_global_from_hash(GString *ss, GString *sr, GHashTable * set_global_hash);
 gboolean is_table_in_list(gchar *table_name, gchar **tl);
@@ -165,6 +165,24 @@ void m_connect(MYSQL *conn, const gchar *app, gchar *schema){
     mysql_query(conn, set_names_statement);
 }
 
+// Connects to another server with the same credentials and options
+void m_connect_to_host(MYSQL *conn, const gchar *app, const gchar *host, guint host_port){
+  configure_connection(conn, app);
+  if (!mysql_real_connect(conn, host, username, password, NULL, host_port,
+                          NULL, 0)) {
+    m_critical("Error connection to %s: %s", host, mysql_error(conn));
+  }
+}
+
+// Same as m_connect_to_host, or m_connect when host is NULL, but a failure
+// is left to the caller
+gboolean m_try_connect_to_host(MYSQL *conn, const gchar *app, const gchar *host, guint host_port){
+  configure_connection(conn, app);
+  if (host == NULL)
+    return mysql_real_connect(conn, hostname, username, password, NULL, port, socket_path, 0) != NULL;
+  return mysql_real_connect(conn, host, username, password, NULL, host_port, NULL, 0) != NULL;
+}
+
 void hide_password(int argc, char *argv[]){
   if (password != NULL){
     int i=1;
@@ -23,6 +23,8 @@
 //void configure_connection(MYSQL *conn, const char *name);
 void initialize_connection(char *cdf);
 void m_connect(MYSQL *conn, const gchar *app, gchar *schema);
+void m_connect_to_host(MYSQL *conn, const gchar *app, const gchar *host, guint host_port);
+gboolean m_try_connect_to_host(MYSQL *conn, const gchar *app, const gchar *host, guint host_port);
 void hide_password(int argc, char *argv[]);
 void ask_password();
 GOptionGroup * load_connection_entries(GOptionContext *context);
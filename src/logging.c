@@ -31,9 +31,44 @@
 #include <signal.h>
 #include <glib/gstdio.h>
 
+#include "logging.h"
+
 gchar *logfile;
 FILE *logoutfile;
 
+// Every thread logs into its own ring buffer and log_writer_thread is the
+// only one writing into logoutfile. Errors and criticals are written in the
+// caller thread after flushing the rings, as the program might exit next.
+#define LOG_RING_SIZE 1024
+#define LOG_SLOT_SIZE 480
+#define LOG_FLUSH_INTERVAL 50000
+
+struct log_slot {
+  gint64 time;
+  GLogLevelFlags level;
+  gchar *long_message;
+  gchar message[LOG_SLOT_SIZE];
+};
+
+// Single producer ring: the owner thread moves head, the writer moves tail
+struct log_ring {
+  struct log_slot slots[LOG_RING_SIZE];
+  volatile gint head;
+  volatile gint tail;
+  volatile gint suppressed;
+};
+
+static void free_log_ring(gpointer data);
+
+static GPrivate log_ring_key = G_PRIVATE_INIT(free_log_ring);
+static GMutex *log_rings_mutex = NULL;
+static GMutex *log_write_mutex = NULL;
+static GList *log_rings = NULL;
+static GThread *log_writer = NULL;
+static gint log_writer_stop = 0;
+static time_t log_date_second = 0;
+static gchar log_date[20];
+
 void no_log(const gchar *log_domain, GLogLevelFlags log_level,
             const gchar *message, gpointer user_data) {
   (void)log_domain;
@@ -42,15 +77,199 @@ void no_log(const gchar *log_domain, GLogLevelFlags log_level,
   (void)user_data;
 }
 
+static const gchar *log_level_label(GLogLevelFlags log_level) {
+  if (log_level & G_LOG_LEVEL_DEBUG)
+    return " [DEBUG] - ";
+  if ((log_level & G_LOG_LEVEL_INFO) || (log_level & G_LOG_LEVEL_MESSAGE))
+    return " [INFO] - ";
+  if (log_level & G_LOG_LEVEL_WARNING)
+    return " [WARNING] - ";
+  if ((log_level & G_LOG_LEVEL_ERROR) || (log_level & G_LOG_LEVEL_CRITICAL))
+    return " [ERROR] - ";
+  return "";
+}
+
+// The date only changes once per second, so it is formatted once per second
+static void append_log_line(GString *out, time_t rawtime, GLogLevelFlags log_level, const gchar *message,
+                            gchar *date, time_t *date_second) {
+  struct tm timeinfo;
+  if (rawtime != *date_second) {
+    localtime_r(&rawtime, &timeinfo);
+    strftime(date, 20, "%Y-%m-%d %H:%M:%S", &timeinfo);
+    *date_second = rawtime;
+  }
+  g_string_append(out, date);
+  g_string_append(out, log_level_label(log_level));
+  g_string_append(out, message);
+  g_string_append_c(out, '\n');
+}
+
+static void write_log_buffer(GString *out) {
+  if (out->len > 0 && write(fileno(logoutfile), out->str, out->len) <= 0) {
+    fprintf(stderr, "Cannot write to log file with error %d.  Exiting...",
+            errno);
+  }
+  g_string_set_size(out, 0);
+}
+
+// Only called with log_write_mutex locked
+static void flush_log_rings(GString *out) {
+  GList *l = NULL;
+  g_mutex_lock(log_rings_mutex);
+  for (l = log_rings; l != NULL; l = l->next) {
+    struct log_ring *ring = l->data;
+    gint tail = g_atomic_int_get(&(ring->tail));
+    gint head = g_atomic_int_get(&(ring->head));
+    for (; tail != head; tail = (gint)((guint)tail + 1)) {
+      struct log_slot *slot = &(ring->slots[(guint)tail % LOG_RING_SIZE]);
+      append_log_line(out, slot->time / G_USEC_PER_SEC, slot->level,
+                      slot->long_message ? slot->long_message : slot->message,
+                      log_date, &log_date_second);
+      if (slot->long_message) {
+        g_free(slot->long_message);
+        slot->long_message = NULL;
+      }
+    }
+    g_atomic_int_set(&(ring->tail), tail);
+    gint suppressed = g_atomic_int_get(&(ring->suppressed));
+    if (suppressed > 0) {
+      g_atomic_int_add(&(ring->suppressed), -suppressed);
+      gchar *aggregated = g_strdup_printf("%d info messages were not logged as the log writer was behind", suppressed);
+      append_log_line(out, time(NULL), G_LOG_LEVEL_MESSAGE, aggregated, log_date, &log_date_second);
+      g_free(aggregated);
+    }
+  }
+  g_mutex_unlock(log_rings_mutex);
+  write_log_buffer(out);
+}
+
+static void *log_writer_thread(void *data) {
+  (void)data;
+  GString *out = g_string_sized_new(LOG_RING_SIZE * 64);
+  while (!g_atomic_int_get(&log_writer_stop)) {
+    g_usleep(LOG_FLUSH_INTERVAL);
+    g_mutex_lock(log_write_mutex);
+    flush_log_rings(out);
+    g_mutex_unlock(log_write_mutex);
+  }
+  g_string_free(out, TRUE);
+  return NULL;
+}
+
+static struct log_ring *get_log_ring() {
+  struct log_ring *ring = g_private_get(&log_ring_key);
+  if (ring == NULL) {
+    ring = g_new0(struct log_ring, 1);
+    g_mutex_lock(log_rings_mutex);
+    log_rings = g_list_append(log_rings, ring);
+    g_mutex_unlock(log_rings_mutex);
+    g_private_set(&log_ring_key, ring);
+  }
+  return ring;
+}
+
+// Called when the owner thread exits: its lines are written before the ring
+// is freed. The rings left in the list are freed by stop_async_log.
+static void free_log_ring(gpointer data) {
+  struct log_ring *ring = data;
+  GString *out = g_string_sized_new(4096);
+  GList *link = NULL;
+  g_mutex_lock(log_write_mutex);
+  flush_log_rings(out);
+  g_mutex_lock(log_rings_mutex);
+  link = g_list_find(log_rings, ring);
+  if (link != NULL)
+    log_rings = g_list_delete_link(log_rings, link);
+  g_mutex_unlock(log_rings_mutex);
+  g_mutex_unlock(log_write_mutex);
+  g_string_free(out, TRUE);
+  if (link != NULL)
+    g_free(ring);
+}
+
+static void write_log_line_sync(GLogLevelFlags log_level, const gchar *message) {
+  GString *out = g_string_sized_new(256);
+  gchar date[20];
+  time_t date_second = 0;
+  if (log_writer == NULL) {
+    append_log_line(out, time(NULL), log_level, message, date, &date_second);
+    write_log_buffer(out);
+  } else {
+    g_mutex_lock(log_write_mutex);
+    flush_log_rings(out);
+    append_log_line(out, time(NULL), log_level, message, log_date, &log_date_second);
+    write_log_buffer(out);
+    g_mutex_unlock(log_write_mutex);
+  }
+  g_string_free(out, TRUE);
+}
+
+static void write_log_line_async(GLogLevelFlags log_level, const gchar *message) {
+  struct log_ring *ring = get_log_ring();
+  gint head = g_atomic_int_get(&(ring->head));
+  guint used = (guint)head - (guint)g_atomic_int_get(&(ring->tail));
+  if (!(log_level & G_LOG_LEVEL_WARNING) && used >= LOG_RING_SIZE * 3 / 4) {
+    // Progress lines can wait for the writer to catch up, they are counted
+    g_atomic_int_inc(&(ring->suppressed));
+    return;
+  }
+  while (used >= LOG_RING_SIZE) {
+    // Warnings are never dropped
+    if (log_writer == NULL) {
+      write_log_line_sync(log_level, message);
+      return;
+    }
+    g_usleep(LOG_FLUSH_INTERVAL / 10);
+    used = (guint)head - (guint)g_atomic_int_get(&(ring->tail));
+  }
+  struct log_slot *slot = &(ring->slots[(guint)head % LOG_RING_SIZE]);
+  slot->time = g_get_real_time();
+  slot->level = log_level;
+  if (g_strlcpy(slot->message, message, LOG_SLOT_SIZE) >= LOG_SLOT_SIZE)
+    slot->long_message = g_strdup(message);
+  g_atomic_int_set(&(ring->head), (gint)((guint)head + 1));
+}
+
+void start_async_log() {
+  GError *serror = NULL;
+  if (log_writer != NULL)
+    return;
+  if (log_rings_mutex == NULL)
+    log_rings_mutex = g_mutex_new();
+  if (log_write_mutex == NULL)
+    log_write_mutex = g_mutex_new();
+  log_writer = g_thread_create(log_writer_thread, NULL, TRUE, &serror);
+  if (log_writer == NULL) {
+    fprintf(stderr, "Could not create log writer thread: %s\n", serror->message);
+    g_error_free(serror);
+  }
+}
+
+void stop_async_log() {
+  GString *out = NULL;
+  if (log_writer == NULL)
+    return;
+  g_atomic_int_set(&log_writer_stop, 1);
+  g_thread_join(log_writer);
+  out = g_string_sized_new(4096);
+  g_mutex_lock(log_write_mutex);
+  flush_log_rings(out);
+  log_writer = NULL;
+  g_mutex_lock(log_rings_mutex);
+  g_list_free_full(log_rings, g_free);
+  log_rings = NULL;
+  g_private_set(&log_ring_key, NULL);
+  g_mutex_unlock(log_rings_mutex);
+  g_mutex_unlock(log_write_mutex);
+  g_atomic_int_set(&log_writer_stop, 0);
+  g_string_free(out, TRUE);
+}
+
 void write_log_file(const gchar *log_domain, GLogLevelFlags log_level,
                     const gchar *message, gpointer user_data) {
   (void)log_domain;
   (void)user_data;
 
-  gchar date[20];
-  time_t rawtime;
-  struct tm timeinfo;
-
   // Don't log debug if debugging off
 #if GLIB_CHECK_VERSION(2,68,0)
   if ((log_level & G_LOG_LEVEL_DEBUG) &&
@@ -59,27 +278,8 @@ void write_log_file(const gchar *log_domain, GLogLevelFlags log_level,
   }
 #endif
 
-  time(&rawtime);
-  localtime_r(&rawtime, &timeinfo);
-  strftime(date, 20, "%Y-%m-%d %H:%M:%S", &timeinfo);
-
-  GString *message_out = g_string_new(date);
-  if (log_level & G_LOG_LEVEL_DEBUG) {
-    g_string_append(message_out, " [DEBUG] - ");
-  } else if ((log_level & G_LOG_LEVEL_INFO) ||
-             (log_level & G_LOG_LEVEL_MESSAGE)) {
-    g_string_append(message_out, " [INFO] - ");
-  } else if (log_level & G_LOG_LEVEL_WARNING) {
-    g_string_append(message_out, " [WARNING] - ");
-  } else if ((log_level & G_LOG_LEVEL_ERROR) ||
-             (log_level & G_LOG_LEVEL_CRITICAL)) {
-    g_string_append(message_out, " [ERROR] - ");
-  }
-
-  g_string_append_printf(message_out, "%s\n", message);
-  if (write(fileno(logoutfile), message_out->str, message_out->len) <= 0) {
-    fprintf(stderr, "Cannot write to log file with error %d.  Exiting...",
-            errno);
-  }
-  g_string_free(message_out, TRUE);
+  if (log_writer == NULL || (log_level & (G_LOG_LEVEL_ERROR | G_LOG_LEVEL_CRITICAL)))
+    write_log_line_sync(log_level, message);
+  else
+    write_log_line_async(log_level, message);
 }
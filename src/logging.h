@@ -31,5 +31,7 @@ void no_log(const gchar *log_domain, GLogLevelFlags log_level,
 
 void write_log_file(const gchar *log_domain, GLogLevelFlags log_level,
                     const gchar *message, gpointer user_data);
+void start_async_log();
+void stop_async_log();
 
 #endif
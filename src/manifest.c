@@ -0,0 +1,389 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include "manifest.h"
+
+G_STATIC_ASSERT(sizeof(struct manifest_header) == 16);
+G_STATIC_ASSERT(sizeof(struct manifest_entry) == 48);
+
+struct manifest_file {
+  gchar *filename;
+  gchar *database;
+  gchar *table;
+  gchar *key;
+  guint part;
+  guint sub_part;
+  guint64 size;
+  guint64 rows;
+  guint64 table_size;
+  enum manifest_file_type type;
+  guint volume;
+};
+
+static const struct {
+  const gchar *suffix;
+  enum manifest_file_type type;
+} manifest_suffixes[] = {
+  { "-schema-create.sql",   MANIFEST_SCHEMA_CREATE },
+  { "-schema-view.sql",     MANIFEST_SCHEMA_VIEW },
+  { "-schema-sequence.sql", MANIFEST_SCHEMA_SEQUENCE },
+  { "-schema-triggers.sql", MANIFEST_SCHEMA_TRIGGER },
+  { "-schema-post.sql",     MANIFEST_SCHEMA_POST },
+  { "-schema.sql",          MANIFEST_SCHEMA_TABLE },
+  { "-metadata",            MANIFEST_METADATA_TABLE },
+  { "-checksum",            MANIFEST_CHECKSUM },
+  { ".sql",                 MANIFEST_DATA },
+  { ".dat",                 MANIFEST_LOAD_DATA },
+  { NULL,                   MANIFEST_OTHER }
+};
+
+static gchar *strip_compression_extension(const gchar *filename){
+  if (g_str_has_suffix(filename, ".gz"))
+    return g_strndup(filename, strlen(filename) - 3);
+  if (g_str_has_suffix(filename, ".zst"))
+    return g_strndup(filename, strlen(filename) - 4);
+  return g_strdup(filename);
+}
+
+// Same naming rules that myloader uses to process the directory
+static void parse_manifest_file(struct manifest_file *mf){
+  gchar *name=strip_compression_extension(mf->filename), *base=NULL, *dash;
+  gchar **split;
+  guint i, n;
+  mf->type=MANIFEST_OTHER;
+  if (g_strcmp0(name, "metadata") == 0){
+    mf->type=MANIFEST_METADATA_GLOBAL;
+  }else if (g_strcmp0(name, "all-schema-create-tablespace.sql") == 0){
+    mf->type=MANIFEST_SCHEMA_TABLESPACE;
+  }else{
+    for (i=0; manifest_suffixes[i].suffix != NULL; i++){
+      if (g_str_has_suffix(name, manifest_suffixes[i].suffix)){
+        mf->type=manifest_suffixes[i].type;
+        base=g_strndup(name, strlen(name) - strlen(manifest_suffixes[i].suffix));
+        break;
+      }
+    }
+  }
+  if (base != NULL){
+    // db.table-schema-checksum, db-schema-create-checksum, ...
+    if (mf->type == MANIFEST_CHECKSUM && (dash=strchr(base, '-')) != NULL)
+      *dash='\0';
+    split=g_strsplit(base, ".", 0);
+    n=g_strv_length(split);
+    if (n >= 1)
+      mf->database=g_strdup(split[0]);
+    if (n >= 2 && mf->type != MANIFEST_SCHEMA_CREATE && mf->type != MANIFEST_SCHEMA_POST)
+      mf->table=g_strdup(split[1]);
+    if (mf->type == MANIFEST_DATA || mf->type == MANIFEST_LOAD_DATA){
+      if (n >= 3)
+        mf->part=g_ascii_strtoull(split[2], NULL, 10);
+      if (n >= 4)
+        mf->sub_part=g_ascii_strtoull(split[3], NULL, 10);
+    }
+    if (mf->table != NULL)
+      mf->key=g_strdup_printf("%s.%s", mf->database, mf->table);
+    g_strfreev(split);
+    g_free(base);
+  }
+  g_free(name);
+}
+
+static gint compare_manifest_file(gconstpointer a, gconstpointer b){
+  const struct manifest_file *x=*(struct manifest_file **)a, *y=*(struct manifest_file **)b;
+  gint r;
+  if (x->type != y->type)
+    return x->type < y->type ? -1 : 1;
+  if (x->table_size != y->table_size)
+    return x->table_size > y->table_size ? -1 : 1;
+  if ((r=g_strcmp0(x->key, y->key)) != 0)
+    return r;
+  if (x->part != y->part)
+    return x->part < y->part ? -1 : 1;
+  if (x->sub_part != y->sub_part)
+    return x->sub_part < y->sub_part ? -1 : 1;
+  return g_strcmp0(x->filename, y->filename);
+}
+
+static void free_manifest_file(gpointer data){
+  struct manifest_file *mf=data;
+  g_free(mf->filename);
+  g_free(mf->database);
+  g_free(mf->table);
+  g_free(mf->key);
+  g_free(mf);
+}
+
+static guint32 add_manifest_string(GString *strings, GHashTable *offsets, const gchar *s){
+  gpointer offset;
+  if (s == NULL)
+    return MANIFEST_NONE;
+  if (g_hash_table_lookup_extended(offsets, s, NULL, &offset))
+    return GPOINTER_TO_UINT(offset);
+  guint32 r=strings->len;
+  g_string_append_len(strings, s, strlen(s) + 1);
+  g_hash_table_insert(offsets, g_strdup(s), GUINT_TO_POINTER(r));
+  return r;
+}
+
+static gboolean add_manifest_directory(const gchar *directory, guint volume, GPtrArray *files,
+                                       GHashTable *table_rows, GHashTable *table_sizes){
+  GError *error=NULL;
+  GDir *dir=g_dir_open(directory, 0, &error);
+  const gchar *filename;
+  struct manifest_file *mf;
+  GStatBuf st;
+  guint64 *table_size, *rows;
+  gchar *path;
+  if (dir == NULL){
+    g_warning("Manifest not written, could not open %s: %s", directory, error->message);
+    g_error_free(error);
+    return FALSE;
+  }
+  while ((filename = g_dir_read_name(dir))){
+    if (g_strcmp0(filename, MANIFEST_FILENAME) == 0)
+      continue;
+    path=g_build_filename(directory, filename, NULL);
+    if (g_stat(path, &st) != 0 || !S_ISREG(st.st_mode)){
+      g_free(path);
+      continue;
+    }
+    g_free(path);
+    mf=g_new0(struct manifest_file, 1);
+    mf->filename=g_strdup(filename);
+    mf->size=st.st_size;
+    mf->volume=volume;
+    parse_manifest_file(mf);
+    if (mf->key != NULL){
+      rows=g_hash_table_lookup(table_rows, mf->key);
+      mf->rows=rows != NULL ? *rows : 0;
+      if (mf->type == MANIFEST_DATA || mf->type == MANIFEST_LOAD_DATA){
+        table_size=g_hash_table_lookup(table_sizes, mf->key);
+        if (table_size == NULL){
+          table_size=g_new0(guint64, 1);
+          g_hash_table_insert(table_sizes, mf->key, table_size);
+        }
+        *table_size+=mf->size;
+      }
+    }
+    g_ptr_array_add(files, mf);
+  }
+  g_dir_close(dir);
+  return TRUE;
+}
+
+// table_rows maps "database.table", with the names used in the filenames, to
+// a guint64 with the rows dumped. volumes are the other directories where the
+// data files were written, NULL when there are none.
+gboolean write_manifest(const gchar *directory, gchar **volumes, GHashTable *table_rows){
+  GPtrArray *files=g_ptr_array_new_with_free_func(free_manifest_file);
+  GHashTable *table_sizes=g_hash_table_new_full(g_str_hash, g_str_equal, NULL, g_free);
+  GHashTable *dependencies=g_hash_table_new(g_str_hash, g_str_equal);
+  GHashTable *offsets=g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  GString *strings=g_string_sized_new(65536);
+  struct manifest_file *mf;
+  struct manifest_header header;
+  struct manifest_entry entry;
+  guint64 *table_size;
+  gpointer dependency;
+  const gchar *dependency_key;
+  gchar *path=NULL;
+  guint i, n_volumes=volumes != NULL ? g_strv_length(volumes) : 0;
+  gboolean r=TRUE;
+
+  if (n_volumes > MANIFEST_MAX_VOLUMES){
+    g_warning("Manifest not written, there are more than %d volumes", MANIFEST_MAX_VOLUMES);
+    r=FALSE;
+    goto cleanup;
+  }
+  if (!add_manifest_directory(directory, 0, files, table_rows, table_sizes)){
+    r=FALSE;
+    goto cleanup;
+  }
+  for (i=0; i < n_volumes; i++){
+    if (!add_manifest_directory(volumes[i], i + 1, files, table_rows, table_sizes)){
+      r=FALSE;
+      goto cleanup;
+    }
+    mf=g_new0(struct manifest_file, 1);
+    mf->filename=g_strdup(volumes[i]);
+    mf->type=MANIFEST_VOLUME;
+    mf->part=i + 1;
+    g_ptr_array_add(files, mf);
+  }
+
+  for (i=0; i < files->len; i++){
+    mf=g_ptr_array_index(files, i);
+    if (mf->key != NULL && (table_size=g_hash_table_lookup(table_sizes, mf->key)) != NULL)
+      mf->table_size=*table_size;
+  }
+  g_ptr_array_sort(files, compare_manifest_file);
+  for (i=0; i < files->len; i++){
+    mf=g_ptr_array_index(files, i);
+    if (mf->type == MANIFEST_SCHEMA_CREATE)
+      g_hash_table_insert(dependencies, mf->database, GUINT_TO_POINTER(i));
+    else if (mf->type == MANIFEST_SCHEMA_TABLE && mf->key != NULL)
+      g_hash_table_insert(dependencies, mf->key, GUINT_TO_POINTER(i));
+  }
+
+  path=g_build_filename(directory, MANIFEST_FILENAME, NULL);
+  FILE *file=g_fopen(path, "w");
+  if (file == NULL){
+    g_warning("Manifest not written, could not open %s (%d)", path, errno);
+    r=FALSE;
+    goto cleanup;
+  }
+  // The string table goes last, the entries are written once it is complete
+  memset(&header, 0, sizeof(header));
+  fwrite(&header, sizeof(header), 1, file);
+  for (i=0; i < files->len; i++){
+    mf=g_ptr_array_index(files, i);
+    memset(&entry, 0, sizeof(entry));
+    entry.filename=GUINT32_TO_LE(add_manifest_string(strings, offsets, mf->filename));
+    entry.database=GUINT32_TO_LE(add_manifest_string(strings, offsets, mf->database));
+    entry.table=GUINT32_TO_LE(add_manifest_string(strings, offsets, mf->table));
+    if (mf->type == MANIFEST_SCHEMA_TABLE || mf->type == MANIFEST_SCHEMA_VIEW ||
+        mf->type == MANIFEST_SCHEMA_SEQUENCE || mf->type == MANIFEST_SCHEMA_POST)
+      dependency_key=mf->database;
+    else
+      dependency_key=mf->key;
+    entry.dependency=GUINT32_TO_LE(dependency_key != NULL &&
+        g_hash_table_lookup_extended(dependencies, dependency_key, NULL, &dependency) ?
+        GPOINTER_TO_UINT(dependency) : MANIFEST_NONE);
+    entry.part=GUINT32_TO_LE(mf->part);
+    entry.sub_part=GUINT32_TO_LE(mf->sub_part);
+    entry.size=GUINT64_TO_LE(mf->size);
+    entry.rows=GUINT64_TO_LE(mf->rows);
+    entry.type=mf->type;
+    entry.volume=mf->volume;
+    fwrite(&entry, sizeof(entry), 1, file);
+  }
+  fwrite(strings->str, 1, strings->len, file);
+  memcpy(header.magic, MANIFEST_MAGIC, MANIFEST_MAGIC_LENGTH);
+  header.entries=GUINT32_TO_LE(files->len);
+  header.strings_length=GUINT32_TO_LE(strings->len);
+  fseek(file, 0, SEEK_SET);
+  fwrite(&header, sizeof(header), 1, file);
+  if (fclose(file) != 0){
+    g_warning("Manifest not written, error closing %s (%d)", path, errno);
+    g_unlink(path);
+    r=FALSE;
+  }
+
+cleanup:
+  g_free(path);
+  g_string_free(strings, TRUE);
+  g_hash_table_destroy(offsets);
+  g_hash_table_destroy(dependencies);
+  g_hash_table_destroy(table_sizes);
+  g_ptr_array_free(files, TRUE);
+  return r;
+}
+
+static gboolean check_manifest_string(guint32 offset, guint32 strings_length, gboolean optional){
+  return offset < strings_length || (optional && offset == MANIFEST_NONE);
+}
+
+static void read_manifest_entry(const gchar *contents, guint i, struct manifest_entry *entry){
+  memcpy(entry, contents + sizeof(struct manifest_header) + (gsize)i * sizeof(struct manifest_entry), sizeof(struct manifest_entry));
+  entry->filename=GUINT32_FROM_LE(entry->filename);
+  entry->database=GUINT32_FROM_LE(entry->database);
+  entry->table=GUINT32_FROM_LE(entry->table);
+  entry->dependency=GUINT32_FROM_LE(entry->dependency);
+  entry->part=GUINT32_FROM_LE(entry->part);
+  entry->sub_part=GUINT32_FROM_LE(entry->sub_part);
+  entry->size=GUINT64_FROM_LE(entry->size);
+  entry->rows=GUINT64_FROM_LE(entry->rows);
+}
+
+// Maps the manifest and calls func for every file in order. Nothing is
+// called when the manifest is not valid. volumes replaces, in order, the
+// directories of the volumes recorded in the manifest.
+gboolean read_manifest(const gchar *directory, gchar **volumes, manifest_entry_func func, gpointer user_data){
+  GError *error=NULL;
+  gchar *path=g_build_filename(directory, MANIFEST_FILENAME, NULL);
+  GMappedFile *mapped=g_mapped_file_new(path, FALSE, &error);
+  struct manifest_header header;
+  struct manifest_entry entry;
+  const gchar *contents, *strings;
+  const gchar *volume_directories[MANIFEST_MAX_VOLUMES + 1];
+  gsize length;
+  guint i, n_volumes=volumes != NULL ? g_strv_length(volumes) : 0;
+  if (mapped == NULL){
+    g_warning("Manifest %s could not be opened: %s", path, error->message);
+    g_error_free(error);
+    g_free(path);
+    return FALSE;
+  }
+  contents=g_mapped_file_get_contents(mapped);
+  length=g_mapped_file_get_length(mapped);
+  if (length < sizeof(header))
+    goto invalid;
+  memcpy(&header, contents, sizeof(header));
+  header.entries=GUINT32_FROM_LE(header.entries);
+  header.strings_length=GUINT32_FROM_LE(header.strings_length);
+  if (memcmp(header.magic, MANIFEST_MAGIC, MANIFEST_MAGIC_LENGTH) != 0 ||
+      length != sizeof(header) + (gsize)header.entries * sizeof(entry) + header.strings_length)
+    goto invalid;
+  strings=contents + sizeof(header) + (gsize)header.entries * sizeof(entry);
+  if (header.entries > 0 && (header.strings_length == 0 || strings[header.strings_length - 1] != '\0'))
+    goto invalid;
+  for (i=0; i < header.entries; i++){
+    read_manifest_entry(contents, i, &entry);
+    if (!check_manifest_string(entry.filename, header.strings_length, FALSE) ||
+        !check_manifest_string(entry.database, header.strings_length, TRUE) ||
+        !check_manifest_string(entry.table, header.strings_length, TRUE) ||
+        entry.type > MANIFEST_VOLUME ||
+        (entry.dependency != MANIFEST_NONE && entry.dependency >= header.entries))
+      goto invalid;
+  }
+  memset(volume_directories, 0, sizeof(volume_directories));
+  for (i=0; i < header.entries; i++){
+    read_manifest_entry(contents, i, &entry);
+    if (entry.type == MANIFEST_VOLUME){
+      if (entry.part == 0 || entry.part > MANIFEST_MAX_VOLUMES)
+        goto invalid;
+      volume_directories[entry.part]=entry.part <= n_volumes ? volumes[entry.part - 1] : strings + entry.filename;
+    }
+  }
+  for (i=0; i < header.entries; i++){
+    read_manifest_entry(contents, i, &entry);
+    if (entry.type != MANIFEST_VOLUME && entry.volume != 0 && volume_directories[entry.volume] == NULL)
+      goto invalid;
+  }
+  for (i=0; i < header.entries; i++){
+    read_manifest_entry(contents, i, &entry);
+    if (entry.type == MANIFEST_VOLUME)
+      continue;
+    func(entry.type, strings + entry.filename, volume_directories[entry.volume],
+         entry.database == MANIFEST_NONE ? NULL : strings + entry.database,
+         entry.table == MANIFEST_NONE ? NULL : strings + entry.table,
+         entry.part, entry.sub_part, entry.size, entry.rows, user_data);
+  }
+  g_mapped_file_unref(mapped);
+  g_free(path);
+  return TRUE;
+
+invalid:
+  g_warning("Manifest %s is not valid", path);
+  g_mapped_file_unref(mapped);
+  g_free(path);
+  return FALSE;
+}
@@ -0,0 +1,89 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+
+#ifndef _src_manifest_h
+#define _src_manifest_h
+
+#include <glib.h>
+
+// mydumper writes the manifest at the end of the dump so that myloader does
+// not need to list and parse the names of every file in the directory. The
+// file is a header, the fixed size entries and a table with the strings that
+// the entries point to. Every number is little endian.
+#define MANIFEST_FILENAME "manifest"
+#define MANIFEST_MAGIC "MYDMAN01"
+#define MANIFEST_MAGIC_LENGTH 8
+#define MANIFEST_NONE 0xFFFFFFFF
+
+// The entries are sorted in this order, the data files of the largest tables
+// first. The volumes are the other directories where the data files were
+// written, their entries are not files, the filename is the directory and the
+// part its number.
+enum manifest_file_type {
+  MANIFEST_SCHEMA_TABLESPACE,
+  MANIFEST_SCHEMA_CREATE,
+  MANIFEST_SCHEMA_TABLE,
+  MANIFEST_DATA,
+  MANIFEST_LOAD_DATA,
+  MANIFEST_METADATA_TABLE,
+  MANIFEST_SCHEMA_SEQUENCE,
+  MANIFEST_SCHEMA_VIEW,
+  MANIFEST_SCHEMA_TRIGGER,
+  MANIFEST_SCHEMA_POST,
+  MANIFEST_CHECKSUM,
+  MANIFEST_METADATA_GLOBAL,
+  MANIFEST_OTHER,
+  MANIFEST_VOLUME
+};
+
+struct manifest_header {
+  gchar magic[MANIFEST_MAGIC_LENGTH];
+  guint32 entries;
+  guint32 strings_length;
+};
+
+// The names are offsets in the string table, MANIFEST_NONE when the file does
+// not have them. dependency is the entry that has to be restored before this
+// one: the database for the table schemas and the table schema for its data,
+// triggers, metadata and checksums. volume is 0 for the files in the directory
+// of the manifest.
+struct manifest_entry {
+  guint32 filename;
+  guint32 database;
+  guint32 table;
+  guint32 dependency;
+  guint32 part;
+  guint32 sub_part;
+  guint64 size;
+  guint64 rows;
+  guint8 type;
+  guint8 volume;
+  guint8 padding[6];
+};
+
+#define MANIFEST_MAX_VOLUMES 255
+
+// volume is the directory of the file, NULL when it is the directory of the
+// manifest
+typedef void (*manifest_entry_func)(enum manifest_file_type type, const gchar *filename, const gchar *volume,
+                                    const gchar *database, const gchar *table, guint part, guint sub_part,
+                                    guint64 size, guint64 rows, gpointer user_data);
+
+gboolean write_manifest(const gchar *directory, gchar **volumes, GHashTable *table_rows);
+gboolean read_manifest(const gchar *directory, gchar **volumes, manifest_entry_func func, gpointer user_data);
+
+#endif
@@ -0,0 +1,85 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+
+#include <glib.h>
+#include <string.h>
+#include "metrics.h"
+
+static const guint64 latency_bucket_bound[LATENCY_BUCKETS] = {
+  1000, 5000, 10000, 50000, 100000, 250000, 500000,
+  1000000, 2500000, 5000000, 10000000, 30000000 };
+
+static const gchar *latency_bucket_label[LATENCY_BUCKETS] = {
+  "0.001", "0.005", "0.01", "0.05", "0.1", "0.25", "0.5",
+  "1", "2.5", "5", "10", "30" };
+
+void histogram_observe(struct latency_histogram *h, gint64 usec){
+  guint i=0;
+  if (usec < 0)
+    usec=0;
+  while (i < LATENCY_BUCKETS && (guint64)usec > latency_bucket_bound[i])
+    i++;
+  h->bucket[i]++;
+  h->sum+=usec;
+  h->count++;
+}
+
+void histogram_merge(struct latency_histogram *to, struct latency_histogram *from){
+  guint i=0;
+  for (i=0; i <= LATENCY_BUCKETS; i++)
+    to->bucket[i]+=from->bucket[i];
+  to->sum+=from->sum;
+  to->count+=from->count;
+}
+
+void append_metric_type(GString *content, const gchar *name, const gchar *type){
+  g_string_append_printf(content,"# TYPE %s %s\n", name, type);
+}
+
+void append_metric_counter(GString *content, const gchar *name, const gchar *labels, guint64 value){
+  g_string_append_printf(content,"%s{%s} %"G_GUINT64_FORMAT"\n", name, labels, value);
+}
+
+void append_metric_seconds(GString *content, const gchar *name, const gchar *labels, gint64 usec){
+  g_string_append_printf(content,"%s{%s} %.6f\n", name, labels, (gdouble)usec / G_USEC_PER_SEC);
+}
+
+void append_metric_gauge(GString *content, const gchar *name, const gchar *labels, gdouble value){
+  g_string_append_printf(content,"%s{%s} %.3f\n", name, labels, value);
+}
+
+// Buckets are stored per range, Prometheus expects them cumulative
+void append_metric_histogram(GString *content, const gchar *name, const gchar *labels, struct latency_histogram *h){
+  struct latency_histogram copy;
+  guint64 cumulative=0;
+  guint i=0;
+  memcpy(&copy, h, sizeof(struct latency_histogram));
+  for (i=0; i < LATENCY_BUCKETS; i++){
+    cumulative+=copy.bucket[i];
+    g_string_append_printf(content,"%s_bucket{%s,le=\"%s\"} %"G_GUINT64_FORMAT"\n", name, labels, latency_bucket_label[i], cumulative);
+  }
+  cumulative+=copy.bucket[LATENCY_BUCKETS];
+  g_string_append_printf(content,"%s_bucket{%s,le=\"+Inf\"} %"G_GUINT64_FORMAT"\n", name, labels, cumulative);
+  g_string_append_printf(content,"%s_sum{%s} %.6f\n", name, labels, (gdouble)copy.sum / G_USEC_PER_SEC);
+  g_string_append_printf(content,"%s_count{%s} %"G_GUINT64_FORMAT"\n", name, labels, cumulative);
+}
+
+gdouble estimate_remaining_seconds(guint64 done, guint64 remaining, gint64 elapsed_usec){
+  if (done == 0 || elapsed_usec <= 0)
+    return -1;
+  return (gdouble)remaining * elapsed_usec / done / G_USEC_PER_SEC;
+}
@@ -0,0 +1,44 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+
+#ifndef _src_metrics_h
+#define _src_metrics_h
+
+#include <glib.h>
+
+// Latency buckets are in microseconds, the last bucket is +Inf
+#define LATENCY_BUCKETS 12
+// 1 out of (METRICS_SAMPLE_MASK+1) rows is timed on the row hot path
+#define METRICS_SAMPLE_MASK 0xF
+
+// A histogram is owned and updated by one thread only. The pmm thread reads
+// it without locking and merges it when the textfile is written.
+struct latency_histogram {
+  guint64 bucket[LATENCY_BUCKETS + 1];
+  guint64 sum;
+  guint64 count;
+};
+
+void histogram_observe(struct latency_histogram *h, gint64 usec);
+void histogram_merge(struct latency_histogram *to, struct latency_histogram *from);
+void append_metric_type(GString *content, const gchar *name, const gchar *type);
+void append_metric_counter(GString *content, const gchar *name, const gchar *labels, guint64 value);
+void append_metric_seconds(GString *content, const gchar *name, const gchar *labels, gint64 usec);
+void append_metric_gauge(GString *content, const gchar *name, const gchar *labels, gdouble value);
+void append_metric_histogram(GString *content, const gchar *name, const gchar *labels, struct latency_histogram *h);
+gdouble estimate_remaining_seconds(guint64 done, guint64 remaining, gint64 elapsed_usec);
+#endif
@@ -42,6 +42,8 @@
 #include "mydumper_daemon_thread.h"
 #include "mydumper_global.h"
 #include "mydumper_arguments.h"
+#include "mydumper_disk_governor.h"
+#include "mydumper_stripe.h"
 const char DIRECTORY[] = "export";
 
 /* Some earlier versions of MySQL do not yet define MYSQL_TYPE_JSON */
@@ -138,6 +140,7 @@ int main(int argc, char *argv[]) {
   }
 
   create_backup_dir(output_directory);
+  initialize_stripes();
 
   if (disk_limits!=NULL){
     parse_disk_limits();
@@ -155,6 +158,7 @@ int main(int argc, char *argv[]) {
   g_strfreev(tables);
 
   if (logoutfile) {
+    stop_async_log();
     fclose(logoutfile);
   }
   if (key_file)  g_key_file_free(key_file);
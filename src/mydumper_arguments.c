@@ -25,11 +25,19 @@
 #include "common.h"
 #include "connection.h"
 #include "regex.h"
+#include "trace.h"
+#include "mydumper_columnar.h"
+#include "mydumper_dictionary.h"
+#include "mydumper_throttle.h"
+#include "uring_writer.h"
 
 static GOptionEntry entries[] = {
     {"help", '?', 0, G_OPTION_ARG_NONE, &help, "Show help options", NULL},
     {"outputdir", 'o', 0, G_OPTION_ARG_FILENAME, &output_directory_param,
      "Directory to output files to", NULL},
+    {"stripe-directories", 0, 0, G_OPTION_ARG_STRING, &stripe_directories,
+     "Comma separated list of directories, on other volumes, where the data files are spread together with "
+     "--outputdir. The schema and metadata files stay in --outputdir", NULL},
     {"stream", 0, G_OPTION_FLAG_OPTIONAL_ARG, G_OPTION_ARG_CALLBACK , &stream_arguments_callback,
      "It will stream over STDOUT once the files has been written. Since v0.12.7-1, accepts NO_DELETE, NO_STREAM_AND_NO_DELETE and TRADITIONAL which is the default value and used if no parameter is given", NULL},
 //    {"no-delete", 0, 0, G_OPTION_ARG_NONE, &no_delete,
@@ -40,7 +48,8 @@ static GOptionEntry entries[] = {
       "Set the limit to pause and resume if determines there is no enough disk space."
       "Accepts values like: '<resume>:<pause>' in MB."
       "For instance: 100:500 will pause when there is only 100MB free and will"
-      "resume if 500MB are available", NULL },
+      "resume if 500MB are available. Writes are slowed down before reaching the "
+      "pause limit, and with --stream or --exec they continue as fast as space is freed", NULL },
     {NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL}};
 
 static GOptionEntry extra_entries[] = {
@@ -63,6 +72,22 @@ static GOptionEntry extra_entries[] = {
      NULL},
     {"compress", 'c', 0, G_OPTION_ARG_NONE, &compress_output,
      "Compress output files", NULL},
+    {"masking-key", 0, 0, G_OPTION_ARG_STRING, &masking_key,
+     "Secret used by the masking functions. The same key masks the same value in the same way on every run, "
+     "a random one is used when it is not set", NULL},
+    {"compress-adaptive", 0, 0, G_OPTION_ARG_NONE, &compress_adaptive,
+     "Picks the compression level of every data file, from 1 to 9, using the time that the "
+     "thread spent waiting on the server, compressing and writing the previous ones. Needs --compress", NULL},
+    {"io-uring", 0, 0, G_OPTION_ARG_NONE, &use_io_uring,
+     "Writes the uncompressed files with io_uring, it uses the regular writes when the kernel or the build "
+     "does not support it", NULL},
+    {"io-uring-direct", 0, 0, G_OPTION_ARG_NONE, &io_uring_direct,
+     "Opens the files with O_DIRECT when --io-uring is used", NULL},
+    {"compress-dictionary", 0, 0, G_OPTION_ARG_NONE, &compress_dictionary,
+     "Trains a zstd dictionary per table, and one for the table schemas, with the first files written, "
+     "and compresses the rest of the files with it. Needs --compress and a build with zstd", NULL},
+    {"manifest", 0, 0, G_OPTION_ARG_NONE, &write_dump_manifest,
+     "Writes a binary manifest with the files of the dump, myloader uses it instead of listing the directory. Not written with --stream", NULL},
     {NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL}};
 
 static GOptionEntry lock_entries[] = {
@@ -112,6 +137,8 @@ static GOptionEntry exec_entries[] = {
 static GOptionEntry pmm_entries[] = {
     { "pmm-path", 0, 0, G_OPTION_ARG_STRING, &pmm_path,
       "which default value will be /usr/local/percona/pmm2/collectors/textfile-collector/high-resolution", NULL },
+    { "trace-file", 0, 0, G_OPTION_ARG_FILENAME, &trace_file,
+      "Write a Chrome trace/Perfetto compatible JSON timeline of the chunks processed by each thread", NULL },
     { "pmm-resolution", 0, 0, G_OPTION_ARG_STRING, &pmm_resolution,
       "which default will be high", NULL },
     {NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL}};
@@ -140,6 +167,14 @@ static GOptionEntry chunks_entries[] = {
      NULL},
     { "split-partitions", 0, 0, G_OPTION_ARG_NONE, &split_partitions,
       "Dump partitions into separate files. This options overrides the --rows option for partitioned tables.", NULL},
+    {"throttle", 0, 0, G_OPTION_ARG_STRING, &throttle_limits,
+     "Reduces the threads dumping chunks and the chunk size when the server goes over any of these limits, "
+     "and increases them again when it is back under. Accepts name=value separated by comma, with the names "
+     "threads_running, history_list_length, replica_lag (seconds) and chunk_time (average seconds per chunk). "
+     "For instance: threads_running=40,replica_lag=30", NULL},
+    {"throttle-query", 0, 0, G_OPTION_ARG_STRING, &throttle_query,
+     "Query used instead of the built in ones to check the server with --throttle. Every column of the first "
+     "row is compared with the --throttle limit with the same name", NULL},
     {NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL}
 };
 
@@ -189,6 +224,12 @@ static GOptionEntry statement_entries[] = {
      "", NULL },
     { "csv", 0, 0, G_OPTION_ARG_NONE, &csv,
       "Automatically enables --load-data and set variables to export in CSV format.", NULL },
+    {"format", 0, 0, G_OPTION_ARG_STRING, &output_format,
+      "Data file format: sql, binary, parquet or arrow. binary writes the rows length-prefixed and "
+      "unescaped, myloader transcodes them when it loads them. It enables --load-data. parquet and arrow "
+      "write one columnar file per chunk for analytics, they can not be loaded with myloader, default: sql", NULL },
+    {"parquet-compression", 0, 0, G_OPTION_ARG_STRING, &columnar_compression,
+      "Compression of the Parquet columns: snappy, zstd, gzip, lz4 or none, default: snappy", NULL },
     {"fields-terminated-by", 0, 0, G_OPTION_ARG_STRING, &fields_terminated_by_ld,"", NULL },
     {"fields-enclosed-by", 0, 0, G_OPTION_ARG_STRING, &fields_enclosed_by_ld,"", NULL },
     {"fields-escaped-by", 0, 0, G_OPTION_ARG_STRING, &fields_escaped_by,
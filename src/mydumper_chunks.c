@@ -33,6 +33,7 @@
 #include "mydumper_chunks.h"
 #include "mydumper_database.h"
 #include "mydumper_jobs.h"
+#include "mydumper_throttle.h"
 #include "mydumper_global.h"
 
 gboolean split_partitions = FALSE;
@@ -53,7 +54,8 @@ static GOptionEntry chunks_entries[] = {
      "Try to split tables into chunks of this many rows.",
      NULL},
     { "split-partitions", 0, 0, G_OPTION_ARG_NONE, &split_partitions,
-      "Dump partitions into separate files. This options overrides the --rows option for partitioned tables.", NULL},
+      "Dump partitions into separate files. With --rows, the partitions are also split in ranges of the "
+      "integer primary key, so a large partition is dumped by several threads", NULL},
     {NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL}
 };
 
@@ -156,6 +158,8 @@ union chunk_step *new_integer_step(gchar *prefix, gchar *field, guint64 nmin, gu
 union chunk_step *new_real_partition_step(GList *partition, guint deep, guint number){
   union chunk_step * cs = g_new0(union chunk_step, 1);
   cs->partition_step.list = partition;
+  cs->partition_step.current_partition = NULL;
+  cs->partition_step.sub_step = NULL;
   cs->partition_step.assigned= FALSE;
   cs->partition_step.mutex = g_mutex_new();
   cs->partition_step.deep = deep;
@@ -263,10 +267,13 @@ union chunk_step *get_next_char_chunk(struct db_table *dbt){
   return NULL;
 }
 
+// The partitions that are not started are given first, half of the ones
+// pending in a step. When there are none left, the range that remains of a
+// partition that is being dumped by ranges is split in two.
 union chunk_step *get_next_partition_chunk(struct db_table *dbt){
   g_mutex_lock(dbt->chunks_mutex);
   GList *l=dbt->chunks;
-  union chunk_step *cs=NULL;
+  union chunk_step *cs=NULL, *new_cs=NULL, *sub=NULL;
   while (l!=NULL){
     cs=l->data;
     g_mutex_lock(cs->partition_step.mutex);
@@ -277,12 +284,15 @@ union chunk_step *get_next_partition_chunk(struct db_table *dbt){
       return cs;
     }
 
-    if (g_list_length (cs->partition_step.list) > 3 ){
+    if (cs->partition_step.list != NULL){
       guint pos=g_list_length (cs->partition_step.list) / 2;
       GList *new_list=g_list_nth(cs->partition_step.list,pos);
-      new_list->prev->next=NULL;
-      new_list->prev=NULL;
-      union chunk_step * new_cs = new_real_partition_step(new_list, cs->partition_step.deep+1, cs->partition_step.number+pow(2,cs->partition_step.deep));
+      if (new_list->prev != NULL){
+        new_list->prev->next=NULL;
+        new_list->prev=NULL;
+      }else
+        cs->partition_step.list=NULL;
+      new_cs = new_real_partition_step(new_list, cs->partition_step.deep+1, cs->partition_step.number+pow(2,cs->partition_step.deep));
       cs->partition_step.deep++;
       new_cs->partition_step.assigned=TRUE;
       dbt->chunks=g_list_append(dbt->chunks,new_cs);
@@ -294,6 +304,34 @@ union chunk_step *get_next_partition_chunk(struct db_table *dbt){
     g_mutex_unlock(cs->partition_step.mutex);
     l=l->next;
   }
+
+  for (l=dbt->chunks; l!=NULL; l=l->next){
+    cs=l->data;
+    g_mutex_lock(cs->partition_step.mutex);
+    sub=cs->partition_step.sub_step;
+    if (sub != NULL){
+      g_mutex_lock(sub->integer_step.mutex);
+      if (sub->integer_step.cursor < sub->integer_step.nmax && sub->integer_step.nmax - sub->integer_step.cursor > sub->integer_step.step){
+        guint64 new_minmax = sub->integer_step.cursor + (sub->integer_step.nmax - sub->integer_step.cursor)/2;
+        new_cs = new_real_partition_step(NULL, cs->partition_step.deep+1, cs->partition_step.number+pow(2,cs->partition_step.deep));
+        cs->partition_step.deep++;
+        new_cs->partition_step.current_partition=g_strdup(cs->partition_step.current_partition);
+        new_cs->partition_step.sub_step=new_integer_step(NULL, dbt->field, new_minmax, sub->integer_step.nmax, 0, 0, FALSE, sub->integer_step.check_max);
+        new_cs->partition_step.sub_step->integer_step.step=sub->integer_step.step;
+        new_cs->partition_step.sub_step->integer_step.cursor=new_minmax;
+        new_cs->partition_step.assigned=TRUE;
+        sub->integer_step.nmax=new_minmax;
+        sub->integer_step.check_max=TRUE;
+        dbt->chunks=g_list_append(dbt->chunks,new_cs);
+        g_mutex_unlock(sub->integer_step.mutex);
+        g_mutex_unlock(cs->partition_step.mutex);
+        g_mutex_unlock(dbt->chunks_mutex);
+        return new_cs;
+      }
+      g_mutex_unlock(sub->integer_step.mutex);
+    }
+    g_mutex_unlock(cs->partition_step.mutex);
+  }
   g_mutex_unlock(dbt->chunks_mutex);
   return NULL;
 }
@@ -362,16 +400,68 @@ gchar * get_escaped_middle_char(MYSQL *conn, gchar *c1, guint c1len, gchar *c2,
   return escapedresult;
 }
 
+// The integer step of the job, the one of the partition being dumped when the
+// table is split by partitions
+union chunk_step *get_integer_step(struct table_job *tj){
+  return tj->dbt->chunk_type == PARTITION ? tj->chunk_step->partition_step.sub_step : tj->chunk_step;
+}
+
+// Returns the integer step to dump the partition by ranges, or NULL when it
+// has to be dumped at once: without --rows, when the key is not an integer or
+// when the partition is small.
+union chunk_step *new_partition_integer_step(MYSQL *conn, struct db_table *dbt, const gchar *partition){
+  gchar *query = NULL;
+  MYSQL_ROW row;
+  MYSQL_RES *minmax = NULL;
+  union chunk_step *cs = NULL;
+  guint64 nmin, nmax;
+  if (rows_per_file == 0 || dbt->field == NULL)
+    return NULL;
+  mysql_query(conn, query = g_strdup_printf(
+                        "SELECT %s MIN(`%s`),MAX(`%s`) FROM `%s`.`%s` PARTITION (%s) %s %s",
+                        (detected_server == SERVER_TYPE_MYSQL || detected_server == SERVER_TYPE_MARIADB)
+                            ? "/*!40001 SQL_NO_CACHE */"
+                            : "",
+                        dbt->field, dbt->field, dbt->database->name, dbt->table, partition, where_option ? "WHERE" : "", where_option ? where_option : ""));
+  g_free(query);
+  minmax = mysql_store_result(conn);
+  if (!minmax)
+    return NULL;
+  row = mysql_fetch_row(minmax);
+  if (row == NULL || row[0] == NULL || row[1] == NULL)
+    goto cleanup;
+  switch (mysql_fetch_fields(minmax)[0].type) {
+  case MYSQL_TYPE_LONG:
+  case MYSQL_TYPE_LONGLONG:
+  case MYSQL_TYPE_INT24:
+  case MYSQL_TYPE_SHORT:
+    nmin = strtoul(row[0], NULL, 10);
+    nmax = strtoul(row[1], NULL, 10) + 1;
+    if ((nmax-nmin) > (4 * rows_per_file)){
+      gchar *prefix=g_strdup_printf("`%s` IS NULL OR `%s` = %"G_GUINT64_FORMAT" OR", dbt->field, dbt->field, nmin);
+      cs=new_integer_step(prefix, dbt->field, nmin, nmax, 0, 0, FALSE, FALSE);
+      cs->integer_step.cursor=nmin;
+      g_free(prefix);
+    }
+    break;
+  default:
+    break;
+  }
+cleanup:
+  mysql_free_result(minmax);
+  return cs;
+}
+
 void update_integer_min(MYSQL *conn, struct table_job *tj){
-  union chunk_step *cs= tj->chunk_step;
+  union chunk_step *cs= get_integer_step(tj);
   gchar *query = NULL;
   MYSQL_ROW row = NULL;
   MYSQL_RES *minmax = NULL;
   /* Get minimum/maximum */
   mysql_query(conn, query = g_strdup_printf(
-                        "SELECT %s `%s` FROM `%s`.`%s` WHERE %s %"G_GUINT64_FORMAT" <= `%s` AND `%s` <= %"G_GUINT64_FORMAT" ORDER BY `%s` ASC LIMIT 1",
+                        "SELECT %s `%s` FROM `%s`.`%s` %s WHERE %s %"G_GUINT64_FORMAT" <= `%s` AND `%s` <= %"G_GUINT64_FORMAT" ORDER BY `%s` ASC LIMIT 1",
                         (detected_server == SERVER_TYPE_MYSQL || detected_server == SERVER_TYPE_MARIADB) ? "/*!40001 SQL_NO_CACHE */": "",
-                        tj->dbt->field, tj->dbt->database->name, tj->dbt->table, cs->integer_step.prefix,  cs->integer_step.nmin, tj->dbt->field, tj->dbt->field, cs->integer_step.nmax, tj->dbt->field));
+                        tj->dbt->field, tj->dbt->database->name, tj->dbt->table, tj->partition?tj->partition:"", cs->integer_step.prefix,  cs->integer_step.nmin, tj->dbt->field, tj->dbt->field, cs->integer_step.nmax, tj->dbt->field));
   g_free(query);
   minmax = mysql_store_result(conn);
 
@@ -390,15 +480,15 @@ void update_integer_min(MYSQL *conn, struct table_job *tj){
 }
 
 void update_integer_max(MYSQL *conn, struct table_job *tj){
-  union chunk_step *cs= tj->chunk_step;
+  union chunk_step *cs= get_integer_step(tj);
   gchar *query = NULL;
   MYSQL_ROW row = NULL;
   MYSQL_RES *minmax = NULL;
   /* Get minimum/maximum */
   mysql_query(conn, query = g_strdup_printf(
-                        "SELECT %s `%s` FROM `%s`.`%s` WHERE %"G_GUINT64_FORMAT" <= `%s` AND `%s` <= %"G_GUINT64_FORMAT" ORDER BY `%s` DESC LIMIT 1",
+                        "SELECT %s `%s` FROM `%s`.`%s` %s WHERE %"G_GUINT64_FORMAT" <= `%s` AND `%s` <= %"G_GUINT64_FORMAT" ORDER BY `%s` DESC LIMIT 1",
                         (detected_server == SERVER_TYPE_MYSQL || detected_server == SERVER_TYPE_MARIADB) ? "/*!40001 SQL_NO_CACHE */": "",
-                        tj->dbt->field, tj->dbt->database->name, tj->dbt->table, cs->integer_step.nmin, tj->dbt->field, tj->dbt->field, cs->integer_step.nmax, tj->dbt->field));
+                        tj->dbt->field, tj->dbt->database->name, tj->dbt->table, tj->partition?tj->partition:"", cs->integer_step.nmin, tj->dbt->field, tj->dbt->field, cs->integer_step.nmax, tj->dbt->field));
 //  g_free(query);
   minmax = mysql_store_result(conn);
 
@@ -744,11 +834,15 @@ guint64 estimate_count(MYSQL *conn, char *database, char *table, char *field,
 }
 
 
-gboolean get_next_dbt_and_chunk(struct db_table **dbt,union chunk_step **cs, GList **dbt_list){
-  GList *iter=*dbt_list;
+// The list is walked and trimmed holding its mutex, as the tables are
+// appended to it and the pmm thread reads it at the same time
+gboolean get_next_dbt_and_chunk(struct db_table **dbt,union chunk_step **cs, GList **dbt_list, GMutex *dbt_list_mutex){
+  GList *iter=NULL;
   union chunk_step *lcs;
   struct db_table *d;
   gboolean are_there_jobs_defining=FALSE;
+  g_mutex_lock(dbt_list_mutex);
+  iter=*dbt_list;
   while (iter){
     d=iter->data;
     if (d->chunk_type != DEFINING){
@@ -778,6 +872,7 @@ gboolean get_next_dbt_and_chunk(struct db_table **dbt,union chunk_step **cs, GLi
     }
     iter=iter->next;
   }
+  g_mutex_unlock(dbt_list_mutex);
   return are_there_jobs_defining;
 }
 
@@ -799,16 +894,34 @@ void enqueue_shutdown_jobs(GAsyncQueue * queue){
   }
 }
 
-void table_job_enqueue(GAsyncQueue * pop_queue, GAsyncQueue * push_queue, GList **table_list){
+static gint compare_dbt_by_size(gconstpointer a, gconstpointer b){
+  const struct db_table *dbt_a=a, *dbt_b=b;
+  return dbt_a->datalength < dbt_b->datalength ? 1 : dbt_a->datalength > dbt_b->datalength ? -1 : 0;
+}
+
+// Largest tables go first: they get the threads while there are chunks to
+// split, and the small tables fill the gaps at the end of the dump. The list
+// is sorted again only when tables were added since the last time.
+static void sort_table_list_by_size(GList **table_list, GMutex *table_list_mutex, gboolean *unsorted){
+  g_mutex_lock(table_list_mutex);
+  if (*unsorted){
+    *table_list=g_list_sort(*table_list, compare_dbt_by_size);
+    *unsorted=FALSE;
+  }
+  g_mutex_unlock(table_list_mutex);
+}
+
+void table_job_enqueue(GAsyncQueue * pop_queue, GAsyncQueue * push_queue, GList **table_list, GMutex *table_list_mutex, gboolean *unsorted){
   struct db_table *dbt;
   union chunk_step *cs;
   gboolean are_there_jobs_defining=FALSE;
   for (;;) {
     g_async_queue_pop(pop_queue);
+    sort_table_list_by_size(table_list, table_list_mutex, unsorted);
     dbt=NULL;
     cs=NULL;
     are_there_jobs_defining=FALSE;
-    are_there_jobs_defining=get_next_dbt_and_chunk(&dbt,&cs,table_list);
+    are_there_jobs_defining=get_next_dbt_and_chunk(&dbt,&cs,table_list,table_list_mutex);
 
     if ((cs==NULL) && (dbt==NULL)){
       if (are_there_jobs_defining){
@@ -847,13 +960,15 @@ void table_job_enqueue(GAsyncQueue * pop_queue, GAsyncQueue * push_queue, GList
 void *chunk_builder_thread(struct configuration *conf){
 
   g_message("Starting Non-InnoDB tables");
-  table_job_enqueue(give_me_another_non_innodb_chunk_step_queue, conf->non_innodb_queue, &non_innodb_table);
+  table_job_enqueue(give_me_another_non_innodb_chunk_step_queue, conf->non_innodb_queue, &non_innodb_table, non_innodb_table_mutex, &non_innodb_table_unsorted);
   g_message("Non-InnoDB tables completed");
+  release_throttle_workers(conf->non_innodb_queue);
   enqueue_shutdown_jobs(conf->non_innodb_queue);
 
   g_message("Starting InnoDB tables");
-  table_job_enqueue(give_me_another_innodb_chunk_step_queue, conf->innodb_queue, &innodb_table);
+  table_job_enqueue(give_me_another_innodb_chunk_step_queue, conf->innodb_queue, &innodb_table, innodb_table_mutex, &innodb_table_unsorted);
   g_message("InnoDB tables completed");
+  release_throttle_workers(conf->innodb_queue);
   enqueue_shutdown_jobs(conf->innodb_queue);
 
   return NULL;
@@ -39,5 +39,7 @@ void give_me_another_innodb_chunk_step();
 gboolean get_new_minmax (struct thread_data *td, struct db_table *dbt, union chunk_step *cs);
 gchar* update_cursor (MYSQL *conn, struct table_job *tj);
 void next_chunk_in_char_step(union chunk_step * cs);
+union chunk_step *get_integer_step(struct table_job *tj);
+union chunk_step *new_partition_integer_step(MYSQL *conn, struct db_table *dbt, const gchar *partition);
 void update_integer_min(MYSQL *conn, struct table_job *tj);
 void update_integer_max(MYSQL *conn, struct table_job *tj);
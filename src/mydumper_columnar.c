@@ -0,0 +1,403 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+
+#include <mysql.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "config.h"
+#ifdef WITH_PARQUET
+#include <arrow-glib/arrow-glib.h>
+#include <parquet-glib/parquet-glib.h>
+#endif
+#include "common.h"
+#include "mydumper_start_dump.h"
+#include "mydumper_database.h"
+#include "mydumper_working_thread.h"
+#include "mydumper_write.h"
+#include "mydumper_columnar.h"
+#include "mydumper_masquerade.h"
+#include "mydumper_global.h"
+
+enum columnar_format columnar_format=COLUMNAR_NONE;
+gchar *columnar_compression=NULL;
+
+#ifdef WITH_PARQUET
+GArrowCompressionType compression_type=GARROW_COMPRESSION_TYPE_SNAPPY;
+
+enum columnar_type {
+  COLUMNAR_INT64,
+  COLUMNAR_UINT64,
+  COLUMNAR_DOUBLE,
+  COLUMNAR_STRING,
+  COLUMNAR_BINARY
+};
+
+struct columnar_file {
+  gchar *filename;
+  GArrowSchema *schema;
+  guint num_fields;
+  enum columnar_type *types;
+  GArrowArrayBuilder **builders;
+  guint64 rows;
+  GParquetArrowFileWriter *parquet;
+  GArrowFileOutputStream *sink;
+  GArrowRecordBatchWriter *arrow;
+};
+
+void initialize_columnar(){
+  if (stream)
+    m_critical("--format=parquet and --format=arrow can not be used with --stream");
+  if (columnar_compression == NULL)
+    return;
+  if (!g_ascii_strcasecmp(columnar_compression, "snappy"))
+    compression_type=GARROW_COMPRESSION_TYPE_SNAPPY;
+  else if (!g_ascii_strcasecmp(columnar_compression, "zstd"))
+    compression_type=GARROW_COMPRESSION_TYPE_ZSTD;
+  else if (!g_ascii_strcasecmp(columnar_compression, "gzip"))
+    compression_type=GARROW_COMPRESSION_TYPE_GZIP;
+  else if (!g_ascii_strcasecmp(columnar_compression, "lz4"))
+    compression_type=GARROW_COMPRESSION_TYPE_LZ4;
+  else if (!g_ascii_strcasecmp(columnar_compression, "none"))
+    compression_type=GARROW_COMPRESSION_TYPE_UNCOMPRESSED;
+  else
+    m_critical("Unknown --parquet-compression %s, valid values are snappy, zstd, gzip, lz4 and none", columnar_compression);
+}
+
+// DECIMAL, temporal and any other type are kept as the text the server sends,
+// so no precision is lost.
+static enum columnar_type get_columnar_type(MYSQL_FIELD *field){
+  switch (field->type){
+    case MYSQL_TYPE_TINY:
+    case MYSQL_TYPE_SHORT:
+    case MYSQL_TYPE_INT24:
+    case MYSQL_TYPE_LONG:
+    case MYSQL_TYPE_LONGLONG:
+    case MYSQL_TYPE_YEAR:
+      return field->flags & UNSIGNED_FLAG ? COLUMNAR_UINT64 : COLUMNAR_INT64;
+    case MYSQL_TYPE_FLOAT:
+    case MYSQL_TYPE_DOUBLE:
+      return COLUMNAR_DOUBLE;
+    case MYSQL_TYPE_BIT:
+    case MYSQL_TYPE_GEOMETRY:
+      return COLUMNAR_BINARY;
+    case MYSQL_TYPE_TINY_BLOB:
+    case MYSQL_TYPE_MEDIUM_BLOB:
+    case MYSQL_TYPE_LONG_BLOB:
+    case MYSQL_TYPE_BLOB:
+    case MYSQL_TYPE_VAR_STRING:
+    case MYSQL_TYPE_STRING:
+      return field->charsetnr == 63 ? COLUMNAR_BINARY : COLUMNAR_STRING;
+    default:
+      return COLUMNAR_STRING;
+  }
+}
+
+static GArrowDataType *new_columnar_data_type(enum columnar_type type){
+  switch (type){
+    case COLUMNAR_INT64:
+      return GARROW_DATA_TYPE(garrow_int64_data_type_new());
+    case COLUMNAR_UINT64:
+      return GARROW_DATA_TYPE(garrow_uint64_data_type_new());
+    case COLUMNAR_DOUBLE:
+      return GARROW_DATA_TYPE(garrow_double_data_type_new());
+    case COLUMNAR_BINARY:
+      return GARROW_DATA_TYPE(garrow_binary_data_type_new());
+    default:
+      return GARROW_DATA_TYPE(garrow_string_data_type_new());
+  }
+}
+
+static GArrowArrayBuilder *new_columnar_builder(enum columnar_type type){
+  switch (type){
+    case COLUMNAR_INT64:
+      return GARROW_ARRAY_BUILDER(garrow_int64_array_builder_new());
+    case COLUMNAR_UINT64:
+      return GARROW_ARRAY_BUILDER(garrow_uint64_array_builder_new());
+    case COLUMNAR_DOUBLE:
+      return GARROW_ARRAY_BUILDER(garrow_double_array_builder_new());
+    case COLUMNAR_BINARY:
+      return GARROW_ARRAY_BUILDER(garrow_binary_array_builder_new());
+    default:
+      return GARROW_ARRAY_BUILDER(garrow_string_array_builder_new());
+  }
+}
+
+static gchar *build_columnar_filename(struct table_job *tj){
+  GString *filename = g_string_sized_new(20);
+  const gchar *extension = columnar_format == COLUMNAR_PARQUET ? "parquet" : "arrow";
+  tj->sub_part == 0 ?
+    g_string_append_printf(filename, "%s.%s.%05u.%s", tj->dbt->database->filename, tj->dbt->table_filename, tj->nchunk, extension):
+    g_string_append_printf(filename, "%s.%s.%05u.%05u.%s", tj->dbt->database->filename, tj->dbt->table_filename, tj->nchunk, tj->sub_part, extension);
+  gchar *r = g_build_filename(dump_directory, filename->str, NULL);
+  g_string_free(filename,TRUE);
+  return r;
+}
+
+// The schema file is an Arrow IPC file without record batches, it is the
+// schema that every chunk file of the table is written with.
+static void write_columnar_schema_file(struct db_table *dbt, GArrowSchema *schema){
+  GError *error=NULL;
+  GString *name = g_string_sized_new(20);
+  g_string_append_printf(name, "%s.%s-schema.arrow", dbt->database->filename, dbt->table_filename);
+  gchar *filename = g_build_filename(dump_directory, name->str, NULL);
+  g_string_free(name, TRUE);
+  GArrowFileOutputStream *sink = garrow_file_output_stream_new(filename, FALSE, &error);
+  GArrowRecordBatchFileWriter *writer = sink ? garrow_record_batch_file_writer_new(GARROW_OUTPUT_STREAM(sink), schema, &error) : NULL;
+  if (!writer || !garrow_record_batch_writer_close(GARROW_RECORD_BATCH_WRITER(writer), &error)){
+    g_critical("Could not write schema file %s: %s", filename, error->message);
+    g_error_free(error);
+    errors++;
+  }
+  if (writer)
+    g_object_unref(writer);
+  if (sink){
+    garrow_output_stream_close(GARROW_OUTPUT_STREAM(sink), NULL);
+    g_object_unref(sink);
+  }
+  g_free(filename);
+}
+
+// All the chunks of a table share the schema, the first one builds it
+static GArrowSchema *get_columnar_schema(struct db_table *dbt, MYSQL_FIELD *fields, guint num_fields, enum columnar_type *types){
+  guint i;
+  GArrowSchema *schema;
+  for (i = 0; i < num_fields; i++)
+    types[i]=get_columnar_type(&(fields[i]));
+  g_mutex_lock(dbt->rows_lock);
+  if (dbt->columnar_schema == NULL){
+    GList *columns=NULL;
+    for (i = 0; i < num_fields; i++){
+      GArrowDataType *data_type=new_columnar_data_type(types[i]);
+      columns=g_list_append(columns, garrow_field_new(fields[i].name, data_type));
+      g_object_unref(data_type);
+    }
+    dbt->columnar_schema=garrow_schema_new(columns);
+    g_list_free_full(columns, g_object_unref);
+    write_columnar_schema_file(dbt, dbt->columnar_schema);
+  }
+  schema=g_object_ref(dbt->columnar_schema);
+  g_mutex_unlock(dbt->rows_lock);
+  return schema;
+}
+
+void free_columnar_schema(struct db_table *dbt){
+  if (dbt->columnar_schema)
+    g_object_unref(dbt->columnar_schema);
+}
+
+static GParquetWriterProperties *new_parquet_properties(MYSQL_FIELD *fields, struct columnar_file *cf){
+  guint i;
+  GParquetWriterProperties *properties=gparquet_writer_properties_new();
+  gparquet_writer_properties_set_compression(properties, compression_type, NULL);
+  // Only text columns repeat enough values for a dictionary to pay off
+  for (i = 0; i < cf->num_fields; i++){
+    if (cf->types[i] == COLUMNAR_STRING)
+      gparquet_writer_properties_enable_dictionary(properties, fields[i].name);
+    else
+      gparquet_writer_properties_disable_dictionary(properties, fields[i].name);
+  }
+  return properties;
+}
+
+static void free_columnar_file(struct columnar_file *cf){
+  guint i;
+  for (i = 0; i < cf->num_fields; i++)
+    g_object_unref(cf->builders[i]);
+  if (cf->parquet)
+    g_object_unref(cf->parquet);
+  if (cf->arrow)
+    g_object_unref(cf->arrow);
+  if (cf->sink){
+    garrow_output_stream_close(GARROW_OUTPUT_STREAM(cf->sink), NULL);
+    g_object_unref(cf->sink);
+  }
+  g_object_unref(cf->schema);
+  g_free(cf->builders);
+  g_free(cf->types);
+  g_free(cf->filename);
+  g_free(cf);
+}
+
+static struct columnar_file *new_columnar_file(struct table_job *tj, MYSQL_FIELD *fields, guint num_fields, GError **error){
+  guint i;
+  struct columnar_file *cf=g_new0(struct columnar_file, 1);
+  cf->filename=build_columnar_filename(tj);
+  cf->num_fields=num_fields;
+  cf->types=g_new(enum columnar_type, num_fields);
+  cf->builders=g_new(GArrowArrayBuilder *, num_fields);
+  cf->schema=get_columnar_schema(tj->dbt, fields, num_fields, cf->types);
+  for (i = 0; i < num_fields; i++)
+    cf->builders[i]=new_columnar_builder(cf->types[i]);
+  if (columnar_format == COLUMNAR_PARQUET){
+    GParquetWriterProperties *properties=new_parquet_properties(fields, cf);
+    cf->parquet=gparquet_arrow_file_writer_new_path(cf->schema, cf->filename, properties, error);
+    g_object_unref(properties);
+    if (!cf->parquet)
+      goto cleanup;
+  }else{
+    cf->sink=garrow_file_output_stream_new(cf->filename, FALSE, error);
+    if (!cf->sink)
+      goto cleanup;
+    cf->arrow=GARROW_RECORD_BATCH_WRITER(garrow_record_batch_file_writer_new(GARROW_OUTPUT_STREAM(cf->sink), cf->schema, error));
+    if (!cf->arrow)
+      goto cleanup;
+  }
+  return cf;
+
+cleanup:
+  g_critical("Could not create %s: %s", cf->filename, (*error)->message);
+  free_columnar_file(cf);
+  return NULL;
+}
+
+static gboolean append_columnar_value(GArrowArrayBuilder *builder, enum columnar_type type, const gchar *value, gulong length, GError **error){
+  if (value == NULL)
+    return garrow_array_builder_append_null(builder, error);
+  switch (type){
+    case COLUMNAR_INT64:
+      return garrow_int64_array_builder_append_value(GARROW_INT64_ARRAY_BUILDER(builder), g_ascii_strtoll(value, NULL, 10), error);
+    case COLUMNAR_UINT64:
+      return garrow_uint64_array_builder_append_value(GARROW_UINT64_ARRAY_BUILDER(builder), g_ascii_strtoull(value, NULL, 10), error);
+    case COLUMNAR_DOUBLE:
+      return garrow_double_array_builder_append_value(GARROW_DOUBLE_ARRAY_BUILDER(builder), g_ascii_strtod(value, NULL), error);
+    case COLUMNAR_BINARY:
+      return garrow_binary_array_builder_append_value(GARROW_BINARY_ARRAY_BUILDER(builder), (const guint8 *)value, length, error);
+    default:
+      return garrow_string_array_builder_append_string_len(GARROW_STRING_ARRAY_BUILDER(builder), value, length, error);
+  }
+}
+
+// Writes the rows in the builders as one record batch, which is a row group
+// in Parquet files
+static gboolean flush_columnar_file(struct columnar_file *cf, GError **error){
+  guint i;
+  gboolean r=FALSE;
+  GList *columns=NULL;
+  GArrowRecordBatch *batch=NULL;
+  if (cf->rows == 0)
+    return TRUE;
+  for (i = 0; i < cf->num_fields; i++){
+    GArrowArray *array=garrow_array_builder_finish(cf->builders[i], error);
+    if (!array)
+      goto cleanup;
+    columns=g_list_append(columns, array);
+  }
+  batch=garrow_record_batch_new(cf->schema, cf->rows, columns, error);
+  if (!batch)
+    goto cleanup;
+  if (cf->parquet){
+    GArrowTable *table=garrow_table_new_record_batches(cf->schema, &batch, 1, error);
+    r=table && gparquet_arrow_file_writer_write_table(cf->parquet, table, cf->rows, error);
+    if (table)
+      g_object_unref(table);
+  }else
+    r=garrow_record_batch_writer_write_record_batch(cf->arrow, batch, error);
+  g_object_unref(batch);
+
+cleanup:
+  g_list_free_full(columns, g_object_unref);
+  cf->rows=0;
+  return r;
+}
+
+guint64 write_row_into_file_in_columnar_mode(struct mask_reader *reader, struct table_job *tj){
+  guint64 num_rows=0;
+  guint num_fields = reader->num_fields;
+  MYSQL_FIELD *fields = reader->fields;
+  MYSQL_ROW row;
+  gulong *lengths;
+  GError *error=NULL;
+  guint i;
+  gint64 start;
+  struct columnar_file *cf;
+
+  if (tj->columnar == NULL){
+    tj->columnar=new_columnar_file(tj, fields, num_fields, &error);
+    if (tj->columnar == NULL){
+      g_error_free(error);
+      errors++;
+      return 0;
+    }
+    if (tj->sql_filename == NULL)
+      tj->sql_filename=g_strdup(tj->columnar->filename);
+    tj->td->stats.files++;
+    tj->td->stats.files_in_flight++;
+  }
+  cf=tj->columnar;
+  message_dumping_data(tj->td, tj);
+
+  while ((row = mask_reader_fetch_row(reader, &lengths))) {
+    num_rows++;
+    for (i = 0; i < num_fields; i++) {
+      if (!append_columnar_value(cf->builders[i], cf->types[i], row[i], lengths[i], &error))
+        goto error;
+      tj->filesize+=lengths[i];
+      tj->td->stats.bytes+=lengths[i];
+    }
+    cf->rows++;
+    if (cf->rows >= COLUMNAR_BATCH_ROWS){
+      start=g_get_monotonic_time();
+      if (!flush_columnar_file(cf, &error))
+        goto error;
+      tj->td->stats.write_time+=g_get_monotonic_time()-start;
+    }
+  }
+  return num_rows;
+
+error:
+  g_critical("Could not write out data for %s.%s into %s: %s", tj->dbt->database->name, tj->dbt->table, cf->filename, error->message);
+  g_error_free(error);
+  errors++;
+  return num_rows;
+}
+
+void close_columnar_file(struct table_job *tj){
+  GError *error=NULL;
+  struct columnar_file *cf=tj->columnar;
+  gboolean r=flush_columnar_file(cf, &error);
+  if (r)
+    r = cf->parquet ? gparquet_arrow_file_writer_close(cf->parquet, &error) : garrow_record_batch_writer_close(cf->arrow, &error);
+  if (!r){
+    g_critical("Could not close %s: %s", cf->filename, error->message);
+    g_error_free(error);
+    errors++;
+  }
+  free_columnar_file(cf);
+  tj->columnar=NULL;
+  tj->td->stats.files_in_flight--;
+}
+#else
+void initialize_columnar(){
+  m_critical("--format=parquet and --format=arrow need mydumper built with -DWITH_PARQUET=ON");
+}
+
+guint64 write_row_into_file_in_columnar_mode(struct mask_reader *reader, struct table_job *tj){
+  (void) reader;
+  (void) tj;
+  return 0;
+}
+
+void close_columnar_file(struct table_job *tj){
+  (void) tj;
+}
+
+void free_columnar_schema(struct db_table *dbt){
+  (void) dbt;
+}
+#endif
@@ -0,0 +1,41 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+
+#ifndef _src_mydumper_columnar_h
+#define _src_mydumper_columnar_h
+
+enum columnar_format {
+  COLUMNAR_NONE,
+  COLUMNAR_PARQUET,
+  COLUMNAR_ARROW
+};
+
+// Rows kept in the column builders before they are written as a row group
+#define COLUMNAR_BATCH_ROWS 65536
+
+extern enum columnar_format columnar_format;
+extern gchar *columnar_compression;
+
+struct columnar_file;
+struct table_job;
+struct db_table;
+struct mask_reader;
+void initialize_columnar();
+guint64 write_row_into_file_in_columnar_mode(struct mask_reader *reader, struct table_job *tj);
+void close_columnar_file(struct table_job *tj);
+void free_columnar_schema(struct db_table *dbt);
+#endif
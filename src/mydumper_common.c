@@ -28,6 +28,7 @@
 #include <errno.h>
 #include "server_detect.h"
 #include "mydumper_global.h"
+#include "mydumper_stripe.h"
 
 GMutex *ref_table_mutex = NULL;
 GHashTable *ref_table=NULL;
@@ -169,32 +170,32 @@ void set_transaction_isolation_level_repeatable_read(MYSQL *conn){
 }
 
 // Global Var used:
-// - dump_directory
 // - compress_extension
-gchar * build_filename(char *database, char *table, guint part, guint sub_part, const gchar *extension, const gchar *second_extension){
+gchar * build_filename(const gchar *directory, char *database, char *table, guint part, guint sub_part, const gchar *extension, const gchar *second_extension){
   GString *filename = g_string_sized_new(20);
   sub_part == 0 ?
     g_string_append_printf(filename, "%s.%s.%05u.%s%s%s%s", database, table, part, extension, compress_extension, second_extension!=NULL ?".":"",second_extension!=NULL ?second_extension:"" ):
     g_string_append_printf(filename, "%s.%s.%05u.%05u.%s%s%s%s", database, table, part, sub_part, extension, compress_extension, second_extension!=NULL ?".":"",second_extension!=NULL ?second_extension:"");
-  gchar *r = g_build_filename(dump_directory, filename->str, NULL);
+  gchar *r = g_build_filename(directory, filename->str, NULL);
   g_string_free(filename,TRUE);
   return r;
 }
 
+// The data files are the ones spread over the stripes
 gchar * build_data_filename(char *database, char *table, guint part, guint sub_part){
-  return build_filename(database,table,part,sub_part,"sql",NULL);
+  return build_filename(open_stripe_file(), database,table,part,sub_part,"sql",NULL);
 }
 
 gchar * build_fifo_filename(char *database, char *table, guint part, guint sub_part, const gchar *extension){
-  return build_filename(database,table,part,sub_part, extension,"fifo");
+  return build_filename(dump_directory, database,table,part,sub_part, extension,"fifo");
 }
 
 gchar * build_stdout_filename(char *database, char *table, guint part, guint sub_part, const gchar *extension, gchar *second_extension){
-  return build_filename(database,table,part,sub_part, extension, second_extension);
+  return build_filename(dump_directory, database,table,part,sub_part, extension, second_extension);
 }
 
 gchar * build_load_data_filename(char *database, char *table, guint part, guint sub_part){
-  return build_filename(database, table, part, sub_part, "dat", NULL);
+  return build_filename(open_stripe_file(), database, table, part, sub_part, "dat", NULL);
 }
 
 unsigned long m_real_escape_string(MYSQL *conn, char *to, const gchar *from, unsigned long length){
@@ -32,7 +32,7 @@ void restore_charset(GString *statement);
 void clear_dump_directory(gchar *directory);
 void set_transaction_isolation_level_repeatable_read(MYSQL *conn);
 gchar * build_tablespace_filename();
-gchar * build_filename(char *database, char *table, guint part, guint sub_part, const gchar *extension);
+gchar * build_filename(const gchar *directory, char *database, char *table, guint part, guint sub_part, const gchar *extension, const gchar *second_extension);
 gchar * build_data_filename(char *database, char *table, guint part, guint sub_part);
 gchar * build_fifo_filename(char *database, char *table, guint part, guint sub_part, const gchar *extesion);
 gchar * build_stdout_filename(char *database, char *table, guint part, guint sub_part, const gchar *extension, gchar *second_extension);
@@ -29,6 +29,7 @@
 #include <glib-unix.h>
 #include "mydumper_start_dump.h"
 #include "mydumper_common.h"
+#include "logging.h"
 #include "mydumper_global.h"
 
 guint snapshot_interval = 60;
@@ -40,12 +41,18 @@ guint dump_number=0;
 void initialize_daemon_thread(){
     pid_t pid, sid;
 
+    // The log writer thread does not exist in the child, it is stopped before
+    // forking so nothing is left in the rings and started again in the child
+    if (logfile)
+      stop_async_log();
     pid = fork();
     if (pid < 0)
       exit(EXIT_FAILURE);
     else if (pid > 0)
       exit(EXIT_SUCCESS);
 
+    if (logfile)
+      start_async_log();
     umask(0037);
     sid = setsid();
 
@@ -0,0 +1,149 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+#include "config.h"
+#ifdef ZWRAP_USE_ZSTD
+#include "../zstd/zstd_zlibwrapper.h"
+#include <zdict.h>
+#endif
+#include "common.h"
+#include "mydumper_dictionary.h"
+#include "mydumper_global.h"
+
+gboolean compress_dictionary = FALSE;
+struct compression_dictionary *schema_dictionary = NULL;
+
+void initialize_dictionary(){
+  if (!compress_dictionary)
+    return;
+#ifndef ZWRAP_USE_ZSTD
+  m_critical("--compress-dictionary needs mydumper built with -DWITH_ZSTD=ON");
+#endif
+  if (!compress_output)
+    m_critical("--compress-dictionary needs --compress");
+  if (stream){
+    // myloader needs the dictionaries before the first file that uses them
+    g_warning("--compress-dictionary is not used with --stream");
+    compress_dictionary=FALSE;
+    return;
+  }
+  gchar *filename=g_strdup_printf("%s/%s.%s", dump_directory, SCHEMA_DICTIONARY, DICTIONARY_EXTENSION);
+  schema_dictionary=new_compression_dictionary(filename, SCHEMA_DICTIONARY_TRAINING_SIZE);
+  g_free(filename);
+}
+
+void finalize_dictionary(){
+  if (schema_dictionary)
+    free_compression_dictionary(schema_dictionary);
+  schema_dictionary=NULL;
+}
+
+struct compression_dictionary *new_compression_dictionary(gchar *filename, gsize training_size){
+  struct compression_dictionary *d=g_new0(struct compression_dictionary, 1);
+  d->mutex=g_mutex_new();
+  d->filename=g_strdup(filename);
+  d->training_size=training_size;
+  d->samples=g_string_sized_new(training_size + DICTIONARY_SAMPLE_SIZE);
+  d->sample_sizes=g_array_new(FALSE, FALSE, sizeof(size_t));
+  d->state=DICTIONARY_SAMPLING;
+  return d;
+}
+
+void free_compression_dictionary(struct compression_dictionary *d){
+  g_mutex_free(d->mutex);
+  g_free(d->filename);
+  if (d->samples)
+    g_string_free(d->samples, TRUE);
+  if (d->sample_sizes)
+    g_array_free(d->sample_sizes, TRUE);
+  if (d->dictionary)
+    g_string_free(d->dictionary, TRUE);
+  g_free(d);
+}
+
+#ifdef ZWRAP_USE_ZSTD
+// Runs once, out of the mutex, so the threads that keep writing do not wait
+// for it. The files opened before it finishes are compressed without it.
+static void train_dictionary(struct compression_dictionary *d){
+  GError *error=NULL;
+  GString *dictionary=g_string_sized_new(DICTIONARY_SIZE);
+  size_t size=ZDICT_trainFromBuffer(dictionary->str, DICTIONARY_SIZE, d->samples->str,
+      (size_t *)d->sample_sizes->data, d->sample_sizes->len);
+  g_string_free(d->samples, TRUE);
+  g_array_free(d->sample_sizes, TRUE);
+  d->samples=NULL;
+  d->sample_sizes=NULL;
+  if (ZDICT_isError(size)){
+    g_message("Dictionary %s was not trained: %s", d->filename, ZDICT_getErrorName(size));
+    g_string_free(dictionary, TRUE);
+    g_atomic_int_set(&(d->state), DICTIONARY_NONE);
+    return;
+  }
+  g_string_set_size(dictionary, size);
+  if (!g_file_set_contents(d->filename, dictionary->str, dictionary->len, &error)){
+    g_critical("Could not write dictionary %s: %s", d->filename, error->message);
+    g_error_free(error);
+    errors++;
+    g_string_free(dictionary, TRUE);
+    g_atomic_int_set(&(d->state), DICTIONARY_NONE);
+    return;
+  }
+  d->dictionary=dictionary;
+  g_atomic_int_set(&(d->state), DICTIONARY_READY);
+}
+#endif
+
+void add_dictionary_sample(struct compression_dictionary *d, const gchar *data, gsize len){
+  if (d == NULL || g_atomic_int_get(&(d->state)) != DICTIONARY_SAMPLING)
+    return;
+  gboolean train=FALSE;
+  gsize offset;
+  size_t sample_size;
+  g_mutex_lock(d->mutex);
+  if (d->state == DICTIONARY_SAMPLING){
+    for (offset=0; offset < len && d->samples->len < d->training_size; offset+=sample_size){
+      sample_size=MIN(DICTIONARY_SAMPLE_SIZE, len - offset);
+      g_string_append_len(d->samples, data + offset, sample_size);
+      g_array_append_val(d->sample_sizes, sample_size);
+    }
+    if (d->samples->len >= d->training_size){
+      g_atomic_int_set(&(d->state), DICTIONARY_TRAINING);
+      train=TRUE;
+    }
+  }
+  g_mutex_unlock(d->mutex);
+#ifdef ZWRAP_USE_ZSTD
+  if (train)
+    train_dictionary(d);
+#else
+  (void) train;
+#endif
+}
+
+// It has to be called before anything is written into the file
+void set_file_dictionary(FILE *file, struct compression_dictionary *d){
+  if (file == NULL || d == NULL || g_atomic_int_get(&(d->state)) != DICTIONARY_READY)
+    return;
+#ifdef ZWRAP_USE_ZSTD
+  if (gzsetdictionary((gzFile)file, d->dictionary->str, d->dictionary->len) != Z_OK)
+    g_warning("Could not set the dictionary %s", d->filename);
+#endif
+}
@@ -0,0 +1,54 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+
+#ifndef _src_mydumper_dictionary_h
+#define _src_mydumper_dictionary_h
+
+// Samples are taken in pieces of DICTIONARY_SAMPLE_SIZE from the data written
+// until the training size is reached, and the dictionary is trained with them
+#define DICTIONARY_SIZE 16384
+#define DICTIONARY_SAMPLE_SIZE 8192
+#define DICTIONARY_TRAINING_SIZE 1048576
+#define SCHEMA_DICTIONARY_TRAINING_SIZE 131072
+
+enum dictionary_state {
+  DICTIONARY_SAMPLING,
+  DICTIONARY_TRAINING,
+  DICTIONARY_READY,
+  DICTIONARY_NONE
+};
+
+struct compression_dictionary {
+  GMutex *mutex;
+  gchar *filename;
+  gsize training_size;
+  GString *samples;
+  GArray *sample_sizes;
+  GString *dictionary;
+  gint state;
+};
+
+extern gboolean compress_dictionary;
+extern struct compression_dictionary *schema_dictionary;
+
+void initialize_dictionary();
+void finalize_dictionary();
+struct compression_dictionary *new_compression_dictionary(gchar *filename, gsize training_size);
+void free_compression_dictionary(struct compression_dictionary *d);
+void add_dictionary_sample(struct compression_dictionary *d, const gchar *data, gsize len);
+void set_file_dictionary(FILE *file, struct compression_dictionary *d);
+#endif
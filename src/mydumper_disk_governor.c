@@ -0,0 +1,196 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+#include <glib.h>
+#include <sys/statvfs.h>
+#include "common.h"
+#include "mydumper_disk_governor.h"
+#include "mydumper_global.h"
+
+// The writers take tokens from a bucket that is refilled at rate bytes per
+// second while the governor is limiting. Tokens are counted in bytes before
+// compression, and the rate is adjusted with the free space that the writes
+// really take, so the compression ratio does not need to be known.
+struct disk_governor {
+  GMutex *mutex;
+  GThread *thread;
+  gboolean running;
+  gboolean limited;
+  gboolean paused;
+  gdouble rate;
+  gdouble tokens;
+  gint64 refill_time;
+  guint64 written;
+  guint in_flight_waiting;
+};
+
+static struct disk_governor governor = { NULL, NULL, FALSE, FALSE, FALSE, 0, 0, 0, 0, 0 };
+guint pause_at=0;
+guint resume_at=0;
+
+void set_disk_limits(guint p_at, guint r_at){
+  pause_at=p_at;
+  resume_at=r_at;
+}
+
+static gboolean get_free_space(guint64 *free_space){
+  struct statvfs buffer;
+  if (statvfs(output_directory, &buffer)){
+    g_warning("Disk space check failed");
+    return FALSE;
+  }
+  *free_space=(guint64)buffer.f_bfree * buffer.f_frsize;
+  return TRUE;
+}
+
+static void refill_tokens(){
+  gint64 now=g_get_monotonic_time();
+  governor.tokens=MIN(governor.tokens + governor.rate * (now - governor.refill_time) / G_USEC_PER_SEC, governor.rate);
+  governor.refill_time=now;
+}
+
+static void set_rate(gdouble rate){
+  if (!governor.limited){
+    governor.limited=TRUE;
+    governor.tokens=0;
+    governor.refill_time=g_get_monotonic_time();
+  }else
+    refill_tokens();
+  governor.rate=rate;
+}
+
+// consumption is how fast the free space went down in the last interval, it is
+// negative when --stream or --exec removed more than what was written.
+static void update_rate(guint64 free_space, gdouble write_rate, gdouble consumption){
+  guint64 pause_bytes=(guint64)pause_at * 1024 * 1024;
+  if (!governor.paused && free_space < pause_bytes){
+    governor.paused=TRUE;
+    g_warning("Disk space lower than %dMB, writing only as fast as space is freed until %dMB are available", pause_at, resume_at);
+  }else if (governor.paused && free_space >= (guint64)resume_at * 1024 * 1024){
+    governor.paused=FALSE;
+    governor.limited=FALSE;
+    g_message("Disk space above %dMB, resuming backup", resume_at);
+  }
+
+  if (governor.paused){
+    // Without --stream or --exec nothing that we wrote is going to be removed
+    if (!stream && exec_command == NULL)
+      set_rate(0);
+    else if (consumption > 0)
+      set_rate(write_rate / 2);
+    else
+      set_rate(MAX(governor.rate * 2, DISK_GOVERNOR_MIN_RATE));
+    return;
+  }
+
+  gdouble target=(gdouble)(free_space - pause_bytes) / DISK_GOVERNOR_HORIZON;
+  if (consumption > target){
+    set_rate(MAX(write_rate * target / consumption, DISK_GOVERNOR_MIN_RATE));
+  }else if (governor.limited){
+    if (governor.rate > write_rate * 4)
+      governor.limited=FALSE;
+    else
+      set_rate(MAX(governor.rate * 2, DISK_GOVERNOR_MIN_RATE));
+  }
+}
+
+static void *disk_governor_thread(void *data){
+  (void)data;
+  guint64 free_space=0, previous_free_space=0, written=0, previous_written=0;
+  gint64 now, previous_time=g_get_monotonic_time();
+  get_free_space(&previous_free_space);
+  while (g_atomic_int_get(&(governor.running))){
+    g_usleep(DISK_GOVERNOR_INTERVAL);
+    if (!get_free_space(&free_space))
+      continue;
+    now=g_get_monotonic_time();
+    gdouble elapsed=(gdouble)(now - previous_time) / G_USEC_PER_SEC;
+    g_mutex_lock(governor.mutex);
+    written=governor.written;
+    update_rate(free_space, (written - previous_written) / elapsed, ((gdouble)previous_free_space - free_space) / elapsed);
+    g_mutex_unlock(governor.mutex);
+    previous_time=now;
+    previous_written=written;
+    previous_free_space=free_space;
+  }
+  return NULL;
+}
+
+void start_disk_governor(){
+  if (disk_limits == NULL)
+    return;
+  governor.mutex=g_mutex_new();
+  governor.running=TRUE;
+  governor.thread=g_thread_create(disk_governor_thread, NULL, TRUE, NULL);
+}
+
+void stop_disk_governor(){
+  if (governor.thread == NULL)
+    return;
+  g_atomic_int_set(&(governor.running), FALSE);
+  g_thread_join(governor.thread);
+  governor.thread=NULL;
+  g_mutex_free(governor.mutex);
+}
+
+// Called before writing bytes into a file that is already open. The writer
+// needs a token left and can go below zero so a statement larger than the bucket still passes,
+// and the next one waits until the debt is paid.
+void disk_governor_write(guint64 bytes){
+  if (governor.thread == NULL)
+    return;
+  gboolean waiting=FALSE;
+  gulong wait;
+  for (;;){
+    g_mutex_lock(governor.mutex);
+    if (governor.limited && !shutdown_triggered)
+      refill_tokens();
+    if (!governor.limited || shutdown_triggered || governor.tokens > 0){
+      governor.tokens-=governor.limited?bytes:0;
+      governor.written+=bytes;
+      if (waiting)
+        governor.in_flight_waiting--;
+      g_mutex_unlock(governor.mutex);
+      return;
+    }
+    if (!waiting){
+      waiting=TRUE;
+      governor.in_flight_waiting++;
+    }
+    wait=governor.rate > 0 ? MIN(-governor.tokens / governor.rate * G_USEC_PER_SEC, DISK_GOVERNOR_MAX_WAIT) : DISK_GOVERNOR_MAX_WAIT;
+    g_mutex_unlock(governor.mutex);
+    g_usleep(wait);
+  }
+}
+
+// Called before a new data file is opened. Chunks that are already being
+// written go first, as their files are the ones that --stream and --exec are
+// waiting for to free the space.
+void disk_governor_new_file(){
+  if (governor.thread == NULL)
+    return;
+  for (;;){
+    g_mutex_lock(governor.mutex);
+    if (governor.limited && !shutdown_triggered)
+      refill_tokens();
+    if (!governor.limited || shutdown_triggered || (governor.in_flight_waiting == 0 && governor.tokens > 0)){
+      g_mutex_unlock(governor.mutex);
+      return;
+    }
+    g_mutex_unlock(governor.mutex);
+    g_usleep(DISK_GOVERNOR_MAX_WAIT);
+  }
+}
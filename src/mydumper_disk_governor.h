@@ -0,0 +1,33 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+#ifndef _src_mydumper_disk_governor_h
+#define _src_mydumper_disk_governor_h
+
+// The free space is checked every DISK_GOVERNOR_INTERVAL microseconds. Writes
+// are paced when, at the current rate, the space above the pause limit would
+// be used in less than DISK_GOVERNOR_HORIZON seconds.
+#define DISK_GOVERNOR_INTERVAL 1000000
+#define DISK_GOVERNOR_HORIZON 60
+#define DISK_GOVERNOR_MIN_RATE 65536
+#define DISK_GOVERNOR_MAX_WAIT 100000
+
+void set_disk_limits(guint p_at, guint r_at);
+void start_disk_governor();
+void stop_disk_governor();
+void disk_governor_write(guint64 bytes);
+void disk_governor_new_file();
+#endif
@@ -13,6 +13,11 @@ extern guint verbose;
 extern gboolean debug;
 extern gchar *tables_list;
 extern gchar *fields_enclosed_by_ld;
+extern gchar *fields_enclosed_by;
+extern gchar *fields_terminated_by;
+extern gchar *lines_starting_by;
+extern gchar *lines_terminated_by;
+extern gchar *statement_terminated_by;
 extern gchar *lines_starting_by_ld;
 extern gchar *statement_terminated_by_ld;
 extern gboolean insert_ignore;
@@ -54,10 +59,13 @@ extern gboolean daemon_mode;
 extern gboolean dump_events;
 extern gboolean dump_routines;
 extern gboolean dump_tablespaces;
+extern gboolean write_dump_manifest;
 extern gboolean dump_triggers;
 extern gboolean ignore_generated_fields;
 extern gboolean less_locking;
 extern gboolean load_data;
+extern gboolean binary_format;
+extern gchar *output_format;
 extern gboolean no_data;
 extern gboolean no_delete;
 extern gboolean no_locks;
@@ -74,11 +82,13 @@ extern gboolean use_savepoints;
 extern gchar *compress_extension;
 extern gchar *db;
 extern gchar *disk_limits;
+extern gchar *stripe_directories;
 extern gchar *dump_directory;
 extern gchar *exec_command;
 extern gchar *fields_escaped_by;
 extern gchar *output_directory;
 extern gchar *output_directory_param;
+extern gboolean pmm;
 extern gchar *pmm_path;
 extern gchar *pmm_resolution ;
 extern gchar *rows_per_chunk;
@@ -91,12 +101,15 @@ extern GHashTable *all_where_per_table;
 extern gint database_counter;
 extern gint non_innodb_done;
 extern GList *innodb_table, *non_innodb_table;
+extern gboolean innodb_table_unsorted, non_innodb_table_unsorted;
 extern GList *no_updated_tables;
 extern GList *schema_post;
 extern GList *table_schemas;
 extern GList *trigger_schemas;
 extern GList *view_schemas;
 extern GMutex *ready_database_dump_mutex;
+extern GMutex *innodb_table_mutex;
+extern GMutex *non_innodb_table_mutex;
 extern GMutex *ready_table_dump_mutex;
 extern GString *set_global;
 extern GString *set_global_back;
@@ -105,13 +118,17 @@ extern guint char_chunk;
 extern guint complete_insert;
 extern guint dump_number;
 extern guint errors;
+extern gint64 main_lock_wait_time;
 extern guint num_threads;
 extern guint rows_per_file;
+extern guint min_rows_per_file;
+extern guint max_rows_per_file;
 extern guint snapshot_count;
 extern guint statement_size;
 extern guint trx_consistency_only;
 extern guint updated_since;
 extern int compress_output;
+extern gboolean compress_adaptive;
 extern int detected_server;
 extern int errno;
 extern int (*m_close)(void *file);
@@ -122,6 +139,7 @@ extern int skip_tz;
 extern MYSQL *main_connection;
 extern struct configuration_per_table conf_per_table;
 extern struct function_pointer pp;
+extern gchar *masking_key;
 extern gchar identifier_quote_character;
 extern gboolean schema_sequence_fix;
 extern gboolean it_is_a_consistent_backup;
@@ -37,6 +37,8 @@
 #include "mydumper_working_thread.h"
 #include "mydumper_write.h"
 #include "mydumper_chunks.h"
+#include "mydumper_dictionary.h"
+#include "mydumper_disk_governor.h"
 #include "mydumper_global.h"
 
 gboolean dump_triggers = FALSE;
@@ -265,6 +267,7 @@ void write_table_definition_into_file(MYSQL *conn, struct db_table *dbt,
     return;
   }
 
+  set_file_dictionary(outfile, schema_dictionary);
   GString *statement = g_string_sized_new(statement_size);
 
   initialize_sql_statement(statement);
@@ -310,6 +313,7 @@ void write_table_definition_into_file(MYSQL *conn, struct db_table *dbt,
     g_critical("Could not write schema for %s.%s", dbt->database->name, dbt->table);
     errors++;
   }
+  add_dictionary_sample(schema_dictionary, statement->str, statement->len);
   g_free(query);
 
   m_close(outfile);
@@ -1081,7 +1085,7 @@ void execute_file_per_thread( gchar *sql_fn, gchar *sql_fn3){
   }
 }
 
-void initialize_fn(gchar ** sql_filename, struct db_table * dbt, FILE ** sql_file, guint fn, guint sub_part, const gchar *extension, gchar * f()){
+void initialize_fn(struct thread_data *td, gchar ** sql_filename, struct db_table * dbt, FILE ** sql_file, guint fn, guint sub_part, const gchar *extension, gchar * f()){
   gchar *stdout_fn=NULL;
 /*  if (*sql_filename != NULL){
     remove(*sql_filename);
@@ -1096,25 +1100,33 @@ void initialize_fn(gchar ** sql_filename, struct db_table * dbt, FILE ** sql_fil
   }else{
     *sql_filename = f(dbt->database->filename, dbt->table_filename, fn, sub_part);
   }
-  *sql_file = m_open(*sql_filename,"w");
+  *sql_file = open_data_file(td, *sql_filename);
+  set_file_dictionary(*sql_file, dbt->dictionary);
 }
 
 void initialize_sql_fn(struct table_job * tj){
-  initialize_fn(&(tj->sql_filename),tj->dbt,&(tj->sql_file), tj->nchunk, tj->sub_part,"sql", &build_data_filename);
+  initialize_fn(tj->td, &(tj->sql_filename),tj->dbt,&(tj->sql_file), tj->nchunk, tj->sub_part,"sql", &build_data_filename);
 }
 
 void initialize_load_data_fn(struct table_job * tj){
-  initialize_fn(&(tj->dat_filename),tj->dbt,&(tj->dat_file), tj->nchunk, tj->sub_part,"dat", &build_load_data_filename);
+  initialize_fn(tj->td, &(tj->dat_filename),tj->dbt,&(tj->dat_file), tj->nchunk, tj->sub_part,"dat", &build_load_data_filename);
 }
 gboolean update_files_on_table_job(struct table_job *tj){
   if (tj->sql_file == NULL){
+     disk_governor_new_file();
      if (load_data){
        initialize_load_data_fn(tj);
+       if (binary_format)
+         write_binary_header(tj->dat_file);
        tj->sql_filename = build_data_filename(tj->dbt->database->filename, tj->dbt->table_filename, tj->nchunk, tj->sub_part);
        tj->sql_file = m_open(tj->sql_filename,"w");
+       tj->td->stats.files+=2;
+       tj->td->stats.files_in_flight+=2;
        return TRUE;
      }else{
        initialize_sql_fn(tj);
+       tj->td->stats.files++;
+       tj->td->stats.files_in_flight++;
      }
 //     write_load_data_statement(tj, fields, num_fields);
   }
@@ -23,85 +23,481 @@
 #include <mysql.h>
 #include "mydumper_masquerade.h"
 
-struct function_pointer pp = {&identity_function,NULL};
+#define DEFAULT_DATE_SHIFT_DAYS 30
 
-gchar * identity_function(gchar ** r, GHashTable * mem){
-  (void) mem;
-  return *r;
+struct function_pointer pp = {&identity_function,0,0};
+gchar *masking_key=NULL;
+
+// The masked values only depend on the value and on this key, so the same
+// value is masked the same way on every table and thread without keeping
+// anything in memory
+static guint64 key[2];
+
+// GRand is not locked, unlike g_random_int, so each thread gets its own
+static GPrivate masquerade_rand_key = G_PRIVATE_INIT((GDestroyNotify)g_rand_free);
+
+// Values are taken from the keyed hash when rand is NULL, or from the
+// thread GRand otherwise
+struct mask_generator{
+  GRand *rand;
+  guint64 seed;
+  guint64 counter;
+  guint64 word;
+  guint available;
+};
+
+#define ROTL(x,b) (guint64)(((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SIPROUND \
+  v0 += v1; v1 = ROTL(v1, 13); v1 ^= v0; v0 = ROTL(v0, 32); \
+  v2 += v3; v3 = ROTL(v3, 16); v3 ^= v2; \
+  v0 += v3; v3 = ROTL(v3, 21); v3 ^= v0; \
+  v2 += v1; v1 = ROTL(v1, 17); v1 ^= v2; v2 = ROTL(v2, 32);
+
+// SipHash-2-4
+static guint64 siphash(const guchar *in, gsize len){
+  guint64 v0 = 0x736f6d6570736575ULL ^ key[0];
+  guint64 v1 = 0x646f72616e646f6dULL ^ key[1];
+  guint64 v2 = 0x6c7967656e657261ULL ^ key[0];
+  guint64 v3 = 0x7465646279746573ULL ^ key[1];
+  guint64 m, b = ((guint64)len) << 56;
+  const guchar *end = in + len - (len % 8);
+  guint i;
+  for (; in != end; in += 8){
+    memcpy(&m, in, 8);
+    m = GUINT64_FROM_LE(m);
+    v3 ^= m;
+    SIPROUND; SIPROUND;
+    v0 ^= m;
+  }
+  for (i = 0; i < len % 8; i++)
+    b |= ((guint64)in[i]) << (8 * i);
+  v3 ^= b;
+  SIPROUND; SIPROUND;
+  v0 ^= b;
+  v2 ^= 0xff;
+  SIPROUND; SIPROUND; SIPROUND; SIPROUND;
+  return v0 ^ v1 ^ v2 ^ v3;
 }
 
-gchar * random_int_function(gchar ** r,GHashTable * mem){
-  (void) mem;
-  g_snprintf(*r, strlen(*r)+1, "%u", g_random_int());
-  return *r;
+void initialize_masquerade(){
+  if (masking_key){
+    guchar digest[32];
+    gsize digest_length=sizeof(digest);
+    GChecksum *checksum=g_checksum_new(G_CHECKSUM_SHA256);
+    g_checksum_update(checksum, (guchar *)masking_key, strlen(masking_key));
+    g_checksum_get_digest(checksum, digest, &digest_length);
+    g_checksum_free(checksum);
+    memcpy(key, digest, sizeof(key));
+  }else{
+    key[0]=((guint64)g_random_int() << 32) | g_random_int();
+    key[1]=((guint64)g_random_int() << 32) | g_random_int();
+  }
 }
 
-gchar * random_int_function_with_mem(gchar ** r, GHashTable * mem){
-  gchar *value=g_hash_table_lookup(mem,*r);
-  if (value==NULL){
-    value=g_strdup_printf("%u", g_random_int());
-    g_hash_table_insert(mem,g_strdup(*r),value);
+static GRand *get_thread_rand(){
+  GRand *rand=g_private_get(&masquerade_rand_key);
+  if (!rand){
+    rand=g_rand_new();
+    g_private_set(&masquerade_rand_key, rand);
   }
-  g_strlcpy(*r, value, strlen(*r)+1);
-  return *r;
-}
-
-#ifndef WITH_GLIB_uuid_string_random
-char *rand_string(char *str, size_t size)
-{
-    const char charset[] = "0123456789abcdef";
-    if (size) {
-        --size;
-        size_t n;
-        for (n = 0; n < size; n++) {
-            int key = rand() % (int) (sizeof charset - 1);
-            str[n] = charset[key];
-        }
-        str[size] = '\0';
-    }
-    return str;
-}
-#endif
-
-gchar * random_uuid_function(gchar ** r, GHashTable * mem){
-  (void) mem;
-#ifdef WITH_GLIB_uuid_string_random
-  g_strlcpy(*r,g_uuid_string_random(), strlen(*r)+1);
-#else
-  rand_string(*r,strlen(*r));
-#endif
-  return *r;
-}
-
-gchar * random_uuid_function_with_mem(gchar ** r, GHashTable * mem){
-  gchar *value=g_hash_table_lookup(mem,*r);
-  if (value==NULL){
-#ifdef WITH_GLIB_uuid_string_random
-    value=g_strndup(g_uuid_string_random(),strlen(*r)+1);
-#else
-    rand_string(*r,strlen(*r));
-#endif
-    g_hash_table_insert(mem,g_strdup(*r),value);
+  return rand;
+}
+
+static void keyed_generator(struct mask_generator *g, const gchar *value, gsize len){
+  g->rand=NULL;
+  g->seed=siphash((const guchar *)value, len);
+  g->counter=0;
+  g->available=0;
+}
+
+static void random_generator(struct mask_generator *g){
+  g->rand=get_thread_rand();
+  g->available=0;
+}
+
+static guint64 next_word(struct mask_generator *g){
+  if (g->rand)
+    return ((guint64)g_rand_int(g->rand) << 32) | g_rand_int(g->rand);
+  guint64 block[2]={GUINT64_TO_LE(g->seed), GUINT64_TO_LE(g->counter)};
+  g->counter++;
+  return siphash((const guchar *)block, sizeof(block));
+}
+
+// Returns a value lower than base, taking as many of them as possible out of
+// each 64 bits word. The bias is negligible for the small bases used here.
+static guint next_value(struct mask_generator *g, guint base){
+  if (g->available < base){
+    g->word=next_word(g);
+    g->available=G_MAXUINT32;
+  }
+  guint v=g->word % base;
+  g->word/=base;
+  g->available/=base;
+  return v;
+}
+
+// Digits are replaced by digits and letters by letters of the same case,
+// anything else is kept, so the length and the format are preserved
+static void mask_characters(gchar *p, gsize len, struct mask_generator *g, gboolean letters){
+  gsize i;
+  for (i=0; i<len; i++){
+    if (g_ascii_isdigit(p[i]))
+      p[i]='0' + next_value(g, 10);
+    else if (letters && g_ascii_islower(p[i]))
+      p[i]='a' + next_value(g, 26);
+    else if (letters && g_ascii_isupper(p[i]))
+      p[i]='A' + next_value(g, 26);
+  }
+}
+
+static void mask_hex(gchar *p, gsize len, struct mask_generator *g){
+  const gchar charset[] = "0123456789abcdef";
+  gsize i;
+  for (i=0; i<len; i++)
+    if (g_ascii_isxdigit(p[i]))
+      p[i]=charset[next_value(g, 16)];
+}
+
+// The first digit is not masked as 0 to not change the magnitude
+static void mask_integer(gchar *p, gsize len, struct mask_generator *g){
+  gsize i=0;
+  if (len && p[0]=='-')
+    i++;
+  if (i+1<len && g_ascii_isdigit(p[i])){
+    p[i]='1' + next_value(g, 9);
+    i++;
+  }
+  mask_characters(p+i, len-i, g, FALSE);
+}
+
+// Copies the value at the end of the arena and returns where it starts, so
+// the masks that keep the format can change it in place
+static inline gchar *append_value(GString *arena, const gchar *value, gulong length){
+  gsize start=arena->len;
+  g_string_append_len(arena, value, length);
+  return arena->str + start;
+}
+
+static inline void random_int_value(const gchar *value, gulong length, GString *arena, struct function_pointer *fp, struct mask_generator *g){
+  (void) fp;
+  mask_integer(append_value(arena, value, length), length, g);
+}
+
+static inline void keyed_int_value(const gchar *value, gulong length, GString *arena, struct function_pointer *fp, struct mask_generator *g){
+  (void) fp;
+  keyed_generator(g, value, length);
+  mask_integer(append_value(arena, value, length), length, g);
+}
+
+static inline void random_uuid_value(const gchar *value, gulong length, GString *arena, struct function_pointer *fp, struct mask_generator *g){
+  (void) fp;
+  mask_hex(append_value(arena, value, length), length, g);
+}
+
+static inline void keyed_uuid_value(const gchar *value, gulong length, GString *arena, struct function_pointer *fp, struct mask_generator *g){
+  (void) fp;
+  keyed_generator(g, value, length);
+  mask_hex(append_value(arena, value, length), length, g);
+}
+
+// The local part and the domain labels are masked, the '@', the dots and the
+// top level domain are kept
+static inline void mask_email_value(const gchar *value, gulong length, GString *arena, struct function_pointer *fp, struct mask_generator *g){
+  (void) fp;
+  gchar *p=append_value(arena, value, length);
+  gchar *at=g_strrstr_len(p, length, "@");
+  gchar *tld=at ? g_strrstr_len(at, length - (at - p), ".") : NULL;
+  keyed_generator(g, value, length);
+  mask_characters(p, tld ? (gsize)(tld - p) : length, g, TRUE);
+}
+
+static inline void mask_phone_value(const gchar *value, gulong length, GString *arena, struct function_pointer *fp, struct mask_generator *g){
+  (void) fp;
+  keyed_generator(g, value, length);
+  mask_characters(append_value(arena, value, length), length, g, FALSE);
+}
+
+// Moves the YYYY-MM-DD part of DATE, DATETIME and TIMESTAMP values up to
+// fp->max days in either direction, the time part is kept
+static inline void date_shift_value(const gchar *value, gulong length, GString *arena, struct function_pointer *fp, struct mask_generator *g){
+  gchar *p=append_value(arena, value, length);
+  guint year, month, day;
+  if (length < 10 || p[4]!='-' || p[7]!='-' || sscanf(p, "%4u-%2u-%2u", &year, &month, &day) != 3 ||
+      !g_date_valid_dmy(day, month, year))
+    return;
+  keyed_generator(g, p, 10);
+  // In guint64, as 2*max+1 does not fit in a gint64 when max is large
+  gint64 shift=(gint64)(next_word(g) % (2 * (guint64)fp->max + 1) - (guint64)fp->max);
+  GDate date;
+  g_date_clear(&date, 1);
+  g_date_set_dmy(&date, day, month, year);
+  if (shift > 0 && shift <= G_MAXUINT32 - g_date_get_julian(&date))
+    g_date_add_days(&date, shift);
+  else if (shift < 0 && g_date_get_julian(&date) > (guint64)-shift)
+    g_date_subtract_days(&date, -shift);
+  if (g_date_get_year(&date) > 9999)
+    return;
+  gchar c=p[10];
+  g_snprintf(p, 11, "%04u-%02u-%02u", g_date_get_year(&date), g_date_get_month(&date), g_date_get_day(&date));
+  p[10]=c;
+}
+
+// Integers are replaced by a value between fp->min and fp->max, the values
+// that are not integers get their digits masked instead
+static inline void numeric_range_value(const gchar *value, gulong length, GString *arena, struct function_pointer *fp, struct mask_generator *g){
+  gulong i=(length && value[0]=='-');
+  keyed_generator(g, value, length);
+  for (; i<length; i++)
+    if (!g_ascii_isdigit(value[i]))
+      break;
+  if (i == length && length > 0){
+    // min+offset overflows a gint64 when the range is wider than G_MAXINT64,
+    // so it is added in guint64, where it wraps into the range
+    guint64 range=(guint64)fp->max - (guint64)fp->min;
+    gint64 v=(gint64)((guint64)fp->min + (range == G_MAXUINT64 ? next_word(g) : next_word(g) % (range + 1)));
+    g_string_append_printf(arena, "%" G_GINT64_FORMAT, v);
+  }else
+    mask_characters(append_value(arena, value, length), length, g, FALSE);
+}
+
+// Masks the values of the column into the arena, NULL values are kept. The
+// offsets are turned into pointers at the end, as the arena is reallocated
+// while it grows. It is inlined in each batch function, so there is no
+// indirect call per value.
+static inline void mask_column_with(struct mask_column *c, struct function_pointer *fp, gboolean keyed,
+    void mask(const gchar *, gulong, GString *, struct function_pointer *, struct mask_generator *)){
+  struct mask_generator g;
+  guint i;
+  if (!keyed)
+    random_generator(&g);
+  g_string_set_size(c->arena, 0);
+  for (i=0; i<c->count; i++){
+    if (!c->values[i])
+      continue;
+    c->offsets[i]=c->arena->len;
+    mask(c->values[i], c->lengths[i], c->arena, fp, &g);
+    c->lengths[i]=c->arena->len - c->offsets[i];
+    g_string_append_c(c->arena, '\0');
   }
-  g_strlcpy(*r, value, strlen(*r)+1);
-  return *r;
+  for (i=0; i<c->count; i++)
+    if (c->values[i])
+      c->values[i]=c->arena->str + c->offsets[i];
+}
+
+void identity_function(struct mask_column *c, struct function_pointer *fp){
+  (void) c;
+  (void) fp;
+}
+
+void random_int_function(struct mask_column *c, struct function_pointer *fp){
+  mask_column_with(c, fp, FALSE, random_int_value);
+}
+
+void random_int_function_with_mem(struct mask_column *c, struct function_pointer *fp){
+  mask_column_with(c, fp, TRUE, keyed_int_value);
+}
+
+void random_uuid_function(struct mask_column *c, struct function_pointer *fp){
+  mask_column_with(c, fp, FALSE, random_uuid_value);
+}
+
+void random_uuid_function_with_mem(struct mask_column *c, struct function_pointer *fp){
+  mask_column_with(c, fp, TRUE, keyed_uuid_value);
+}
+
+void mask_email_function(struct mask_column *c, struct function_pointer *fp){
+  mask_column_with(c, fp, TRUE, mask_email_value);
+}
+
+void mask_phone_function(struct mask_column *c, struct function_pointer *fp){
+  mask_column_with(c, fp, TRUE, mask_phone_value);
+}
+
+void date_shift_function(struct mask_column *c, struct function_pointer *fp){
+  mask_column_with(c, fp, TRUE, date_shift_value);
+}
+
+void numeric_range_function(struct mask_column *c, struct function_pointer *fp){
+  mask_column_with(c, fp, TRUE, numeric_range_value);
 }
 
 fun_ptr get_function_pointer_for (gchar *function_char){
   if (!g_strcmp0(function_char,"random_int"))
     return &random_int_function;
-  if (!g_strcmp0(function_char,"random_int_with_mem"))
+  if (!g_strcmp0(function_char,"random_int_with_mem") || !g_strcmp0(function_char,"mask_int"))
     return &random_int_function_with_mem;
 
   if (!g_strcmp0(function_char,"random_uuid"))
     return &random_uuid_function;
-  if (!g_strcmp0(function_char,"random_uuid_with_mem"))
+  if (!g_strcmp0(function_char,"random_uuid_with_mem") || !g_strcmp0(function_char,"mask_uuid"))
     return &random_uuid_function_with_mem;
 
-  // TODO: more functions needs to be added.
-  if (!g_strcmp0(function_char,""))
-    return &identity_function;
-  if (!g_strcmp0(function_char,""))
-    return &identity_function;
+  if (!g_strcmp0(function_char,"mask_email"))
+    return &mask_email_function;
+  if (!g_strcmp0(function_char,"mask_phone"))
+    return &mask_phone_function;
+  if (!g_strcmp0(function_char,"date_shift"))
+    return &date_shift_function;
+  if (!g_strcmp0(function_char,"numeric_range"))
+    return &numeric_range_function;
+
+  if (g_strcmp0(function_char,""))
+    g_warning("Unknown masking function %s, the column is not going to be masked", function_char);
   return &identity_function;
 }
+
+// The value in the config file is the function name followed by its
+// parameters separated by spaces, like: date_shift 90
+struct function_pointer * new_function_pointer(gchar *value){
+  struct function_pointer *fp = g_new0(struct function_pointer, 1);
+  gchar **parameters = g_strsplit_set(g_strstrip(value), " \t", 0);
+  guint n=0, i;
+  for (i=0; parameters[i]; i++)
+    if (*parameters[i] != '\0')
+      parameters[n++]=parameters[i];
+    else
+      g_free(parameters[i]);
+  parameters[n]=NULL;
+  fp->function=n ? get_function_pointer_for(parameters[0]) : &identity_function;
+  if (fp->function == &date_shift_function){
+    fp->max=n > 1 ? g_ascii_strtoll(parameters[1], NULL, 10) : DEFAULT_DATE_SHIFT_DAYS;
+    if (fp->max < 0)
+      fp->max=fp->max == G_MININT64 ? G_MAXINT64 : -fp->max;
+  }else if (fp->function == &numeric_range_function){
+    if (n < 3)
+      m_critical("numeric_range needs the minimum and the maximum: %s", value);
+    fp->min=g_ascii_strtoll(parameters[1], NULL, 10);
+    fp->max=g_ascii_strtoll(parameters[2], NULL, 10);
+    if (fp->min > fp->max)
+      m_critical("numeric_range minimum is greater than the maximum: %s", value);
+  }
+  g_strfreev(parameters);
+  return fp;
+}
+
+static MYSQL_ROW next_source_row(struct mask_reader *r, gulong **lengths){
+  if (r->fetch_row)
+    return r->fetch_row(r->source, lengths);
+  MYSQL_ROW row=mysql_fetch_row(r->result);
+  if (row)
+    *lengths=mysql_fetch_lengths(r->result);
+  return row;
+}
+
+// The rows are copied out of the libmysql buffer, which is only valid until
+// the next fetch, and each masked column is masked once per batch
+static void fill_mask_batch(struct mask_reader *r){
+  MYSQL_ROW row;
+  gulong *lengths;
+  GList *l;
+  guint i;
+  gchar **values;
+  g_string_set_size(r->arena, 0);
+  r->count=0;
+  r->next=0;
+  while (r->count < MASK_BATCH_ROWS && r->arena->len < MASK_BATCH_SIZE && (row = next_source_row(r, &lengths))){
+    values=r->rows + r->count * r->num_fields;
+    for (i=0; i<r->num_fields; i++){
+      r->lengths[r->count * r->num_fields + i]=lengths[i];
+      if (!row[i]){
+        values[i]=NULL;
+        continue;
+      }
+      r->offsets[r->count * r->num_fields + i]=r->arena->len;
+      g_string_append_len(r->arena, row[i], lengths[i]);
+      g_string_append_c(r->arena, '\0');
+      values[i]=r->arena->str;
+    }
+    r->count++;
+  }
+  for (i=0; i<r->count * r->num_fields; i++)
+    if (r->rows[i])
+      r->rows[i]=r->arena->str + r->offsets[i];
+  for (l=r->masked; l; l=l->next){
+    struct mask_column *c=l->data;
+    for (i=0; i<r->count; i++){
+      c->values[i]=r->rows[i * r->num_fields + c->column];
+      c->lengths[i]=r->lengths[i * r->num_fields + c->column];
+    }
+    c->count=r->count;
+    c->fp->function(c, c->fp);
+    for (i=0; i<r->count; i++){
+      r->rows[i * r->num_fields + c->column]=c->values[i];
+      r->lengths[i * r->num_fields + c->column]=c->lengths[i];
+    }
+  }
+}
+
+static void init_mask_columns(struct mask_reader *r, GList *anonymized_function){
+  GList *f;
+  guint i=0;
+  for (f=anonymized_function; f && i<r->num_fields; f=f->next, i++){
+    struct function_pointer *fp=f->data;
+    if (fp->function == &identity_function)
+      continue;
+    struct mask_column *c=g_new0(struct mask_column, 1);
+    c->column=i;
+    c->fp=fp;
+    c->values=g_new(gchar *, MASK_BATCH_ROWS);
+    c->lengths=g_new(gulong, MASK_BATCH_ROWS);
+    c->offsets=g_new(gsize, MASK_BATCH_ROWS);
+    c->arena=g_string_sized_new(MASK_BATCH_ROWS * 16);
+    r->masked=g_list_append(r->masked, c);
+  }
+  if (!r->masked)
+    return;
+  r->rows=g_new(gchar *, MASK_BATCH_ROWS * r->num_fields);
+  r->lengths=g_new(gulong, MASK_BATCH_ROWS * r->num_fields);
+  r->offsets=g_new(gsize, MASK_BATCH_ROWS * r->num_fields);
+  r->arena=g_string_sized_new(MASK_BATCH_ROWS * 64);
+}
+
+void mask_reader_init(struct mask_reader *r, MYSQL_RES *result, GList *anonymized_function){
+  memset(r, 0, sizeof(struct mask_reader));
+  r->result=result;
+  r->fields=mysql_fetch_fields(result);
+  r->num_fields=mysql_num_fields(result);
+  init_mask_columns(r, anonymized_function);
+}
+
+void mask_reader_init_with_source(struct mask_reader *r, MYSQL_FIELD *fields, guint num_fields, mask_row_source fetch_row, gpointer source, GList *anonymized_function){
+  memset(r, 0, sizeof(struct mask_reader));
+  r->fields=fields;
+  r->num_fields=num_fields;
+  r->fetch_row=fetch_row;
+  r->source=source;
+  init_mask_columns(r, anonymized_function);
+}
+
+// Tables without masked columns get the rows straight from libmysql
+MYSQL_ROW mask_reader_fetch_row(struct mask_reader *r, gulong **lengths){
+  if (!r->masked)
+    return next_source_row(r, lengths);
+  if (r->next == r->count){
+    fill_mask_batch(r);
+    if (!r->count)
+      return NULL;
+  }
+  *lengths=r->lengths + r->next * r->num_fields;
+  return r->rows + r->next++ * r->num_fields;
+}
+
+static void free_mask_column(struct mask_column *c){
+  g_free(c->values);
+  g_free(c->lengths);
+  g_free(c->offsets);
+  g_string_free(c->arena, TRUE);
+  g_free(c);
+}
+
+void mask_reader_clear(struct mask_reader *r){
+  if (!r->masked)
+    return;
+  g_list_free_full(r->masked, (GDestroyNotify)free_mask_column);
+  g_free(r->rows);
+  g_free(r->lengths);
+  g_free(r->offsets);
+  g_string_free(r->arena, TRUE);
+  r->masked=NULL;
+}
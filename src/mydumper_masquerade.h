@@ -11,10 +11,57 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
     Authors:        David Ducos, Percona (david dot ducos at percona dot com)
 */
+#ifndef _src_mydumper_masquerade_h
+#define _src_mydumper_masquerade_h
 #include "common.h"
 
-gchar * random_uuid_function(gchar ** r, GHashTable * mem);
-gchar *    identity_function(gchar ** r, GHashTable * mem);
-gchar *  random_int_function(gchar ** r, GHashTable * mem);
-fun_ptr get_function_pointer_for (gchar *function_char);
+#include <mysql.h>
+
+#define MASK_BATCH_ROWS 1024
+#define MASK_BATCH_SIZE 16777216
+
+// The values of one column for a batch of rows. The masking functions write
+// the masked values into the arena and point values and lengths to them, so
+// they can have a different length than the original ones.
+struct mask_column{
+  guint column;
+  struct function_pointer *fp;
+  guint count;
+  gchar **values;
+  gulong *lengths;
+  gsize *offsets;
+  GString *arena;
+};
 
+typedef MYSQL_ROW (*mask_row_source)(gpointer source, gulong **lengths);
+
+// Fetches the rows of a result in batches of MASK_BATCH_ROWS, or
+// MASK_BATCH_SIZE bytes, and masks them column by column. The rows come from
+// fetch_row when it is set instead of the result, used when they are already
+// in memory.
+struct mask_reader{
+  MYSQL_RES *result;
+  MYSQL_FIELD *fields;
+  guint num_fields;
+  mask_row_source fetch_row;
+  gpointer source;
+  GList *masked;
+  GString *arena;
+  gchar **rows;
+  gulong *lengths;
+  gsize *offsets;
+  guint count;
+  guint next;
+};
+
+void random_uuid_function(struct mask_column *c, struct function_pointer *fp);
+void    identity_function(struct mask_column *c, struct function_pointer *fp);
+void  random_int_function(struct mask_column *c, struct function_pointer *fp);
+fun_ptr get_function_pointer_for (gchar *function_char);
+struct function_pointer * new_function_pointer(gchar *value);
+void initialize_masquerade();
+void mask_reader_init(struct mask_reader *r, MYSQL_RES *result, GList *anonymized_function);
+void mask_reader_init_with_source(struct mask_reader *r, MYSQL_FIELD *fields, guint num_fields, mask_row_source fetch_row, gpointer source, GList *anonymized_function);
+MYSQL_ROW mask_reader_fetch_row(struct mask_reader *r, gulong **lengths);
+void mask_reader_clear(struct mask_reader *r);
+#endif
@@ -17,6 +17,7 @@
 
 #include <stddef.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include <glib.h>
 #include <glib/gstdio.h>
@@ -24,19 +25,148 @@
 #include <gio/gio.h>
 #include <mysql.h>
 #include "mydumper_start_dump.h"
+#include "mydumper_database.h"
+#include "mydumper_write.h"
 #include "mydumper_global.h"
 
 gint kill_pmm = 0;
+static struct thread_data *pmm_td = NULL;
+static guint pmm_td_count = 0;
+static gint64 pmm_start_time = 0;
 
 void kill_pmm_thread(){
   kill_pmm=1;
 }
 
+void set_pmm_thread_data(struct thread_data *td, guint n){
+  pmm_td=td;
+  pmm_td_count=n;
+}
+
 void append_pmm_entry(GString *content, const gchar *key, GAsyncQueue * queue){
   if (queue != NULL)
     g_string_append_printf(content,"mydumper_queue{name=\"%s\"} %d\n",key,g_async_queue_length(queue));
 }
 
+void append_pmm_thread_counter(GString *content, const gchar *name, gsize offset){
+  guint n=0;
+  gchar labels[32];
+  append_metric_type(content, name, "counter");
+  for (n=0; n < pmm_td_count; n++){
+    g_snprintf(labels, sizeof(labels), "thread=\"%d\"", pmm_td[n].thread_id);
+    append_metric_counter(content, name, labels, *(guint64 *)((gchar *)&(pmm_td[n].stats) + offset));
+  }
+}
+
+void append_pmm_thread_time(GString *content, const gchar *stage, gint64 (*get)(struct thread_stats *)){
+  guint n=0;
+  gchar labels[64];
+  for (n=0; n < pmm_td_count; n++){
+    g_snprintf(labels, sizeof(labels), "thread=\"%d\",stage=\"%s\"", pmm_td[n].thread_id, stage);
+    append_metric_seconds(content, "mydumper_thread_time_seconds_total", labels, get(&(pmm_td[n].stats)));
+  }
+}
+
+gint64 get_fetch_time(struct thread_stats *s){ return s->fetch_time; }
+gint64 get_encode_time(struct thread_stats *s){ return s->encode_time; }
+gint64 get_write_time(struct thread_stats *s){ return s->write_time; }
+gint64 get_lock_wait_time(struct thread_stats *s){ return s->lock_wait_time; }
+
+void append_pmm_thread_histogram(GString *content, const gchar *name, struct latency_histogram *total, gsize offset){
+  guint n=0;
+  gchar labels[32];
+  struct latency_histogram *h=NULL;
+  append_metric_type(content, name, "histogram");
+  for (n=0; n < pmm_td_count; n++){
+    h=(struct latency_histogram *)((gchar *)&(pmm_td[n].stats) + offset);
+    g_snprintf(labels, sizeof(labels), "thread=\"%d\"", pmm_td[n].thread_id);
+    append_metric_histogram(content, name, labels, h);
+    histogram_merge(total, h);
+  }
+  append_metric_histogram(content, name, "thread=\"all\"", total);
+}
+
+void append_pmm_entry_threads(GString *content){
+  guint n=0;
+  gchar labels[32];
+  struct latency_histogram total;
+  if (pmm_td == NULL)
+    return;
+  append_pmm_thread_counter(content, "mydumper_thread_rows_total", G_STRUCT_OFFSET(struct thread_stats, rows));
+  append_pmm_thread_counter(content, "mydumper_thread_bytes_total", G_STRUCT_OFFSET(struct thread_stats, bytes));
+  append_pmm_thread_counter(content, "mydumper_thread_compressed_bytes_total", G_STRUCT_OFFSET(struct thread_stats, compressed_bytes));
+  append_pmm_thread_counter(content, "mydumper_thread_chunks_total", G_STRUCT_OFFSET(struct thread_stats, chunks));
+  append_pmm_thread_counter(content, "mydumper_thread_files_total", G_STRUCT_OFFSET(struct thread_stats, files));
+
+  // When compression is enabled, the write stage also includes the compression
+  append_metric_type(content, "mydumper_thread_time_seconds_total", "counter");
+  append_pmm_thread_time(content, "fetch", &get_fetch_time);
+  append_pmm_thread_time(content, "encode", &get_encode_time);
+  append_pmm_thread_time(content, compress_output ? "compress" : "write", &get_write_time);
+  append_pmm_thread_time(content, "lock_wait", &get_lock_wait_time);
+  append_metric_seconds(content, "mydumper_thread_time_seconds_total", "thread=\"main\",stage=\"lock_wait\"", main_lock_wait_time);
+
+  append_metric_type(content, "mydumper_thread_chunk_step", "gauge");
+  for (n=0; n < pmm_td_count; n++){
+    g_snprintf(labels, sizeof(labels), "thread=\"%d\"", pmm_td[n].thread_id);
+    append_metric_counter(content, "mydumper_thread_chunk_step", labels, pmm_td[n].stats.chunk_step);
+  }
+  append_metric_type(content, "mydumper_thread_files_in_flight", "gauge");
+  for (n=0; n < pmm_td_count; n++){
+    g_snprintf(labels, sizeof(labels), "thread=\"%d\"", pmm_td[n].thread_id);
+    append_metric_counter(content, "mydumper_thread_files_in_flight", labels, pmm_td[n].stats.files_in_flight);
+  }
+
+  memset(&total, 0, sizeof(struct latency_histogram));
+  append_pmm_thread_histogram(content, "mydumper_query_latency_seconds", &total, G_STRUCT_OFFSET(struct thread_stats, query_latency));
+  memset(&total, 0, sizeof(struct latency_histogram));
+  append_pmm_thread_histogram(content, "mydumper_chunk_latency_seconds", &total, G_STRUCT_OFFSET(struct thread_stats, chunk_latency));
+}
+
+guint64 append_pmm_entry_table_list(GString *content, GList **list, GMutex *mutex){
+  GList *iter=NULL;
+  struct db_table *dbt=NULL;
+  gchar *labels=NULL;
+  guint64 remaining=0, total=0;
+  if (mutex == NULL)
+    return 0;
+  g_mutex_lock(mutex);
+  for (iter=*list; iter != NULL; iter=iter->next){
+    dbt=iter->data;
+    g_mutex_lock(dbt->chunks_mutex);
+    remaining=get_estimated_remaining_chunks_on_dbt(dbt);
+    g_mutex_unlock(dbt->chunks_mutex);
+    total+=remaining;
+    labels=g_strdup_printf("database=\"%s\",table=\"%s\"", dbt->database->name, dbt->table);
+    append_metric_counter(content, "mydumper_table_rows_total", labels, dbt->rows);
+    append_metric_counter(content, "mydumper_table_bytes_total", labels, dbt->bytes);
+    append_metric_counter(content, "mydumper_table_chunks_total", labels, g_atomic_int_get(dbt->chunks_completed));
+    append_metric_counter(content, "mydumper_table_estimated_remaining_chunks", labels, remaining);
+    g_free(labels);
+  }
+  g_mutex_unlock(mutex);
+  return total;
+}
+
+void append_pmm_entry_tables(GString *content){
+  guint64 remaining=0, done=0;
+  guint n=0;
+  append_metric_type(content, "mydumper_table_rows_total", "counter");
+  append_metric_type(content, "mydumper_table_bytes_total", "counter");
+  append_metric_type(content, "mydumper_table_chunks_total", "counter");
+  append_metric_type(content, "mydumper_table_estimated_remaining_chunks", "gauge");
+  remaining+=append_pmm_entry_table_list(content, &non_innodb_table, non_innodb_table_mutex);
+  remaining+=append_pmm_entry_table_list(content, &innodb_table, innodb_table_mutex);
+  for (n=0; n < pmm_td_count; n++)
+    done+=pmm_td[n].stats.chunks;
+  // Same estimation than get_estimated_remaining_of_all_chunks, but holding
+  // the locks as the lists are being modified by the working threads
+  append_metric_type(content, "mydumper_estimated_remaining_chunks", "gauge");
+  g_string_append_printf(content,"mydumper_estimated_remaining_chunks %"G_GUINT64_FORMAT"\n", remaining);
+  append_metric_type(content, "mydumper_eta_seconds", "gauge");
+  g_string_append_printf(content,"mydumper_eta_seconds %.0f\n", estimate_remaining_seconds(done, remaining, g_get_monotonic_time() - pmm_start_time));
+}
+
 void write_pmm_entries(const gchar* filename, GString *content, struct configuration* conf){
   g_string_set_size(content,0);
   append_pmm_entry(content,"schema_queue",      conf->schema_queue);
@@ -47,12 +177,15 @@ void write_pmm_entries(const gchar* filename, GString *content, struct configura
   append_pmm_entry(content,"unlock_tables",     conf->unlock_tables);
   append_pmm_entry(content,"pause_resume",      conf->pause_resume);
   append_pmm_entry(content,"stream_queue",      stream_queue);
+  append_pmm_entry_threads(content);
+  append_pmm_entry_tables(content);
   g_file_set_contents( filename , content->str, content->len, NULL);
 }
 
 void *pmm_thread(void *conf){
   const gchar* filename=g_strdup_printf("%s/mydumper.prom",pmm_path);
   GString *content = g_string_sized_new(200);
+  pmm_start_time=g_get_monotonic_time();
   while (!kill_pmm){
     write_pmm_entries(filename, content, (struct configuration*)conf);
     sleep(1);
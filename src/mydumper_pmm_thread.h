@@ -17,3 +17,4 @@
 
 void *pmm_thread(void *data);
 void kill_pmm_thread();
+void set_pmm_thread_data(struct thread_data *td, guint n);
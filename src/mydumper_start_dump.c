@@ -56,7 +56,6 @@
 #include "logging.h"
 #include "set_verbose.h"
 #include "locale.h"
-#include <sys/statvfs.h>
 
 #include "tables_skiplist.h"
 #include "regex.h"
@@ -72,6 +71,10 @@
 #include "mydumper_masquerade.h"
 #include "mydumper_chunks.h"
 #include "mydumper_write.h"
+#include "mydumper_disk_governor.h"
+#include "mydumper_throttle.h"
+#include "mydumper_stripe.h"
+#include "manifest.h"
 /* Some earlier versions of MySQL do not yet define MYSQL_TYPE_JSON */
 #ifndef MYSQL_TYPE_JSON
 #define MYSQL_TYPE_JSON 245
@@ -97,6 +100,7 @@ gboolean less_locking = FALSE;
 gboolean no_backup_locks = FALSE;
 gboolean no_ddl_locks = FALSE;
 gboolean dump_tablespaces = FALSE;
+gboolean write_dump_manifest = FALSE;
 GList *all_dbts = NULL;
 GList *table_schemas = NULL;
 GList *trigger_schemas = NULL;
@@ -110,8 +114,7 @@ guint trx_consistency_only = 0;
 gchar *pmm_resolution = NULL;
 gchar *pmm_path = NULL;
 gboolean pmm = FALSE;
-guint pause_at=0;
-guint resume_at=0;
+gint64 main_lock_wait_time = 0;
 gchar **db_items=NULL;
 
 GMutex *ready_database_dump_mutex = NULL;
@@ -123,6 +126,7 @@ gchar *exec_command=NULL;
 void initialize_start_dump(){
   initialize_set_names();
   initialize_working_thread();
+  initialize_masquerade();
   conf_per_table.all_anonymized_function=g_hash_table_new ( g_str_hash, g_str_equal );
   conf_per_table.all_where_per_table=g_hash_table_new ( g_str_hash, g_str_equal );
   conf_per_table.all_limit_per_table=g_hash_table_new ( g_str_hash, g_str_equal );
@@ -156,56 +160,6 @@ void initialize_start_dump(){
   }
 }
 
-void set_disk_limits(guint p_at, guint r_at){
-  pause_at=p_at;
-  resume_at=r_at;
-}
-
-gboolean is_disk_space_ok(guint val){
-  struct statvfs buffer;
-  int ret = statvfs(output_directory, &buffer);
-  if (!ret) {
-    const double available = (double)(buffer.f_bfree * buffer.f_frsize) / 1024 / 1024;
-    return available > val;
-  }else{
-    g_warning("Disk space check failed");
-  }
-  return TRUE;
-}
-
-void *monitor_disk_space_thread (void *queue){
-  (void)queue;
-  guint i=0;
-  GMutex **pause_mutex_per_thread=g_new(GMutex * , num_threads) ;
-  for(i=0;i<num_threads;i++){
-    pause_mutex_per_thread[i]=g_mutex_new();
-  }
-
-  gboolean previous_state = TRUE, current_state = TRUE;
-
-  while (disk_limits != NULL){
-    current_state = previous_state ? is_disk_space_ok(pause_at) : is_disk_space_ok(resume_at);
-    if (previous_state != current_state){
-      if (!current_state){
-        g_warning("Pausing backup disk space lower than %dMB. You need to free up to %dMB to resume",pause_at,resume_at);
-        for(i=0;i<num_threads;i++){
-          g_mutex_lock(pause_mutex_per_thread[i]);
-          g_async_queue_push(queue,pause_mutex_per_thread[i]);
-        }
-      }else{
-        g_warning("Resuming backup");
-        for(i=0;i<num_threads;i++){
-          g_mutex_unlock(pause_mutex_per_thread[i]);
-        }
-      }
-      previous_state = current_state;
-
-    }
-    sleep(10);
-  }
-  return NULL;
-}
-
 GMutex **pause_mutex_per_thread=NULL;
 
 gboolean sig_triggered(void * user_data, int signal) {
@@ -294,7 +248,7 @@ MYSQL *create_main_connection() {
   if (key_file != NULL ){
     load_hash_of_all_variables_perproduct_from_key_file(key_file,set_global_hash,"mydumper_global_variables");
     load_hash_of_all_variables_perproduct_from_key_file(key_file,set_session_hash,"mydumper_session_variables");
-    load_per_table_info_from_key_file(key_file, &conf_per_table, &get_function_pointer_for);
+    load_per_table_info_from_key_file(key_file, &conf_per_table, &new_function_pointer);
   }
   refresh_set_session_from_hash(set_session,set_session_hash);
   refresh_set_global_from_hash(set_global, set_global_back, set_global_hash);
@@ -660,6 +614,8 @@ void send_lock_all_tables(MYSQL *conn){
 
 void start_dump() {
   initialize_start_dump();
+  initialize_trace("mydumper");
+  struct trace_buffer *main_trace=new_trace_buffer("main", 0);
   initialize_common();
   initialize_connection(key_file!=NULL && g_key_file_has_group(key_file,"mydumper")?defaults_file:NULL);
 
@@ -691,11 +647,7 @@ void start_dump() {
 //  struct schema_post *sp;
   guint n;
   FILE *nufile = NULL;
-  GThread *disk_check_thread = NULL;
-  if (disk_limits!=NULL){
-    conf.pause_resume = g_async_queue_new();
-    disk_check_thread = g_thread_create(monitor_disk_space_thread, conf.pause_resume, FALSE, NULL);
-  }
+  start_disk_governor();
 
   if (!daemon_mode){
     GError *serror;
@@ -714,7 +666,7 @@ void start_dump() {
     g_message("Using PMM resolution %s at %s", pmm_resolution, pmm_path);
     GError *serror;
     pmmthread =
-        g_thread_create(pmm_thread, &conf, FALSE, &serror);
+        g_thread_create(pmm_thread, &conf, TRUE, &serror);
     if (pmmthread == NULL) {
       m_critical("Could not create pmm thread: %s", serror->message);
       g_error_free(serror);
@@ -782,6 +734,7 @@ void start_dump() {
       if (!no_backup_locks)
         determine_ddl_lock_function(&second_conn,&flush_table_function, &acquire_ddl_lock_function,&release_ddl_lock_function, &release_binlog_function);
 
+      gint64 lock_start=g_get_monotonic_time();
       if (lock_all_tables) {
         send_lock_all_tables(conn);
       } else {
@@ -793,6 +746,8 @@ void start_dump() {
           acquire_ddl_lock_function(second_conn);
         }
       }
+      main_lock_wait_time=g_get_monotonic_time()-lock_start;
+      trace_span(main_trace, "lock", NULL, NULL, -1, lock_start);
     } else {
       g_warning("Executing in no-locks mode, snapshot might not be consistent");
     }
@@ -907,11 +862,15 @@ void start_dump() {
 
   GThread **threads = g_new(GThread *, num_threads );
   struct thread_data *td =
-      g_new(struct thread_data, num_threads * (less_locking + 1));
+      g_new0(struct thread_data, num_threads * (less_locking + 1));
+  if (pmm)
+    set_pmm_thread_data(td, num_threads);
+  start_throttle(td, num_threads);
   g_message("Creating workers");
   for (n = 0; n < num_threads; n++) {
     td[n].conf = &conf;
     td[n].thread_id = n + 1;
+    td[n].trace = new_trace_buffer("dump", n + 1);
     td[n].less_locking_stage = FALSE;
     td[n].binlog_snapshot_gtid_executed = NULL;
     td[n].pause_resume_mutex=NULL;
@@ -1008,6 +967,12 @@ void start_dump() {
   for (n = 0; n < num_threads; n++) {
     g_thread_join(threads[n]);
   }
+  stop_throttle();
+  if (pmm){
+    kill_pmm_thread();
+    g_thread_join(pmmthread);
+  }
+  finalize_trace();
   finalize_working_thread();
 
   if (release_ddl_lock_function != NULL) {
@@ -1043,10 +1008,6 @@ void start_dump() {
   write_database_on_disk(mdfile);
 //  g_list_free(table_schemas);
 //  table_schemas=NULL;
-  if (pmm){
-    kill_pmm_thread();
-//    g_thread_join(pmmthread);
-  }
   g_async_queue_unref(conf.innodb_queue);
   conf.innodb_queue=NULL;
   g_async_queue_unref(conf.non_innodb_queue);
@@ -1076,6 +1037,17 @@ void start_dump() {
   g_rename(metadata_partial_filename, metadata_filename);
   if (stream) {
     g_async_queue_push(stream_queue, g_strdup(metadata_filename));
+  }else if (write_dump_manifest){
+    GHashTable *table_rows=g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    for (iter = all_dbts; iter != NULL; iter = iter->next) {
+      dbt = (struct db_table *)iter->data;
+      g_hash_table_insert(table_rows, g_strdup_printf("%s.%s", dbt->database->filename, dbt->table_filename), &(dbt->rows));
+    }
+    gchar **volumes=get_stripe_volumes();
+    if (!write_manifest(dump_directory, volumes, table_rows))
+      errors++;
+    g_strfreev(volumes);
+    g_hash_table_destroy(table_rows);
   }
   g_free(metadata_partial_filename);
   g_free(metadata_filename);
@@ -1098,9 +1070,7 @@ void start_dump() {
   g_free(threads);
   free_databases();
 
-  if (disk_check_thread!=NULL){
-    disk_limits=NULL;
-  }
+  stop_disk_governor();
 
   g_string_free(set_session, TRUE);
   g_string_free(set_global, TRUE);
@@ -15,6 +15,8 @@
         Authors:    David Ducos, Percona (david dot ducos at percona dot com)
 */
 
+#include "metrics.h"
+#include "trace.h"
 
 enum job_type {
   JOB_SHUTDOWN,
@@ -63,6 +65,34 @@ struct configuration {
   int done;
 };
 
+// Counters are only written by the thread that owns them, pmm_thread reads
+// and aggregates them when the textfile is written. Times are in microseconds.
+struct thread_stats {
+  guint64 rows;
+  guint64 bytes;
+  guint64 compressed_bytes;
+  guint64 chunks;
+  guint64 files;
+  guint files_in_flight;
+  guint64 chunk_step;
+  gint64 fetch_time;
+  gint64 encode_time;
+  gint64 write_time;
+  gint64 write_cpu_time;
+  gint64 lock_wait_time;
+  struct latency_histogram query_latency;
+  struct latency_histogram chunk_latency;
+};
+
+// Compression level that --compress-adaptive uses for the next data file, and
+// the thread_stats times when it was decided.
+struct adaptive_compression {
+  gint level;
+  gint64 fetch_time;
+  gint64 write_time;
+  gint64 write_cpu_time;
+};
+
 struct thread_data {
   struct configuration *conf;
   guint thread_id;
@@ -70,6 +100,14 @@ struct thread_data {
   gboolean less_locking_stage;
   gchar *binlog_snapshot_gtid_executed;
   GMutex *pause_resume_mutex;
+  struct thread_stats stats;
+  struct adaptive_compression adaptive;
+  struct trace_buffer *trace;
+  // Buffers reused by every chunk processed by the thread
+  GString *query;
+  GString *statement;
+  GString *statement_row;
+  GString *escaped;
 };
 
 struct job {
@@ -126,9 +164,13 @@ struct char_step {
   guint status;
 };
 
+// With --rows, current_partition is dumped in the ranges of sub_step, an
+// integer step on the key of the table. sub_step is NULL when the partition
+// is dumped with a single query.
 struct partition_step{
   GList *list;
   gchar *current_partition;
+  union chunk_step *sub_step;
   guint number;
   guint deep;
   GMutex *mutex;
@@ -151,7 +193,7 @@ struct table_job {
   guint nchunk;
   guint sub_part;
 //  char *filename;
-  char *where;
+  GString *where;
   union chunk_step *chunk_step;  
   char *order_by;
   struct db_table *dbt;
@@ -159,6 +201,7 @@ struct table_job {
   FILE *sql_file;
   gchar *dat_filename;
   FILE *dat_file;
+  struct columnar_file *columnar;
   float filesize;
   guint st_in_file;
   int char_chunk_part;
@@ -204,6 +247,7 @@ struct db_table {
   char *character_set;
   guint64 datalength;
   guint64 rows;
+  guint64 bytes;
   GMutex *rows_lock;
   GList *anonymized_function;
   gchar *where;
@@ -219,6 +263,8 @@ struct db_table {
   gchar *schema_checksum;
   gchar *indexes_checksum;
   gchar *triggers_checksum;
+  gpointer columnar_schema;
+  struct compression_dictionary *dictionary;
 };
 
 struct schema_post {
@@ -232,7 +278,6 @@ MYSQL *create_main_connection();
 void *exec_thread(void *data);
 gboolean sig_triggered_int(void * user_data);
 gboolean sig_triggered_term(void * user_data);
-void set_disk_limits(guint p_at, guint r_at);
 //gboolean write_data(FILE *, GString *);
 
 
@@ -0,0 +1,158 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <sys/statvfs.h>
+#include "common.h"
+#include "mydumper_stripe.h"
+#include "mydumper_global.h"
+
+// The data files are spread over the output directory and the directories in
+// --stripe-directories. Every new file goes to the directory that has less
+// bytes for its free space, counting the files that are still open as the
+// average size of the closed ones. The rest of the files stay in the output
+// directory.
+struct stripe {
+  gchar *directory;
+  gdouble free_space;
+  guint64 bytes;
+  guint open_files;
+};
+
+gchar *stripe_directories=NULL;
+static GPtrArray *stripes=NULL;
+static GMutex *stripe_mutex=NULL;
+static guint64 closed_bytes=0;
+static guint64 closed_files=0;
+static guint next_stripe=0;
+
+static gchar *normalize_stripe_directory(const gchar *directory){
+  gchar *r=g_strdup(directory);
+  gsize len=strlen(r);
+  while (len > 1 && r[len - 1] == '/')
+    r[--len]='\0';
+  return r;
+}
+
+static void add_stripe(const gchar *directory){
+  struct stripe *s=g_new0(struct stripe, 1);
+  struct statvfs buffer;
+  s->directory=normalize_stripe_directory(directory);
+  if (statvfs(s->directory, &buffer) == 0 && buffer.f_bavail > 0)
+    s->free_space=(gdouble)buffer.f_bavail * buffer.f_frsize;
+  else
+    s->free_space=1;
+  g_ptr_array_add(stripes, s);
+}
+
+void initialize_stripes(){
+  gchar **split, *cwd, *path;
+  guint i;
+  if (stripe_directories == NULL)
+    return;
+  if (daemon_mode)
+    m_critical("--stripe-directories is not supported with --daemon");
+  if (exec_per_thread != NULL)
+    m_critical("--stripe-directories is not supported with --exec-per-thread");
+  stripes=g_ptr_array_new();
+  stripe_mutex=g_mutex_new();
+  add_stripe(output_directory);
+  cwd=g_get_current_dir();
+  split=g_strsplit(stripe_directories, ",", 0);
+  for (i=0; split[i] != NULL; i++){
+    g_strstrip(split[i]);
+    if (strlen(split[i]) == 0)
+      continue;
+    // The paths are written in the manifest, myloader can run somewhere else
+    path=g_path_is_absolute(split[i]) ? g_strdup(split[i]) : g_build_filename(cwd, split[i], NULL);
+    create_backup_dir(path);
+    add_stripe(path);
+    g_free(path);
+  }
+  g_strfreev(split);
+  g_free(cwd);
+  if (stripes->len > 256)
+    m_critical("--stripe-directories accepts up to 255 directories");
+  g_message("Data files striped over %u directories", stripes->len);
+}
+
+gboolean is_striped(){
+  return stripes != NULL && stripes->len > 1;
+}
+
+// Returns the directory for a new data file
+const gchar *open_stripe_file(){
+  struct stripe *s, *best=NULL;
+  gdouble average, score, best_score=0;
+  guint i, n;
+  if (!is_striped())
+    return dump_directory;
+  g_mutex_lock(stripe_mutex);
+  average=closed_files > 0 ? (gdouble)closed_bytes / closed_files : 0;
+  n=stripes->len;
+  for (i=0; i < n; i++){
+    s=g_ptr_array_index(stripes, (next_stripe + i) % n);
+    score=(s->bytes + s->open_files * average) / s->free_space;
+    if (best == NULL || score < best_score){
+      best=s;
+      best_score=score;
+    }
+  }
+  next_stripe=(next_stripe + 1) % n;
+  best->open_files++;
+  g_mutex_unlock(stripe_mutex);
+  return best->directory;
+}
+
+void close_stripe_file(const gchar *filename){
+  GStatBuf st;
+  gchar *dirname;
+  struct stripe *s;
+  guint i;
+  if (!is_striped())
+    return;
+  if (g_stat(filename, &st) != 0)
+    st.st_size=0;
+  dirname=g_path_get_dirname(filename);
+  g_mutex_lock(stripe_mutex);
+  for (i=0; i < stripes->len; i++){
+    s=g_ptr_array_index(stripes, i);
+    if (g_strcmp0(s->directory, dirname) == 0){
+      if (s->open_files > 0)
+        s->open_files--;
+      s->bytes+=st.st_size;
+      closed_bytes+=st.st_size;
+      closed_files++;
+      break;
+    }
+  }
+  g_mutex_unlock(stripe_mutex);
+  g_free(dirname);
+}
+
+// The directories of the stripes other than the output directory, in order
+gchar **get_stripe_volumes(){
+  gchar **volumes;
+  guint i;
+  if (!is_striped())
+    return NULL;
+  volumes=g_new0(gchar *, stripes->len);
+  for (i=1; i < stripes->len; i++)
+    volumes[i - 1]=g_strdup(((struct stripe *)g_ptr_array_index(stripes, i))->directory);
+  return volumes;
+}
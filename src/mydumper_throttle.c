@@ -0,0 +1,265 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+#include <mysql.h>
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+#include "common.h"
+#include "connection.h"
+#include "mydumper_start_dump.h"
+#include "mydumper_throttle.h"
+#include "mydumper_global.h"
+
+gchar *throttle_limits=NULL;
+gchar *throttle_query=NULL;
+
+// Health metrics built in, a --throttle-query can return any other column
+#define THREADS_RUNNING "threads_running"
+#define HISTORY_LIST_LENGTH "history_list_length"
+#define REPLICA_LAG "replica_lag"
+#define CHUNK_TIME "chunk_time"
+
+static GHashTable *limits=NULL;
+static MYSQL *throttle_conn=NULL;
+static GThread *throttle_thread=NULL;
+static gboolean throttle_running=FALSE;
+static struct thread_data *throttle_td=NULL;
+static guint throttle_td_count=0;
+static gint active_workers=0;
+static gint chunk_scale=1;
+static GMutex *workers_mutex=NULL;
+static GCond *workers_cond=NULL;
+static GAsyncQueue *released_queue=NULL;
+
+// Called at the start of every dump, in daemon mode the workers of the
+// previous one must not be taken as released
+void initialize_throttle(){
+  g_atomic_int_set(&active_workers, num_threads);
+  g_atomic_int_set(&chunk_scale, 1);
+  released_queue=NULL;
+  if (throttle_limits == NULL || limits != NULL)
+    return;
+  workers_mutex=g_mutex_new();
+  workers_cond=g_cond_new();
+  limits=g_hash_table_new_full(g_str_hash, g_str_equal, &g_free, &g_free);
+  gchar **split=g_strsplit(throttle_limits, ",", 0);
+  guint i;
+  for (i=0; split[i] != NULL; i++){
+    gchar **kv=g_strsplit(split[i], "=", 2);
+    gdouble *limit=g_new(gdouble, 1);
+    if (kv[0] == NULL || kv[1] == NULL || (*limit=g_ascii_strtod(kv[1], NULL)) <= 0)
+      m_critical("Invalid --throttle limit %s, expected name=value with a value greater than 0", split[i]);
+    g_hash_table_insert(limits, g_ascii_strdown(g_strstrip(kv[0]), -1), limit);
+    g_strfreev(kv);
+  }
+  g_strfreev(split);
+}
+
+// Keeps in load the largest value/limit ratio seen, 1 is at the limit, and in
+// worst the metric that has it
+static void update_load(gdouble *load, gchar **worst, const gchar *name, gdouble value){
+  gdouble *limit=g_hash_table_lookup(limits, name);
+  if (limit == NULL || value / *limit <= *load)
+    return;
+  *load=value / *limit;
+  g_free(*worst);
+  *worst=g_strdup_printf("%s %.0f", name, value);
+}
+
+// Checks every column of the first row of the query that has a limit with
+// the same name. Returns FALSE if the query failed.
+static gboolean load_from_query(const gchar *query, gdouble *load, gchar **worst){
+  if (mysql_query(throttle_conn, query))
+    return FALSE;
+  MYSQL_RES *res=mysql_store_result(throttle_conn);
+  if (res == NULL)
+    return TRUE;
+  MYSQL_ROW row=mysql_fetch_row(res);
+  MYSQL_FIELD *fields=mysql_fetch_fields(res);
+  guint i;
+  for (i=0; row != NULL && i < mysql_num_fields(res); i++){
+    if (row[i] == NULL)
+      continue;
+    gchar *name=g_ascii_strdown(fields[i].name, -1);
+    update_load(load, worst, name, g_ascii_strtod(row[i], NULL));
+    g_free(name);
+  }
+  mysql_free_result(res);
+  return TRUE;
+}
+
+static gdouble get_second_column(const gchar *query, gboolean *found){
+  gdouble value=0;
+  *found=FALSE;
+  if (mysql_query(throttle_conn, query))
+    return 0;
+  MYSQL_RES *res=mysql_store_result(throttle_conn);
+  if (res == NULL)
+    return 0;
+  MYSQL_ROW row=mysql_fetch_row(res);
+  if (row != NULL && mysql_num_fields(res) > 1 && row[1] != NULL){
+    value=g_ascii_strtod(row[1], NULL);
+    *found=TRUE;
+  }
+  mysql_free_result(res);
+  return value;
+}
+
+static gdouble get_replica_lag(gboolean *found){
+  gdouble lag=0;
+  *found=FALSE;
+  if (mysql_query(throttle_conn, "SHOW REPLICA STATUS") && mysql_query(throttle_conn, "SHOW SLAVE STATUS"))
+    return 0;
+  MYSQL_RES *res=mysql_store_result(throttle_conn);
+  if (res == NULL)
+    return 0;
+  MYSQL_ROW row;
+  MYSQL_FIELD *fields=mysql_fetch_fields(res);
+  guint i;
+  // With multi-source replication the largest lag is the one that matters
+  while ((row=mysql_fetch_row(res))){
+    for (i=0; i < mysql_num_fields(res); i++){
+      if (row[i] != NULL && (!g_ascii_strcasecmp(fields[i].name, "Seconds_Behind_Source") || !g_ascii_strcasecmp(fields[i].name, "Seconds_Behind_Master"))){
+        lag=MAX(lag, g_ascii_strtod(row[i], NULL));
+        *found=TRUE;
+      }
+    }
+  }
+  mysql_free_result(res);
+  return lag;
+}
+
+static gdouble get_server_load(gdouble chunk_time, gchar **worst){
+  gdouble load=0;
+  gboolean found;
+  if (throttle_query != NULL){
+    if (!load_from_query(throttle_query, &load, worst))
+      g_warning("Throttle query failed: %s", mysql_error(throttle_conn));
+  }else{
+    if (g_hash_table_lookup(limits, THREADS_RUNNING) != NULL){
+      gdouble threads_running=get_second_column("SHOW GLOBAL STATUS LIKE 'Threads_running'", &found);
+      if (found)
+        update_load(&load, worst, THREADS_RUNNING, threads_running);
+    }
+    if (g_hash_table_lookup(limits, HISTORY_LIST_LENGTH) != NULL){
+      gdouble history_list_length=get_second_column("SELECT NAME, COUNT FROM information_schema.INNODB_METRICS WHERE NAME='trx_rseg_history_len'", &found);
+      if (found)
+        update_load(&load, worst, HISTORY_LIST_LENGTH, history_list_length);
+    }
+    if (g_hash_table_lookup(limits, REPLICA_LAG) != NULL){
+      gdouble lag=get_replica_lag(&found);
+      if (found)
+        update_load(&load, worst, REPLICA_LAG, lag);
+    }
+  }
+  update_load(&load, worst, CHUNK_TIME, chunk_time);
+  return load;
+}
+
+// Average time of the chunks finished since the previous call, in seconds
+static gdouble get_chunk_time(guint64 *previous_sum, guint64 *previous_count){
+  guint64 sum=0, count=0;
+  guint i;
+  for (i=0; i < throttle_td_count; i++){
+    sum+=throttle_td[i].stats.chunk_latency.sum;
+    count+=throttle_td[i].stats.chunk_latency.count;
+  }
+  gdouble chunk_time=count > *previous_count ? (gdouble)(sum - *previous_sum) / (count - *previous_count) / G_USEC_PER_SEC : 0;
+  *previous_sum=sum;
+  *previous_count=count;
+  return chunk_time;
+}
+
+static void *throttle_thread_function(void *data){
+  (void)data;
+  guint64 previous_sum=0, previous_count=0;
+  gint workers, scale;
+  while (g_atomic_int_get(&throttle_running)){
+    g_usleep(THROTTLE_INTERVAL);
+    gchar *worst=NULL;
+    gdouble load=get_server_load(get_chunk_time(&previous_sum, &previous_count), &worst);
+    workers=g_atomic_int_get(&active_workers);
+    scale=g_atomic_int_get(&chunk_scale);
+    if (load > 1){
+      workers=MAX(workers / 2, 1);
+      scale=MIN(scale * 2, THROTTLE_MAX_CHUNK_SCALE);
+    }else if (load < THROTTLE_RECOVER){
+      workers=MIN(workers + 1, (gint)num_threads);
+      scale=MAX(scale / 2, 1);
+    }
+    if (workers != g_atomic_int_get(&active_workers) || scale != g_atomic_int_get(&chunk_scale)){
+      if (load > 1)
+        g_message("Throttling on %s: %d threads, chunks up to %"G_GUINT64_FORMAT" rows", worst, workers, MAX((guint64)max_rows_per_file / scale, min_rows_per_file));
+      else
+        g_message("Server load is back under the limits: %d threads, chunks up to %"G_GUINT64_FORMAT" rows", workers, MAX((guint64)max_rows_per_file / scale, min_rows_per_file));
+      g_mutex_lock(workers_mutex);
+      g_atomic_int_set(&active_workers, workers);
+      g_cond_broadcast(workers_cond);
+      g_mutex_unlock(workers_mutex);
+      g_atomic_int_set(&chunk_scale, scale);
+    }
+    g_free(worst);
+  }
+  return NULL;
+}
+
+void start_throttle(struct thread_data *td, guint n){
+  if (limits == NULL)
+    return;
+  throttle_td=td;
+  throttle_td_count=n;
+  throttle_conn=mysql_init(NULL);
+  m_connect(throttle_conn, "mydumper", NULL);
+  throttle_running=TRUE;
+  throttle_thread=g_thread_create(throttle_thread_function, NULL, TRUE, NULL);
+}
+
+void stop_throttle(){
+  if (throttle_thread == NULL)
+    return;
+  g_atomic_int_set(&throttle_running, FALSE);
+  g_thread_join(throttle_thread);
+  throttle_thread=NULL;
+  mysql_close(throttle_conn);
+  throttle_conn=NULL;
+}
+
+// Workers over the active count wait here before asking the chunk builder
+// for a chunk and taking a job, so every chunk is dumped by the worker that
+// asked for it. The chunk builder releases them once the queue is shut down,
+// so they can take their shutdown job.
+void wait_throttle_active_worker(struct thread_data *td, GAsyncQueue *queue){
+  if (limits == NULL)
+    return;
+  g_mutex_lock(workers_mutex);
+  while ((gint)td->thread_id > g_atomic_int_get(&active_workers) && released_queue != queue)
+    g_cond_wait(workers_cond, workers_mutex);
+  g_mutex_unlock(workers_mutex);
+}
+
+void release_throttle_workers(GAsyncQueue *queue){
+  if (limits == NULL)
+    return;
+  g_mutex_lock(workers_mutex);
+  released_queue=queue;
+  g_cond_broadcast(workers_cond);
+  g_mutex_unlock(workers_mutex);
+}
+
+guint64 get_throttle_max_rows_per_file(){
+  return MAX((guint64)max_rows_per_file / g_atomic_int_get(&chunk_scale), min_rows_per_file);
+}
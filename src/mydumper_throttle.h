@@ -0,0 +1,38 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+#ifndef _src_mydumper_throttle_h
+#define _src_mydumper_throttle_h
+
+// Server health is sampled every THROTTLE_INTERVAL microseconds. Over any
+// limit, the workers and the chunk size are halved; under THROTTLE_RECOVER of
+// every limit, one worker is added back and the chunk size doubled.
+#define THROTTLE_INTERVAL 2000000
+#define THROTTLE_RECOVER 0.8
+#define THROTTLE_MAX_CHUNK_SCALE 64
+
+struct thread_data;
+
+extern gchar *throttle_limits;
+extern gchar *throttle_query;
+
+void initialize_throttle();
+void start_throttle(struct thread_data *td, guint n);
+void stop_throttle();
+void wait_throttle_active_worker(struct thread_data *td, GAsyncQueue *queue);
+void release_throttle_workers(GAsyncQueue *queue);
+guint64 get_throttle_max_rows_per_file();
+#endif
@@ -71,6 +71,10 @@
 #include "mydumper_jobs.h"
 #include "mydumper_chunks.h"
 #include "mydumper_write.h"
+#include "mydumper_throttle.h"
+#include "uring_writer.h"
+#include "mydumper_columnar.h"
+#include "mydumper_dictionary.h"
 #include "mydumper_global.h"
 
 /* Some earlier versions of MySQL do not yet define MYSQL_TYPE_JSON */
@@ -100,8 +104,10 @@ gboolean success_on_1146 = FALSE;
 
 GList  *innodb_table = NULL;
 GMutex *innodb_table_mutex = NULL;
+gboolean innodb_table_unsorted = FALSE;
 GList  *non_innodb_table = NULL;
 GMutex *non_innodb_table_mutex = NULL;
+gboolean non_innodb_table_unsorted = FALSE;
 GMutex *table_schemas_mutex = NULL;
 GMutex *all_dbts_mutex=NULL;
 GMutex *trigger_schemas_mutex = NULL;
@@ -190,6 +196,7 @@ void initialize_working_thread(){
   initialize_jobs();
   initialize_chunk();
   initialize_write();
+  initialize_throttle();
 
 
   /* savepoints workaround to avoid metadata locking issues
@@ -203,10 +210,23 @@ void initialize_working_thread(){
   if (ignore_engines)
     ignore = g_strsplit(ignore_engines, ",", 0);
 
+  if (use_io_uring && (compress_output || exec_per_thread != NULL)){
+    g_warning("--io-uring is not used with --compress or --exec-per-thread");
+    use_io_uring=FALSE;
+  }
+  if (use_io_uring && !initialize_uring_writer())
+    use_io_uring=FALSE;
+
   if (!compress_output) {
-    m_open=&g_fopen;
-    m_close=(void *) &fclose;
-    m_write=(void *)&write_file;
+    if (use_io_uring){
+      m_open=&uring_open;
+      m_close=&uring_close;
+      m_write=&uring_write;
+    }else{
+      m_open=&g_fopen;
+      m_close=(void *) &fclose;
+      m_write=(void *)&write_file;
+    }
     compress_extension=g_strdup("");
   } else {
     m_open=(void *) &gzopen;
@@ -218,6 +238,7 @@ void initialize_working_thread(){
     compress_extension = g_strdup(".gz");
 #endif
   }
+  initialize_dictionary();
   if (dump_checksums){
     data_checksums = TRUE;
     schema_checksums = TRUE;
@@ -228,6 +249,9 @@ void initialize_working_thread(){
 
 
 void finalize_working_thread(){
+  if (use_io_uring)
+    stop_uring_writer();
+  finalize_dictionary();
   g_hash_table_destroy(character_set_hash);
   g_mutex_free(character_set_hash_mutex);
   g_mutex_free(innodb_table_mutex);
@@ -250,7 +274,7 @@ void finalize_working_thread(){
 void free_table_job(struct table_job *tj){
   g_message("free_table_job");
   if (tj->where)
-    g_free(tj->where);
+    g_string_free(tj->where, TRUE);
   if (tj->order_by)
     g_free(tj->order_by);
   if (tj->chunk_step){
@@ -460,12 +484,13 @@ void thd_JOB_DUMP(struct thread_data *td, struct job *job){
       break;
   }
   if (tj->sql_file){
-    m_close(tj->sql_file);
-    tj->sql_file=NULL;
+    close_table_job_file(tj, &(tj->sql_file), tj->sql_filename);
   }
   if (tj->dat_file){
-    m_close(tj->dat_file);
-    tj->dat_file=NULL;
+    close_table_job_file(tj, &(tj->dat_file), tj->dat_filename);
+  }
+  if (tj->columnar){
+    close_columnar_file(tj);
   }
   if (tj->filesize == 0 && !build_empty_files) {
     // dropping the useless file
@@ -850,8 +875,10 @@ void process_queue(GAsyncQueue * queue, struct thread_data *td, gboolean (*p)(),
   struct job *job = NULL;
   for (;;) {
     check_pause_resume(td);
-    if (f!=NULL)
+    if (f!=NULL){
+      wait_throttle_active_worker(td, queue);
       f();
+    }
     job = (struct job *)g_async_queue_pop(queue);
     if (shutdown_triggered && (job->type != JOB_SHUTDOWN)) {
       continue;
@@ -881,28 +908,44 @@ void build_lock_tables_statement(struct configuration *conf){
   g_mutex_unlock(non_innodb_table_mutex);
 }
 
+// The where is rebuilt for every sub chunk, so the same GString is reused
+static GString *get_where_on_table_job(struct table_job *tj){
+  if (tj->where == NULL)
+    tj->where=g_string_sized_new(128);
+  return tj->where;
+}
+
+static void update_integer_where_on_table_job(struct table_job *tj, union chunk_step *cs){
+  if (cs->integer_step.nmin == cs->integer_step.nmax)
+    g_string_printf(get_where_on_table_job(tj), "(%s ( `%s` = %"G_GUINT64_FORMAT"))",
+                      cs->integer_step.prefix?cs->integer_step.prefix:"",
+                      cs->integer_step.field, cs->integer_step.cursor);
+  else
+    g_string_printf(get_where_on_table_job(tj), "( %s ( %"G_GUINT64_FORMAT" < `%s` AND `%s` <= %"G_GUINT64_FORMAT"))",
+                      cs->integer_step.prefix?cs->integer_step.prefix:"",
+                      cs->integer_step.nmin, cs->integer_step.field,
+                      cs->integer_step.field, cs->integer_step.cursor);
+}
+
 void update_where_on_table_job(struct thread_data *td, struct table_job *tj){
   switch (tj->dbt->chunk_type){
     case INTEGER:
-      tj->where=tj->chunk_step->integer_step.nmin == tj->chunk_step->integer_step.nmax ?
-                g_strdup_printf("(%s ( `%s` = %"G_GUINT64_FORMAT"))",
-                          tj->chunk_step->integer_step.prefix?tj->chunk_step->integer_step.prefix:"",
-                          tj->chunk_step->integer_step.field, tj->chunk_step->integer_step.cursor):
-                g_strdup_printf("( %s ( %"G_GUINT64_FORMAT" < `%s` AND `%s` <= %"G_GUINT64_FORMAT"))",
-                          tj->chunk_step->integer_step.prefix?tj->chunk_step->integer_step.prefix:"",
-                          tj->chunk_step->integer_step.nmin, tj->chunk_step->integer_step.field,
-                          tj->chunk_step->integer_step.field, tj->chunk_step->integer_step.cursor);
+      update_integer_where_on_table_job(tj, tj->chunk_step);
+    break;
+  case PARTITION:
+    if (tj->chunk_step->partition_step.sub_step != NULL)
+      update_integer_where_on_table_job(tj, tj->chunk_step->partition_step.sub_step);
     break;
   case CHAR:
     if (td != NULL){
       if (tj->chunk_step->char_step.cmax == NULL){
-        tj->where=g_strdup_printf("(%s(`%s` >= '%s'))",
+        g_string_printf(get_where_on_table_job(tj), "(%s(`%s` >= '%s'))",
                           tj->chunk_step->char_step.prefix?tj->chunk_step->char_step.prefix:"",
                           tj->chunk_step->char_step.field, tj->chunk_step->char_step.cmin_escaped
                           );
       }else{
         update_cursor(td->thrconn,tj);
-        tj->where=g_strdup_printf("(%s('%s' < `%s` AND `%s` <= '%s'))",
+        g_string_printf(get_where_on_table_job(tj), "(%s('%s' < `%s` AND `%s` <= '%s'))",
                           tj->chunk_step->char_step.prefix?tj->chunk_step->char_step.prefix:"",
                           tj->chunk_step->char_step.cmin_escaped, tj->chunk_step->char_step.field,
                           tj->chunk_step->char_step.field, tj->chunk_step->char_step.cursor_escaped
@@ -916,21 +959,23 @@ void update_where_on_table_job(struct thread_data *td, struct table_job *tj){
 }
 
 void process_integer_chunk_job(struct thread_data *td, struct table_job *tj){
-  g_mutex_lock(tj->chunk_step->integer_step.mutex);
-  if (tj->chunk_step->integer_step.check_max){
+  union chunk_step *cs = get_integer_step(tj);
+  g_mutex_lock(cs->integer_step.mutex);
+  if (cs->integer_step.check_max){
 //    g_message("thread: %d Updating MAX", td->thread_id);
     update_integer_max(td->thrconn, tj);
-    tj->chunk_step->integer_step.check_max=FALSE;
+    cs->integer_step.check_max=FALSE;
   }
-  if (tj->chunk_step->integer_step.check_min){
+  if (cs->integer_step.check_min){
 //    g_message("thread: %d Updating MIN", td->thread_id);
     update_integer_min(td->thrconn, tj);
-    tj->chunk_step->integer_step.check_min=FALSE;
+    cs->integer_step.check_min=FALSE;
   }
-  tj->chunk_step->integer_step.cursor = tj->chunk_step->integer_step.nmin + tj->chunk_step->integer_step.step > tj->chunk_step->integer_step.nmax ? tj->chunk_step->integer_step.nmax : tj->chunk_step->integer_step.nmin + tj->chunk_step->integer_step.step;
-  tj->chunk_step->integer_step.estimated_remaining_steps=1+(tj->chunk_step->integer_step.nmax - tj->chunk_step->integer_step.cursor) / tj->chunk_step->integer_step.step;
-  g_mutex_unlock(tj->chunk_step->integer_step.mutex);
-/*  if (tj->chunk_step->integer_step.nmin == tj->chunk_step->integer_step.nmax){
+  cs->integer_step.cursor = cs->integer_step.nmin + cs->integer_step.step > cs->integer_step.nmax ? cs->integer_step.nmax : cs->integer_step.nmin + cs->integer_step.step;
+  cs->integer_step.estimated_remaining_steps=1+(cs->integer_step.nmax - cs->integer_step.cursor) / cs->integer_step.step;
+  td->stats.chunk_step=cs->integer_step.step;
+  g_mutex_unlock(cs->integer_step.mutex);
+/*  if (cs->integer_step.nmin == cs->integer_step.nmax){
     return;
   }*/
 //  g_message("CONTINUE");
@@ -944,18 +989,21 @@ void process_integer_chunk_job(struct thread_data *td, struct table_job *tj){
   GTimeSpan diff=g_date_time_difference(to,from)/G_TIME_SPAN_SECOND;
 
   if (diff > 2){
-    tj->chunk_step->integer_step.step=tj->chunk_step->integer_step.step  / 2;
-    tj->chunk_step->integer_step.step=tj->chunk_step->integer_step.step<min_rows_per_file?max_rows_per_file:tj->chunk_step->integer_step.step;
-//    g_message("Decreasing time: %ld | %ld", diff, tj->chunk_step->integer_step.step);
+    cs->integer_step.step=cs->integer_step.step  / 2;
+    cs->integer_step.step=cs->integer_step.step<min_rows_per_file?max_rows_per_file:cs->integer_step.step;
+//    g_message("Decreasing time: %ld | %ld", diff, cs->integer_step.step);
   }else if (diff < 1){
-    tj->chunk_step->integer_step.step=tj->chunk_step->integer_step.step  * 2;
-    tj->chunk_step->integer_step.step=tj->chunk_step->integer_step.step>max_rows_per_file?max_rows_per_file:tj->chunk_step->integer_step.step;
-//    g_message("Increasing time: %ld | %ld", diff, tj->chunk_step->integer_step.step);
+    cs->integer_step.step=cs->integer_step.step  * 2;
+    cs->integer_step.step=cs->integer_step.step>max_rows_per_file?max_rows_per_file:cs->integer_step.step;
+//    g_message("Increasing time: %ld | %ld", diff, cs->integer_step.step);
   }
+  guint64 throttle_max_rows_per_file=get_throttle_max_rows_per_file();
+  if (cs->integer_step.step > throttle_max_rows_per_file)
+    cs->integer_step.step=throttle_max_rows_per_file;
 
-  g_mutex_lock(tj->chunk_step->integer_step.mutex);
-  tj->chunk_step->integer_step.nmin=tj->chunk_step->integer_step.cursor;
-  g_mutex_unlock(tj->chunk_step->integer_step.mutex);
+  g_mutex_lock(cs->integer_step.mutex);
+  cs->integer_step.nmin=cs->integer_step.cursor;
+  g_mutex_unlock(cs->integer_step.mutex);
 }
 
 void process_integer_chunk(struct thread_data *td, struct table_job *tj){
@@ -987,6 +1035,7 @@ void process_integer_chunk(struct thread_data *td, struct table_job *tj){
 void process_char_chunk_job(struct thread_data *td, struct table_job *tj){
   g_mutex_lock(tj->chunk_step->char_step.mutex);
   update_where_on_table_job(td, tj);
+  td->stats.chunk_step=tj->chunk_step->char_step.step;
   g_mutex_unlock(tj->chunk_step->char_step.mutex);
 
 //  message_dumping_data(td,tj);
@@ -1061,19 +1110,56 @@ void process_char_chunk(struct thread_data *td, struct table_job *tj){
 }
 
 void process_partition_chunk(struct thread_data *td, struct table_job *tj){
-  union chunk_step *cs = tj->chunk_step;
+  union chunk_step *cs = tj->chunk_step, *sub=NULL;
   gchar *partition=NULL;
-  while (cs->partition_step.list != NULL){
+  for(;;){
     g_mutex_lock(cs->partition_step.mutex);
-    partition=g_strdup_printf(" PARTITION (%s) ",(char*)(cs->partition_step.list->data));
-    g_message("Partition text: %s", partition);
-    cs->partition_step.list= cs->partition_step.list->next;
+    sub=cs->partition_step.sub_step;
+    if (sub == NULL){
+      if (cs->partition_step.list == NULL){
+        g_mutex_unlock(cs->partition_step.mutex);
+        break;
+      }
+      g_free(cs->partition_step.current_partition);
+      cs->partition_step.current_partition=g_strdup(cs->partition_step.list->data);
+      cs->partition_step.list= cs->partition_step.list->next;
+    }
+    // A step split from another one starts with its range already set
+    partition=g_strdup(cs->partition_step.current_partition);
     g_mutex_unlock(cs->partition_step.mutex);
-    tj->partition = partition;
-// = new_table_job(dbt, partition ,  cs->partition_step.number, dbt->primary_key, cs);
-//    message_dumping_data(td,tj);
-    write_table_job_into_file(td->thrconn, tj);
+    tj->partition=g_strdup_printf(" PARTITION (%s) ", partition);
+    g_message("Partition text: %s", tj->partition);
+    if (sub == NULL){
+      sub=new_partition_integer_step(td->thrconn, tj->dbt, partition);
+      g_mutex_lock(cs->partition_step.mutex);
+      cs->partition_step.sub_step=sub;
+      g_mutex_unlock(cs->partition_step.mutex);
+    }
     g_free(partition);
+    if (sub == NULL){
+      if (tj->where){
+        g_string_free(tj->where, TRUE);
+        tj->where=NULL;
+      }
+      write_table_job_into_file(td->thrconn, tj);
+    }else{
+      process_integer_chunk_job(td,tj);
+      if (sub->integer_step.prefix)
+        g_free(sub->integer_step.prefix);
+      sub->integer_step.prefix=NULL;
+      while (sub->integer_step.nmin < sub->integer_step.nmax)
+        process_integer_chunk_job(td,tj);
+      g_mutex_lock(cs->partition_step.mutex);
+      cs->partition_step.sub_step=NULL;
+      g_mutex_unlock(cs->partition_step.mutex);
+      free_integer_step(sub);
+    }
+    g_free(tj->partition);
+    tj->partition=NULL;
+  }
+  if (tj->where){
+    g_string_free(tj->where, TRUE);
+    tj->where=NULL;
   }
 }
 
@@ -1085,6 +1171,11 @@ void *working_thread(struct thread_data *td) {
 
   initialize_thread(td);
   execute_gstring(td->thrconn, set_session);
+  td->query=g_string_sized_new(1024);
+  td->statement=g_string_sized_new(2*statement_size);
+  td->statement_row=g_string_sized_new(0);
+  td->escaped=g_string_sized_new(3000);
+  initialize_adaptive_compression(&(td->adaptive));
 
   // Initialize connection 
   if (!skip_tz && mysql_query(td->thrconn, "/*!40103 SET TIME_ZONE='+00:00' */")) {
@@ -1119,9 +1210,12 @@ void *working_thread(struct thread_data *td) {
     g_async_queue_pop(td->conf->ready_non_innodb_queue);
     if (less_locking){
       // Sending LOCK TABLE over all non-innodb tables
+      gint64 lock_start=g_get_monotonic_time();
       if (mysql_query(td->thrconn, td->conf->lock_tables_statement->str)) {
         m_error("Error locking non-innodb tables %s", mysql_error(td->thrconn));
       }
+      td->stats.lock_wait_time+=g_get_monotonic_time()-lock_start;
+      trace_span(td->trace, "lock", NULL, NULL, -1, lock_start);
       // This push will unlock the FTWRL on the Main Connection
       g_async_queue_push(td->conf->unlock_tables, GINT_TO_POINTER(1));
       process_queue(td->conf->non_innodb_queue, td, process_job, give_me_another_non_innodb_chunk_step);
@@ -1146,6 +1240,10 @@ void *working_thread(struct thread_data *td) {
 
   if (td->binlog_snapshot_gtid_executed!=NULL)
     g_free(td->binlog_snapshot_gtid_executed);
+  g_string_free(td->query, TRUE);
+  g_string_free(td->statement, TRUE);
+  g_string_free(td->statement_row, TRUE);
+  g_string_free(td->escaped, TRUE);
 
   if (td->thrconn)
     mysql_close(td->thrconn);
@@ -1309,6 +1407,13 @@ struct db_table *new_db_table( MYSQL *conn, struct configuration *conf, struct d
   dbt->schema_checksum=NULL;
   dbt->triggers_checksum=NULL;
   dbt->rows=0;
+  dbt->bytes=0;
+  dbt->dictionary=NULL;
+  if (compress_dictionary){
+    gchar *filename=g_strdup_printf("%s/%s.%s.%s", dump_directory, dbt->database->filename, dbt->table_filename, DICTIONARY_EXTENSION);
+    dbt->dictionary=new_compression_dictionary(filename, DICTIONARY_TRAINING_SIZE);
+    g_free(filename);
+  }
   if (!datalength)
     dbt->datalength = 0;
   else
@@ -1319,6 +1424,8 @@ struct db_table *new_db_table( MYSQL *conn, struct configuration *conf, struct d
 void free_db_table(struct db_table * dbt){
   g_free(dbt->table);
   g_mutex_free(dbt->rows_lock);
+  free_columnar_schema(dbt);
+  if (dbt->dictionary) free_compression_dictionary(dbt->dictionary);
   g_free(dbt->escaped_table);
   g_string_free(dbt->select_fields, TRUE);
   if (dbt->min!=NULL) g_free(dbt->min);
@@ -1366,12 +1473,14 @@ void new_table_to_dump(MYSQL *conn, struct configuration *conf, gboolean is_view
           dbt->is_innodb=TRUE;
           g_mutex_lock(innodb_table_mutex);
           innodb_table=g_list_prepend(innodb_table,dbt);
+          innodb_table_unsorted=TRUE;
           g_mutex_unlock(innodb_table_mutex);
 
         } else {
           dbt->is_innodb=FALSE;
           g_mutex_lock(non_innodb_table_mutex);
           non_innodb_table = g_list_prepend(non_innodb_table, dbt);
+          non_innodb_table_unsorted=TRUE;
           g_mutex_unlock(non_innodb_table_mutex);
         }
       }else{
@@ -1379,6 +1488,7 @@ void new_table_to_dump(MYSQL *conn, struct configuration *conf, gboolean is_view
           dbt->is_innodb=FALSE;
           g_mutex_lock(non_innodb_table_mutex);
           non_innodb_table = g_list_prepend(non_innodb_table, dbt);
+          non_innodb_table_unsorted=TRUE;
           g_mutex_unlock(non_innodb_table_mutex);
         }
       }
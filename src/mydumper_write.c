@@ -40,22 +40,43 @@
 #include "mydumper_working_thread.h"
 #include "mydumper_write.h"
 #include <math.h>
+#include <time.h>
 //#include "common_options.h"
 #include "mydumper_masquerade.h"
+#include "mydumper_columnar.h"
 #ifdef ZWRAP_USE_ZSTD
 #include "../zstd/zstd_zlibwrapper.h"
 #else
 #include <zlib.h>
 #endif
 
+#include "mydumper_dictionary.h"
+#include "mydumper_disk_governor.h"
+#include "mydumper_stripe.h"
 #include "mydumper_global.h"
 
+// Levels of --compress-adaptive. The files keep the compression extension,
+// so the lowest level still compresses for zstd, gzip and any other tool to
+// read them.
+#define ADAPTIVE_MIN_LEVEL 1
+#ifdef ZWRAP_USE_ZSTD
+#define ADAPTIVE_INITIAL_LEVEL 3
+#else
+#define ADAPTIVE_INITIAL_LEVEL 6
+#endif
+#define ADAPTIVE_MAX_LEVEL 9
+// Time measured since the last decision needed to take a new one, in microseconds
+#define ADAPTIVE_MIN_SAMPLE_TIME 200000
+
 const gchar *insert_statement=INSERT;
 guint statement_size = 1000000;
 guint complete_insert = 0;
 guint chunk_filesize = 0;
 gboolean load_data = FALSE;
+gboolean compress_adaptive = FALSE;
 gboolean csv = FALSE;
+gchar *output_format=NULL;
+gboolean binary_format = FALSE;
 gchar *fields_enclosed_by=NULL;
 gchar *fields_escaped_by=NULL;
 gchar *fields_terminated_by=NULL;
@@ -131,6 +152,9 @@ void load_write_entries(GOptionGroup *main_group, GOptionContext *context){
 
 void initialize_write(){
 
+  if (compress_adaptive && !compress_output)
+    m_critical("--compress-adaptive needs --compress");
+
   // rows chunks have precedence over chunk_filesize
   if (rows_per_file > 0 && chunk_filesize > 0) {
 //    chunk_filesize = 0;
@@ -138,6 +162,23 @@ void initialize_write(){
     g_warning("We are going to chunk by row and by filesize");
   }
 
+  if (output_format){
+    if (!g_ascii_strcasecmp(output_format, "binary")){
+      // myloader transcodes the rows into the default LOAD DATA format
+      if (csv || fields_terminated_by_ld || fields_enclosed_by_ld || fields_escaped_by || lines_starting_by_ld || lines_terminated_by_ld)
+        m_critical("--format=binary can not be used with --csv, --fields-* or --lines-* options");
+      binary_format=TRUE;
+      load_data=TRUE;
+    }else if (!g_ascii_strcasecmp(output_format, "parquet")){
+      columnar_format=COLUMNAR_PARQUET;
+      initialize_columnar();
+    }else if (!g_ascii_strcasecmp(output_format, "arrow")){
+      columnar_format=COLUMNAR_ARROW;
+      initialize_columnar();
+    }else if (g_ascii_strcasecmp(output_format, "sql"))
+      m_critical("Unknown --format %s, valid values are sql, binary, parquet and arrow", output_format);
+  }
+
   fields_enclosed_by=g_strdup("\"");
   if (csv){
     load_data=TRUE;
@@ -312,6 +353,83 @@ gboolean write_data(FILE *file, GString *data) {
   return real_write_data(file, &f, data);
 }
 
+// Compression happens inside m_write, so the CPU time of the thread while
+// writing is the compression cost and the rest of the wall time is the wait
+// on the disk.
+static inline gint64 get_thread_cpu_time(){
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return (gint64)ts.tv_sec * G_USEC_PER_SEC + ts.tv_nsec / 1000;
+}
+
+gboolean write_table_job_data(struct table_job *tj, FILE *file, GString *data){
+  trace_span_from_mark(tj->td->trace, "fetch_encode", tj->dbt->database->name, tj->dbt->table, tj->nchunk);
+  gint64 start=g_get_monotonic_time();
+  disk_governor_write(data->len);
+  gint64 cpu_start=compress_adaptive?get_thread_cpu_time():0;
+  gboolean r=real_write_data(file, &(tj->filesize), data);
+  if (compress_adaptive)
+    tj->td->stats.write_cpu_time+=get_thread_cpu_time()-cpu_start;
+  add_dictionary_sample(tj->dbt->dictionary, data->str, data->len);
+  tj->td->stats.write_time+=g_get_monotonic_time()-start;
+  tj->td->stats.bytes+=data->len;
+  trace_span(tj->td->trace, "write", tj->dbt->database->name, tj->dbt->table, tj->nchunk, start);
+  trace_mark(tj->td->trace);
+  return r;
+}
+
+void initialize_adaptive_compression(struct adaptive_compression *ac){
+  ac->level=ADAPTIVE_INITIAL_LEVEL;
+}
+
+// With --compress-adaptive the level of each data file is decided from where
+// the thread spent its time since the previous one. Waiting on the server or
+// on the disk means that there is CPU to spare, so the level goes up to write
+// fewer bytes. When compressing takes longer than both, the level goes down,
+// to the fastest one at ADAPTIVE_MIN_LEVEL.
+FILE *open_data_file(struct thread_data *td, const gchar *filename){
+  if (!compress_adaptive)
+    return m_open(filename,"w");
+  struct adaptive_compression *ac=&(td->adaptive);
+  gint64 fetch=td->stats.fetch_time - ac->fetch_time;
+  gint64 compress=td->stats.write_cpu_time - ac->write_cpu_time;
+  gint64 io_wait=td->stats.write_time - ac->write_time - compress;
+  if (io_wait < 0)
+    io_wait=0;
+  if (fetch + compress + io_wait >= ADAPTIVE_MIN_SAMPLE_TIME){
+    gint level=ac->level;
+    if (compress > fetch + io_wait)
+      level=MAX(level - 1, ADAPTIVE_MIN_LEVEL);
+    else if (compress * 2 < fetch + io_wait)
+      level=MIN(level + 1, ADAPTIVE_MAX_LEVEL);
+    if (level != ac->level){
+      g_debug("Thread %d: compression level %d (fetch %"G_GINT64_FORMAT"us compress %"G_GINT64_FORMAT"us write %"G_GINT64_FORMAT"us)", td->thread_id, level, fetch, compress, io_wait);
+      ac->level=level;
+    }
+    ac->fetch_time=td->stats.fetch_time;
+    ac->write_time=td->stats.write_time;
+    ac->write_cpu_time=td->stats.write_cpu_time;
+  }
+  gchar mode[4];
+  g_snprintf(mode, sizeof(mode), "w%d", ac->level);
+  return m_open(filename, mode);
+}
+
+void close_table_job_file(struct table_job *tj, FILE **file, const gchar *filename){
+  GStatBuf st;
+  gint64 start=trace_time(tj->td->trace);
+  m_close(*file);
+  *file=NULL;
+  tj->td->stats.files_in_flight--;
+  // The size on disk is the only way to know how much the compression saved
+  if (pmm && filename != NULL && g_stat(filename, &st) == 0)
+    tj->td->stats.compressed_bytes+=st.st_size;
+  if (filename != NULL)
+    close_stripe_file(filename);
+  trace_span(tj->td->trace, "rotate", tj->dbt->database->name, tj->dbt->table, tj->nchunk, start);
+  trace_mark(tj->td->trace);
+}
+
 
 void initialize_load_data_statement(GString *statement, gchar * table, const gchar *character_set, gchar *basename, MYSQL_FIELD * fields, guint num_fields){
   g_string_append_printf(statement, "LOAD DATA LOCAL INFILE '%s' REPLACE INTO TABLE `%s` ", basename, table);
@@ -336,9 +454,9 @@ void initialize_load_data_statement(GString *statement, gchar * table, const gch
   g_string_append(statement,";\n");
 }
 
-gboolean write_statement(FILE *load_data_file, float *filessize, GString *statement, struct db_table * dbt){
-  if (!real_write_data(load_data_file, filessize, statement)) {
-    g_critical("Could not write out data for %s.%s", dbt->database->name, dbt->table);
+gboolean write_statement(struct table_job *tj, FILE *file, GString *statement){
+  if (!write_table_job_data(tj, file, statement)) {
+    g_critical("Could not write out data for %s.%s", tj->dbt->database->name, tj->dbt->table);
     return FALSE;
   }
   g_string_set_size(statement, 0);
@@ -387,7 +505,7 @@ void message_dumping_data(struct thread_data *td, struct table_job *tj){
   g_message("Thread %d: dumping data for `%s`.`%s` %s %s %s %s %s %s %s %s %s into %s| Remaining jobs in this table: %"G_GINT64_FORMAT,
                     td->thread_id,
                     tj->dbt->database->name, tj->dbt->table, tj->partition?tj->partition:"",
-                     (tj->where || where_option   || tj->dbt->where) ? "WHERE" : "" ,      tj->where ?      tj->where : "",
+                     (tj->where || where_option   || tj->dbt->where) ? "WHERE" : "" ,      tj->where ?      tj->where->str : "",
                      (tj->where && where_option )                    ? "AND"   : "" ,   where_option ?   where_option : "",
                     ((tj->where || where_option ) && tj->dbt->where) ? "AND"   : "" , tj->dbt->where ? tj->dbt->where : "",
                     tj->order_by ? "ORDER BY" : "", tj->order_by ? tj->order_by : "",
@@ -395,43 +513,43 @@ void message_dumping_data(struct thread_data *td, struct table_job *tj){
 //                    g_async_queue_length(td->conf->innodb_queue) + g_async_queue_length(td->conf->non_innodb_queue) + g_async_queue_length(td->conf->schema_queue));
 }
 
-void write_load_data_column_into_string( MYSQL *conn, gchar **column, MYSQL_FIELD field, gulong length,GString *escaped, GString *statement_row, struct function_pointer *fun_ptr_i){
+void write_load_data_column_into_string( MYSQL *conn, gchar *column, MYSQL_FIELD field, gulong length,GString *escaped, GString *statement_row){
 //  if (load_data){
-    if (!*column) {
+    if (!column) {
       g_string_append(statement_row, "\\N");
     }else if (field.type != MYSQL_TYPE_LONG && field.type != MYSQL_TYPE_LONGLONG  && field.type != MYSQL_TYPE_INT24  && field.type != MYSQL_TYPE_SHORT ){
       g_string_append(statement_row,fields_enclosed_by);
       g_string_set_size(escaped, length * 2 + 1);
 //      unsigned long new_length = 
-      mysql_real_escape_string(conn, escaped->str, fun_ptr_i->function(column,fun_ptr_i->memory), length);
+      mysql_real_escape_string(conn, escaped->str, column, length);
 //      g_string_set_size(escaped, new_length);
       m_replace_char_with_char('\\',*fields_escaped_by,escaped->str,escaped->len);
       m_escape_char_with_char(*fields_terminated_by, *fields_escaped_by, escaped->str,escaped->len);
       g_string_append(statement_row,escaped->str);
       g_string_append(statement_row,fields_enclosed_by);
     }else
-      g_string_append(statement_row, fun_ptr_i->function(column,fun_ptr_i->memory));
+      g_string_append(statement_row, column);
 }
 
-void write_sql_column_into_string( MYSQL *conn, gchar **column, MYSQL_FIELD field, gulong length,GString *escaped, GString *statement_row, struct function_pointer *fun_ptr_i){
+void write_sql_column_into_string( MYSQL *conn, gchar *column, MYSQL_FIELD field, gulong length,GString *escaped, GString *statement_row){
     /* Don't escape safe formats, saves some time */
-    if (!*column) {
+    if (!column) {
       g_string_append(statement_row, "NULL");
     } else if (field.flags & NUM_FLAG) {
-      g_string_append(statement_row, fun_ptr_i->function(column,fun_ptr_i->memory));
+      g_string_append(statement_row, column);
     } else if ( length == 0){
       g_string_append_c(statement_row,*fields_enclosed_by);
       g_string_append_c(statement_row,*fields_enclosed_by);
     } else if ( field.type == MYSQL_TYPE_BLOB ) {
       g_string_set_size(escaped, length * 2 + 1);
       g_string_append(statement_row,"0x");
-      mysql_hex_string(escaped->str,fun_ptr_i->function(column,fun_ptr_i->memory),length);
+      mysql_hex_string(escaped->str,column,length);
       g_string_append(statement_row,escaped->str);
     } else {
       /* We reuse buffers for string escaping, growing is expensive just at
  *        * the beginning */
       g_string_set_size(escaped, length * 2 + 1);
-      mysql_real_escape_string(conn, escaped->str, fun_ptr_i->function(column,fun_ptr_i->memory), length);
+      mysql_real_escape_string(conn, escaped->str, column, length);
       if (field.type == MYSQL_TYPE_JSON)
         g_string_append(statement_row, "CONVERT(");
       g_string_append_c(statement_row, *fields_enclosed_by);
@@ -442,34 +560,66 @@ void write_sql_column_into_string( MYSQL *conn, gchar **column, MYSQL_FIELD fiel
     }
 }
 
-void write_row_into_string(MYSQL *conn, struct db_table * dbt, MYSQL_ROW row, MYSQL_FIELD *fields, gulong *lengths, guint num_fields, GString *escaped, GString *statement_row, void write_column_into_string(MYSQL *, gchar **, MYSQL_FIELD , gulong ,GString *, GString *, struct function_pointer * )){
+// The row comes already masked from the mask_reader
+void write_row_into_string(MYSQL *conn, MYSQL_ROW row, MYSQL_FIELD *fields, gulong *lengths, guint num_fields, GString *escaped, GString *statement_row, void write_column_into_string(MYSQL *, gchar *, MYSQL_FIELD , gulong ,GString *, GString *)){
   guint i = 0;
   g_string_append(statement_row, lines_starting_by);
-  (void) dbt;
-  GList *f = dbt->anonymized_function;
-  struct function_pointer *fun_ptr_i=&pp;
   for (i = 0; i < num_fields-1; i++) {
-    if (f){
-      fun_ptr_i=f->data;
-      f=f->next;
-    }
-    write_column_into_string( conn, &(row[i]), fields[i], lengths[i], escaped, statement_row, fun_ptr_i);
+    write_column_into_string( conn, row[i], fields[i], lengths[i], escaped, statement_row);
     g_string_append(statement_row, fields_terminated_by);
   }
-  write_column_into_string( conn, &(row[i]), fields[i], lengths[i], escaped, statement_row, fun_ptr_i);
+  write_column_into_string( conn, row[i], fields[i], lengths[i], escaped, statement_row);
   g_string_append(statement_row, lines_terminated_by);
 }
 
-guint64 write_row_into_file_in_load_data_mode(MYSQL *conn, MYSQL_RES *result, struct table_job * tj){
+gboolean write_binary_header(FILE *file){
+  GString *header=g_string_new_len(BINARY_FORMAT_MAGIC, BINARY_FORMAT_MAGIC_LENGTH);
+  gboolean r=write_data(file, header);
+  g_string_free(header, TRUE);
+  return r;
+}
+
+// Values are copied as they come from the row buffer, no escaping is needed
+// as every value is length-prefixed
+void write_binary_row_into_string(MYSQL_ROW row, MYSQL_FIELD *fields, gulong *lengths, guint num_fields, GString *statement_row){
+  guint i;
+  guint16 column_count=GUINT16_TO_LE(num_fields);
+  guint32 length;
+  g_string_append_len(statement_row, (gchar *)&column_count, sizeof(column_count));
+  for (i = 0; i < num_fields; i++) {
+    g_string_append_c(statement_row, (gchar)fields[i].type);
+    if (!row[i]){
+      length=GUINT32_TO_LE(BINARY_FORMAT_NULL_LENGTH);
+      g_string_append_len(statement_row, (gchar *)&length, sizeof(length));
+      continue;
+    }
+    length=GUINT32_TO_LE(lengths[i]);
+    g_string_append_len(statement_row, (gchar *)&length, sizeof(length));
+    g_string_append_len(statement_row, row[i], lengths[i]);
+  }
+}
+
+// Timing every row would cost more than what we want to measure, so only
+// 1 out of METRICS_SAMPLE_MASK+1 rows is timed and the result is scaled.
+static inline gboolean is_sampled_row(guint64 num_rows){
+  return (pmm || compress_adaptive) && (num_rows & METRICS_SAMPLE_MASK) == 0;
+}
+
+guint64 write_row_into_file_in_load_data_mode(MYSQL *conn, struct mask_reader *reader, struct table_job * tj){
   struct db_table * dbt = tj->dbt;
 //  guint fn = tj->nchunk;
   guint64 num_rows=0;
-  GString *escaped = g_string_sized_new(3000);
-  guint num_fields = mysql_num_fields(result);
-  MYSQL_FIELD *fields = mysql_fetch_fields(result);
+  GString *escaped = tj->td->escaped;
+  guint num_fields = reader->num_fields;
+  MYSQL_FIELD *fields = reader->fields;
   MYSQL_ROW row;
-  GString *statement_row = g_string_sized_new(0);
-  GString *statement = g_string_sized_new(2*statement_size);
+  GString *statement_row = tj->td->statement_row;
+  GString *statement = tj->td->statement;
+  g_string_set_size(statement_row, 0);
+  g_string_set_size(statement, 0);
+  gint64 sample_time=0;
+  gboolean sampled=FALSE;
+  gulong *lengths = NULL;
 //  guint sections = tj->where==NULL?1:2;
 
 //  if (tj->sql_filename == NULL){
@@ -480,20 +630,20 @@ guint64 write_row_into_file_in_load_data_mode(MYSQL *conn, MYSQL_RES *result, st
 //    write_load_data_statement(tj, fields, num_fields);
 //  }
 
-  while ((row = mysql_fetch_row(result))) {
-    gulong *lengths = mysql_fetch_lengths(result);
+  while ((row = mask_reader_fetch_row(reader, &lengths))) {
     num_rows++;
+    sampled=is_sampled_row(num_rows);
+    if (sampled)
+      tj->td->stats.fetch_time+=(g_get_monotonic_time()-sample_time)*(METRICS_SAMPLE_MASK+1);
     if (chunk_filesize &&
         (guint)ceil((float)tj->filesize / 1024 / 1024) >
             chunk_filesize ) {
-      if (!write_statement(tj->dat_file, &(tj->filesize), statement_row, dbt)) {
+      if (!write_statement(tj, tj->dat_file, statement_row)) {
         return num_rows;
       }
 
-      m_close(tj->sql_file);
-      m_close(tj->dat_file);
-      tj->sql_file=NULL;
-      tj->dat_file=NULL;
+      close_table_job_file(tj, &(tj->sql_file), tj->sql_filename);
+      close_table_job_file(tj, &(tj->dat_file), tj->dat_filename);
 
       if (stream) {
         g_async_queue_push(stream_queue, tj->sql_filename);
@@ -523,19 +673,28 @@ guint64 write_row_into_file_in_load_data_mode(MYSQL *conn, MYSQL_RES *result, st
     }
     g_string_set_size(statement_row, 0);
 
-    write_row_into_string(conn, dbt, row, fields, lengths, num_fields, escaped, statement_row, write_load_data_column_into_string);
+    if (sampled)
+      sample_time=g_get_monotonic_time();
+    if (binary_format)
+      write_binary_row_into_string(row, fields, lengths, num_fields, statement_row);
+    else
+      write_row_into_string(conn, row, fields, lengths, num_fields, escaped, statement_row, write_load_data_column_into_string);
+    if (sampled)
+      tj->td->stats.encode_time+=(g_get_monotonic_time()-sample_time)*(METRICS_SAMPLE_MASK+1);
     tj->filesize+=statement_row->len+1;
-    g_string_append(statement, statement_row->str);
+    g_string_append_len(statement, statement_row->str, statement_row->len);
     /* INSERT statement is closed before over limit but this is load data, so we only need to flush the data to disk*/
     if (statement->len > statement_size) {
-      if (!write_statement(tj->dat_file, &(tj->filesize), statement, dbt)) {
+      if (!write_statement(tj, tj->dat_file, statement)) {
         return num_rows;
       }
 
     }
+    if (is_sampled_row(num_rows+1))
+      sample_time=g_get_monotonic_time();
   }
   if (statement->len > 0){
-    if (!real_write_data(tj->dat_file, &(tj->filesize), statement)) {
+    if (!write_table_job_data(tj, tj->dat_file, statement)) {
       g_critical("Could not write out data for %s.%s", dbt->database->name, dbt->table);
       return num_rows;
     }
@@ -544,7 +703,7 @@ guint64 write_row_into_file_in_load_data_mode(MYSQL *conn, MYSQL_RES *result, st
 }
 
 
-guint64 write_row_into_file_in_sql_mode(MYSQL *conn, MYSQL_RES *result, struct table_job * tj){
+guint64 write_row_into_file_in_sql_mode(MYSQL *conn, struct mask_reader *reader, struct table_job * tj){
   // There are 2 possible options to chunk the files:
   // - no chunk: this means that will be just 1 data file
   // - chunk_filesize: this function will be spliting the per filesize, this means that multiple files will be created
@@ -552,15 +711,19 @@ guint64 write_row_into_file_in_sql_mode(MYSQL *conn, MYSQL_RES *result, struct t
   // It could write multiple INSERT statments in a data file if statement_size is reached
   struct db_table * dbt = tj->dbt;
 //  guint sections = tj->where==NULL?1:2;
-  guint num_fields = mysql_num_fields(result);
-  GString *escaped = g_string_sized_new(3000);
-  MYSQL_FIELD *fields = mysql_fetch_fields(result);
+  guint num_fields = reader->num_fields;
+  GString *escaped = tj->td->escaped;
+  MYSQL_FIELD *fields = reader->fields;
   MYSQL_ROW row;
-  GString *statement = g_string_sized_new(statement_size);
-  GString *statement_row = g_string_sized_new(0);
+  GString *statement = tj->td->statement;
+  GString *statement_row = tj->td->statement_row;
+  g_string_set_size(statement, 0);
+  g_string_set_size(statement_row, 0);
   gulong *lengths = NULL;
   guint64 num_rows = 0;
   guint64 num_rows_st = 0;
+  gint64 sample_time=0;
+  gboolean sampled=FALSE;
 //  guint fn = tj->nchunk;
 //  if (tj->sql_file == NULL)
 //    initialize_sql_fn(tj);
@@ -573,9 +736,11 @@ guint64 write_row_into_file_in_sql_mode(MYSQL *conn, MYSQL_RES *result, struct t
       build_insert_statement(dbt, fields, num_fields);
     g_mutex_unlock(dbt->chunks_mutex);
   }
-  while ((row = mysql_fetch_row(result))) {
-    lengths = mysql_fetch_lengths(result);
+  while ((row = mask_reader_fetch_row(reader, &lengths))) {
     num_rows++;
+    sampled=is_sampled_row(num_rows);
+    if (sampled)
+      tj->td->stats.fetch_time+=(g_get_monotonic_time()-sample_time)*(METRICS_SAMPLE_MASK+1);
 
     if (!statement->len) {
       // if statement->len is 0 we consider that new statement needs to be written
@@ -583,7 +748,7 @@ guint64 write_row_into_file_in_sql_mode(MYSQL *conn, MYSQL_RES *result, struct t
       if (!tj->st_in_file) {
         // File Header
         initialize_sql_statement(statement);
-        if (!real_write_data(tj->sql_file, &(tj->filesize), statement)) {
+        if (!write_table_job_data(tj, tj->sql_file, statement)) {
           g_critical("Could not write out data for %s.%s", dbt->database->name, dbt->table);
           return num_rows;
         }
@@ -599,7 +764,11 @@ guint64 write_row_into_file_in_sql_mode(MYSQL *conn, MYSQL_RES *result, struct t
       num_rows_st++;
     }
 
-    write_row_into_string(conn, dbt, row, fields, lengths, num_fields, escaped, statement_row, write_sql_column_into_string);
+    if (sampled)
+      sample_time=g_get_monotonic_time();
+    write_row_into_string(conn, row, fields, lengths, num_fields, escaped, statement_row, write_sql_column_into_string);
+    if (sampled)
+      tj->td->stats.encode_time+=(g_get_monotonic_time()-sample_time)*(METRICS_SAMPLE_MASK+1);
 
     if (statement->len + statement_row->len + 1 > statement_size) {
       // We need to flush the statement into disk
@@ -611,7 +780,7 @@ guint64 write_row_into_file_in_sql_mode(MYSQL *conn, MYSQL_RES *result, struct t
       }
       g_string_append(statement, statement_terminated_by);
 
-      if (!real_write_data(tj->sql_file, &(tj->filesize), statement)) {
+      if (!write_table_job_data(tj, tj->sql_file, statement)) {
         g_critical("Could not write out data for %s.%s", dbt->database->name, dbt->table);
         return num_rows;
       }
@@ -625,8 +794,7 @@ guint64 write_row_into_file_in_sql_mode(MYSQL *conn, MYSQL_RES *result, struct t
 //        }else{
           tj->sub_part++;
 //        }
-        m_close(tj->sql_file);
-        tj->sql_file=NULL;
+        close_table_job_file(tj, &(tj->sql_file), tj->sql_filename);
         if (stream) {
           g_async_queue_push(stream_queue, g_strdup(tj->sql_filename));
         }
@@ -644,6 +812,8 @@ guint64 write_row_into_file_in_sql_mode(MYSQL *conn, MYSQL_RES *result, struct t
       num_rows_st++;
       g_string_set_size(statement_row, 0);
     }
+    if (is_sampled_row(num_rows+1))
+      sample_time=g_get_monotonic_time();
   }
   if (statement_row->len > 0) {
     /* this last row has not been written out */
@@ -654,7 +824,7 @@ guint64 write_row_into_file_in_sql_mode(MYSQL *conn, MYSQL_RES *result, struct t
 
   if (statement->len > 0) {
     g_string_append(statement, statement_terminated_by);
-    if (!real_write_data(tj->sql_file, &(tj->filesize), statement)) {
+    if (!write_table_job_data(tj, tj->sql_file, statement)) {
       g_critical(
           "Could not write out closing newline for %s.%s, now this is sad!",
           dbt->database->name, dbt->table);
@@ -665,9 +835,6 @@ guint64 write_row_into_file_in_sql_mode(MYSQL *conn, MYSQL_RES *result, struct t
   g_mutex_lock(dbt->rows_lock);
   dbt->rows+=num_rows;
   g_mutex_unlock(dbt->rows_lock);
-  g_string_free(statement, TRUE);
-  g_string_free(escaped, TRUE);
-  g_string_free(statement_row, TRUE);
   return num_rows;
 }
 
@@ -676,40 +843,51 @@ guint64 write_table_data_into_file(MYSQL *conn, struct table_job * tj){
   guint64 num_rows = 0;
 //  guint64 num_rows_st = 0;
   MYSQL_RES *result = NULL;
-  char *query = NULL;
+  struct mask_reader reader;
+  GString *query = tj->td->query;
+  gint64 chunk_start=g_get_monotonic_time(), query_start=0;
+  guint64 bytes=tj->td->stats.bytes;
 
   /* Ghm, not sure if this should be statement_size - but default isn't too big
    * for now */
   /* Poor man's database code */
-  query = g_strdup_printf(
+  g_string_printf(query,
       "SELECT %s %s FROM `%s`.`%s` %s %s %s %s %s %s %s %s %s %s %s",
       (detected_server == SERVER_TYPE_MYSQL || detected_server == SERVER_TYPE_MARIADB) ? "/*!40001 SQL_NO_CACHE */" : "",
       tj->dbt->select_fields->str,
       tj->dbt->database->name, tj->dbt->table, tj->partition?tj->partition:"",
-       (tj->where || where_option   || tj->dbt->where) ? "WHERE"  : "" ,      tj->where ?      tj->where : "",
+       (tj->where || where_option   || tj->dbt->where) ? "WHERE"  : "" ,      tj->where ?      tj->where->str : "",
        (tj->where && where_option )                    ? "AND"    : "" ,   where_option ?   where_option : "",
       ((tj->where || where_option ) && tj->dbt->where) ? "AND"    : "" , tj->dbt->where ? tj->dbt->where : "",
       tj->order_by ? "ORDER BY" : "", tj->order_by   ? tj->order_by   : "",
       tj->dbt->limit ?  "LIMIT" : "", tj->dbt->limit ? tj->dbt->limit : ""
   );
-  if (mysql_query(conn, query) || !(result = mysql_use_result(conn))) {
+  query_start=g_get_monotonic_time();
+  if (mysql_query(conn, query->str) || !(result = mysql_use_result(conn))) {
     // ERROR 1146
     if (success_on_1146 && mysql_errno(conn) == 1146) {
       g_warning("Error dumping table (%s.%s) data: %s\nQuery: %s", tj->dbt->database->name, tj->dbt->table,
-                mysql_error(conn), query);
+                mysql_error(conn), query->str);
     } else {
       g_critical("Error dumping table (%s.%s) data: %s\nQuery: %s ", tj->dbt->database->name, tj->dbt->table,
-                 mysql_error(conn), query);
+                 mysql_error(conn), query->str);
       errors++;
     }
     goto cleanup;
   }
+  histogram_observe(&(tj->td->stats.query_latency), g_get_monotonic_time()-query_start);
+  trace_span(tj->td->trace, "query", tj->dbt->database->name, tj->dbt->table, tj->nchunk, query_start);
+  trace_mark(tj->td->trace);
 
   /* Poor man's data dump code */
-  if (load_data)
-    num_rows = write_row_into_file_in_load_data_mode(conn, result, tj);
+  mask_reader_init(&reader, result, tj->dbt->anonymized_function);
+  if (columnar_format != COLUMNAR_NONE)
+    num_rows = write_row_into_file_in_columnar_mode(&reader, tj);
+  else if (load_data)
+    num_rows = write_row_into_file_in_load_data_mode(conn, &reader, tj);
   else
-    num_rows=write_row_into_file_in_sql_mode(conn, result, tj);
+    num_rows=write_row_into_file_in_sql_mode(conn, &reader, tj);
+  mask_reader_clear(&reader);
 
   if (mysql_errno(conn)) {
     g_critical("Could not read data from %s.%s: %s", tj->dbt->database->name, tj->dbt->table,
@@ -718,12 +896,18 @@ guint64 write_table_data_into_file(MYSQL *conn, struct table_job * tj){
   }
 
 cleanup:
-  g_free(query);
-
   if (result) {
     mysql_free_result(result);
   }
 
+  tj->td->stats.rows+=num_rows;
+  tj->td->stats.chunks++;
+  histogram_observe(&(tj->td->stats.chunk_latency), g_get_monotonic_time()-chunk_start);
+  trace_span(tj->td->trace, "chunk", tj->dbt->database->name, tj->dbt->table, tj->nchunk, chunk_start);
+  g_mutex_lock(tj->dbt->rows_lock);
+  tj->dbt->bytes+=tj->td->stats.bytes-bytes;
+  g_mutex_unlock(tj->dbt->rows_lock);
+
   return num_rows;
 }
 
@@ -19,11 +19,24 @@
                     David Ducos, Percona (david dot ducos at percona dot com)
 */
 
+struct mask_reader;
+
 void load_write_entries(GOptionGroup *main_group, GOptionContext *context);
 void initialize_write();
 guint64 write_table_data_into_file(MYSQL *conn, struct table_job *tj);
-gboolean write_statement(FILE *load_data_file, float *filessize, GString *statement, struct db_table * dbt);
+guint64 write_row_into_file_in_load_data_mode(MYSQL *conn, struct mask_reader *reader, struct table_job * tj);
+guint64 write_row_into_file_in_sql_mode(MYSQL *conn, struct mask_reader *reader, struct table_job * tj);
+gboolean write_statement(struct table_job *tj, FILE *file, GString *statement);
+void initialize_adaptive_compression(struct adaptive_compression *ac);
+FILE *open_data_file(struct thread_data *td, const gchar *filename);
+void close_table_job_file(struct table_job *tj, FILE **file, const gchar *filename);
 gboolean write_load_data_statement(struct table_job * tj, MYSQL_FIELD *fields, guint num_fields);
 gboolean real_write_data(FILE *file, float *filesize, GString *data);
+void write_row_into_string(MYSQL *conn, MYSQL_ROW row, MYSQL_FIELD *fields, gulong *lengths, guint num_fields, GString *escaped, GString *statement_row, void write_column_into_string(MYSQL *, gchar *, MYSQL_FIELD , gulong ,GString *, GString *));
+void write_sql_column_into_string( MYSQL *conn, gchar *column, MYSQL_FIELD field, gulong length,GString *escaped, GString *statement_row);
+void write_load_data_column_into_string( MYSQL *conn, gchar *column, MYSQL_FIELD field, gulong length,GString *escaped, GString *statement_row);
+gboolean write_binary_header(FILE *file);
+void write_binary_row_into_string(MYSQL_ROW row, MYSQL_FIELD *fields, gulong *lengths, guint num_fields, GString *statement_row);
 void initialize_sql_statement(GString *statement);
 void message_dumping_data(struct thread_data *td, struct table_job *tj);
+guint64 get_estimated_remaining_chunks_on_dbt(struct db_table *dbt);
@@ -56,6 +56,7 @@
 #include "common_options.h"
 #include "myloader_jobs_manager.h"
 #include "myloader_directory.h"
+#include "myloader_stripe.h"
 #include "myloader_restore.h"
 #include "myloader_pmm_thread.h"
 #include "myloader_restore_job.h"
@@ -63,6 +64,7 @@
 #include "myloader_arguments.h"
 #include "myloader_global.h"
 #include "myloader_worker_index.h"
+#include "myloader_lag_pacing.h"
 guint commit_count = 1000;
 gchar *input_directory = NULL;
 gchar *directory = NULL;
@@ -85,8 +87,17 @@ gchar *purge_mode_str=NULL;
 guint errors = 0;
 guint max_threads_per_table=4;
 guint max_threads_for_index_creation=4;
+guint max_threads_total=0;
+gint data_threads_running=0;
 gboolean stream = FALSE;
 gboolean no_delete = FALSE;
+gboolean no_multi_statements = FALSE;
+gboolean ignore_manifest = FALSE;
+gchar *transaction_size_str = NULL;
+guint64 min_transaction_size = 0;
+guint64 max_transaction_size = 0;
+guint commit_latency_target = 200;
+guint retry_count = 10;
 
 GMutex *load_data_list_mutex=NULL;
 GHashTable * load_data_list = NULL;
@@ -113,6 +124,22 @@ GHashTable * myloader_initialize_hash_of_session_variables(){
 }
 
 
+void parse_transaction_size(){
+  gchar ** strsplit = g_strsplit(transaction_size_str,":",3);
+  if (g_strv_length(strsplit)!=2){
+    m_critical("Parse transaction size failed, it must be MIN:MAX");
+  }
+  min_transaction_size=g_ascii_strtoull(strsplit[0], NULL, 10) * 1024 * 1024;
+  max_transaction_size=g_ascii_strtoull(strsplit[1], NULL, 10) * 1024 * 1024;
+  g_strfreev(strsplit);
+  if (max_transaction_size == 0 || min_transaction_size > max_transaction_size){
+    m_critical("Transaction size MAX must be greater than 0 and not lower than MIN");
+  }
+  if (commit_count <= 1){
+    m_critical("--transaction-size needs --queries-per-transaction greater than 1");
+  }
+}
+
 gchar * print_time(GTimeSpan timespan){
   GTimeSpan days   = timespan/G_TIME_SPAN_DAY;
   GTimeSpan hours  =(timespan-(days*G_TIME_SPAN_DAY))/G_TIME_SPAN_HOUR;
@@ -229,13 +256,17 @@ int main(int argc, char *argv[]) {
 
     g_message("Using PMM resolution %s at %s", pmm_resolution, pmm_path);
     GError *serror;
+    initialize_pmm();
     pmmthread =
-        g_thread_create(pmm_thread, &conf, FALSE, &serror);
+        g_thread_create(pmm_thread, &conf, TRUE, &serror);
     if (pmmthread == NULL) {
       m_critical("Could not create pmm thread: %s", serror->message);
       g_error_free(serror);
     }
   }
+  if (transaction_size_str != NULL){
+    parse_transaction_size();
+  }
   initialize_job(purge_mode_str);
   char *current_dir=g_get_current_dir();
   if (!input_directory) {
@@ -288,6 +319,7 @@ int main(int argc, char *argv[]) {
   MYSQL *conn;
   conn = mysql_init(NULL);
   m_connect(conn,"myloader",NULL);
+  enable_multi_statements(conn);
 
   set_session = g_string_new(NULL);
   set_global = g_string_new(NULL);
@@ -347,11 +379,10 @@ int main(int argc, char *argv[]) {
     }
   }
 
-  struct thread_data t;
+  struct thread_data t={0};
   t.thread_id = 0;
   t.conf = &conf;
   t.thrconn = conn;
-  t.current_database=NULL;
 
   if (tables_list)
     tables = get_table_list(tables_list);
@@ -363,6 +394,7 @@ int main(int argc, char *argv[]) {
     d->schema_state=CREATED;
   }
 
+  initialize_trace("myloader");
   initialize_worker_index(&conf);
   initialize_intermediate_queue(&conf);
 
@@ -373,6 +405,11 @@ int main(int argc, char *argv[]) {
     initialize_stream(&conf);
   }
 
+  if (!stream)
+    load_compression_dictionaries(directory);
+  initialize_stripes();
+
+  start_lag_pacing();
   initialize_loader_threads(&conf);
 
   if (stream){
@@ -382,8 +419,10 @@ int main(int argc, char *argv[]) {
   }
 
   wait_loader_threads_to_finish();
+  stop_lag_pacing();
   create_index_shutdown_job(&conf);
   wait_index_worker_to_finish();
+  finalize_trace();
 
   g_async_queue_unref(conf.ready);
   conf.ready=NULL;
@@ -457,13 +496,14 @@ int i=0;
 
   if (pmm){
     kill_pmm_thread();
-//    g_thread_join(pmmthread);
+    g_thread_join(pmmthread);
   }
   free_table_hash(conf.table_hash);
   g_hash_table_remove_all(conf.table_hash);
   g_hash_table_unref(conf.table_hash);
   g_list_free_full(conf.checksum_list,g_free);
   if (logoutfile) {
+    stop_async_log();
     fclose(logoutfile);
   }
 
@@ -16,15 +16,39 @@
 */
 
 #include <mysql.h>
+#include "metrics.h"
+#include "trace.h"
 
 #ifndef _src_myloader_h
 #define _src_myloader_h
 
+// Counters are only written by the thread that owns them, pmm_thread reads
+// and aggregates them when the textfile is written. Times are in microseconds.
+struct thread_stats {
+  guint64 rows;
+  guint64 statements;
+  guint64 bytes;
+  guint64 files;
+  guint64 data_files;
+  guint64 commits;
+  guint64 retries;
+  gint64 read_time;
+  gint64 query_time;
+  gint64 commit_time;
+  struct latency_histogram query_latency;
+  struct latency_histogram commit_latency;
+};
+
 struct thread_data {
   struct configuration *conf;
   MYSQL *thrconn;
   gchar *current_database;
   guint thread_id;
+  struct thread_stats stats;
+  struct trace_buffer *trace;
+  struct db_table *dbt;
+  guint64 transaction_bytes;
+  GPtrArray *transaction;
 };
 
 struct configuration {
@@ -50,6 +74,18 @@ struct configuration {
 };
 
 
+// Statements sent in one round trip when multi statements are enabled
+#define STATEMENT_BATCH_STATEMENTS 100
+#define STATEMENT_BATCH_SIZE 65536
+// Bytes added to the transaction size of a table after a fast COMMIT
+#define TRANSACTION_SIZE_STEP 1048576
+// Statements kept per thread to replay a transaction, it is committed earlier
+// when they reach this size
+#define TRANSACTION_REPLAY_SIZE 67108864
+// Microseconds to wait before the first retry and the most to wait on any
+#define RETRY_BACKOFF_BASE 100000
+#define RETRY_BACKOFF_MAX 10000000
+
 enum schema_status { NOT_FOUND, NOT_CREATED, CREATING, CREATED, DATA_DONE, INDEX_ENQUEUED, ALL_DONE};
 
 struct database {
@@ -69,6 +105,7 @@ struct db_table {
   char *table;
   char *real_table;
   guint64 rows;
+  guint64 bytes;
 //  GAsyncQueue * queue;
   GList * restore_job_list;
   guint current_threads;
@@ -76,6 +113,11 @@ struct db_table {
   GMutex *mutex;
   GString *indexes;
   GString *constraints;
+  guint64 row_width;
+  guint64 index_key_width;
+  guint64 index_cost;
+  guint64 transaction_size;
+  guint64 data_size;
   guint count;
   enum schema_status schema_state;
   gboolean index_enqueued;
@@ -27,6 +27,9 @@
 #include "logging.h"
 #include "connection.h"
 #include "regex.h"
+#include "trace.h"
+#include "myloader_lag_pacing.h"
+#include "uring_writer.h"
 
 extern gboolean enable_binlog;
 
@@ -62,6 +65,9 @@ static GOptionEntry entries[] = {
     {"help", '?', 0, G_OPTION_ARG_NONE, &help, "Show help options", NULL},
     {"directory", 'd', 0, G_OPTION_ARG_STRING, &input_directory,
      "Directory of the dump to import", NULL},
+    {"stripe-directories", 0, 0, G_OPTION_ARG_STRING, &stripe_directories,
+     "Comma separated list of the other directories where mydumper --stripe-directories wrote the data files. "
+     "They replace, in order, the ones recorded in the manifest", NULL},
     {"logfile", 'L', 0, G_OPTION_ARG_FILENAME, &logfile,
      "Log file name to use, by default stdout is used", NULL},
     {"database", 'B', 0, G_OPTION_ARG_STRING, &db,
@@ -70,6 +76,8 @@ static GOptionEntry entries[] = {
 
     {"resume",0, 0, G_OPTION_ARG_NONE, &resume,
       "Expect to find resume file in backup dir and will only process those files",NULL},
+    {"ignore-manifest",0, 0, G_OPTION_ARG_NONE, &ignore_manifest,
+      "Lists the backup dir even if it has the manifest written by mydumper --manifest",NULL},
     {NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL}};
 
 static GOptionEntry threads_entries[] = {
@@ -77,6 +85,19 @@ static GOptionEntry threads_entries[] = {
      "Maximum number of threads per table to use, default 4", NULL},
     {"max-threads-for-index-creation", 0, 0, G_OPTION_ARG_INT, &max_threads_for_index_creation,
      "Maximum number of threads for index creation, default 4", NULL},
+    {"max-threads-total", 0, 0, G_OPTION_ARG_INT, &max_threads_total,
+     "Maximum number of data and index threads working at the same time. Data and index jobs "
+     "wait while it is reached, and a waiting index goes before the data. Default 0, no limit", NULL},
+    {"replica-lag-target", 0, 0, G_OPTION_ARG_INT, &replica_lag_target,
+     "Replication lag in seconds to stay under. Over it, the threads restoring data are halved and the "
+     "transactions made smaller, and they are added back while the lag is under half of it. Default 0, disabled", NULL},
+    {"replica-lag-host", 0, 0, G_OPTION_ARG_STRING, &replica_lag_host,
+     "Replica to check with SHOW REPLICA STATUS for --replica-lag-target, using the same credentials", NULL},
+    {"replica-lag-port", 0, 0, G_OPTION_ARG_INT, &replica_lag_port,
+     "Port of --replica-lag-host", NULL},
+    {"replica-lag-query", 0, 0, G_OPTION_ARG_STRING, &replica_lag_query,
+     "Query that returns the replication lag in seconds in its first column, for instance from a heartbeat "
+     "table. It is sent to --replica-lag-host if given, otherwise to the server being restored", NULL},
     {NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL}};
 
 static GOptionEntry execution_entries[] = {
@@ -96,6 +117,11 @@ static GOptionEntry execution_entries[] = {
       "Table recreation will be executed in series, one thread at a time",NULL},
     {"stream", 0, G_OPTION_FLAG_OPTIONAL_ARG, G_OPTION_ARG_CALLBACK , &stream_arguments_callback,
      "It will receive the stream from STDIN and creates the file in the disk before start processing. Since v0.12.7-1, accepts NO_DELETE, NO_STREAM_AND_NO_DELETE and TRADITIONAL which is the default value and used if no parameter is given", NULL},
+    {"io-uring", 0, 0, G_OPTION_ARG_NONE, &use_io_uring,
+     "Writes the files received by --stream with io_uring, it uses the regular writes when the kernel or "
+     "the build does not support it", NULL},
+    {"io-uring-direct", 0, 0, G_OPTION_ARG_NONE, &io_uring_direct,
+     "Opens the files with O_DIRECT when --io-uring is used", NULL},
 //    {"no-delete", 0, 0, G_OPTION_ARG_NONE, &no_delete,
 //      "It will not delete the files after stream has been completed", NULL},
     {NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL}};
@@ -103,6 +129,8 @@ static GOptionEntry execution_entries[] = {
 static GOptionEntry pmm_entries[] = {
     { "pmm-path", 0, 0, G_OPTION_ARG_STRING, &pmm_path,
       "which default value will be /usr/local/percona/pmm2/collectors/textfile-collector/high-resolution", NULL },
+    { "trace-file", 0, 0, G_OPTION_ARG_FILENAME, &trace_file,
+      "Write a Chrome trace/Perfetto compatible JSON timeline of the files processed by each thread", NULL },
     { "pmm-resolution", 0, 0, G_OPTION_ARG_STRING, &pmm_resolution,
       "which default will be high", NULL },
     {NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL}};
@@ -124,12 +152,22 @@ static GOptionEntry statement_entries[] ={
      "Split the INSERT statement into this many rows.", NULL},
     {"queries-per-transaction", 'q', 0, G_OPTION_ARG_INT, &commit_count,
      "Number of queries per transaction, default 1000", NULL},
+    {"transaction-size", 0, 0, G_OPTION_ARG_STRING, &transaction_size_str,
+     "MIN:MAX in MB. Sizes the transactions of each table by bytes between these bounds, growing while the COMMITs "
+     "are faster than --commit-latency-target and halving on slow COMMITs, lock wait timeouts or deadlocks. "
+     "--queries-per-transaction is still the maximum number of queries per transaction", NULL},
+    {"commit-latency-target", 0, 0, G_OPTION_ARG_INT, &commit_latency_target,
+     "COMMIT latency in milliseconds that --transaction-size tries to keep, default 200", NULL},
+    {"retry-count", 0, 0, G_OPTION_ARG_INT, &retry_count,
+     "Number of times a transaction is replayed after a deadlock, a lock wait timeout or a lost connection, default 10", NULL},
     {"append-if-not-exist", 0, 0, G_OPTION_ARG_NONE,&append_if_not_exist,
       "Appends IF NOT EXISTS to the create table statements. This will be removed when https://bugs.mysql.com/bug.php?id=103791 has been implemented", NULL},
     { "set-names",0, 0, G_OPTION_ARG_STRING, &set_names_str,
       "Sets the names, use it at your own risk, default binary", NULL },
     {"skip-definer", 0, 0, G_OPTION_ARG_NONE, &skip_definer,
      "Removes DEFINER from the CREATE statement. By default, statements are not modified", NULL},
+    {"no-multi-statements", 0, 0, G_OPTION_ARG_NONE, &no_multi_statements,
+     "Sends the schema statements one by one instead of in batches", NULL},
     {NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL}};
 
 
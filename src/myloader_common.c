@@ -35,6 +35,8 @@
 #include "connection.h"
 #include "tables_skiplist.h"
 #include "regex.h"
+#include "manifest.h"
+#include "myloader_create_table.h"
 #include <errno.h>
 #include "myloader_global.h"
 
@@ -42,6 +44,7 @@
 static GMutex *db_hash_mutex = NULL;
 GHashTable *db_hash=NULL;
 GHashTable *tbl_hash=NULL;
+static GHashTable *compression_dictionaries=NULL;
 
 
 void initialize_common(){
@@ -233,6 +236,11 @@ enum file_type get_file_type (const char * filename){
     return METADATA_GLOBAL;
   } else if ( strcmp(filename, "all-schema-create-tablespace.sql") == 0 ){
     return SCHEMA_TABLESPACE;
+  } else if ( strcmp(filename, MANIFEST_FILENAME) == 0 ){
+    return DO_NOT_ENQUEUE;
+  } else if (m_filename_has_suffix(filename, "." DICTIONARY_EXTENSION) ){
+    // Loaded by load_compression_dictionaries
+    return DO_NOT_ENQUEUE;
   } else if ( strcmp(filename, "resume") == 0 ){
     if (!resume){
       m_critical("resume file found, but no --resume option passed. Use --resume or remove it and restart process if you consider that it will be safe.");
@@ -323,52 +331,115 @@ void finish_alter_table(GString * alter_table_statement){
     g_string_append(alter_table_statement,";\n");
 }
 
+// Bytes that a column takes in an index entry, it only needs to be good
+// enough to compare the cost of the indexes of different tables
+static guint get_column_width(const gchar *type){
+  const gchar *p=strchr(type, '(');
+  guint length = p ? strtoul(p+1, NULL, 10) : 0;
+  if (g_str_has_prefix(type, "tinyint"))
+    return 1;
+  if (g_str_has_prefix(type, "smallint"))
+    return 2;
+  if (g_str_has_prefix(type, "mediumint"))
+    return 3;
+  if (g_str_has_prefix(type, "bigint") || g_str_has_prefix(type, "double") ||
+      g_str_has_prefix(type, "datetime") || g_str_has_prefix(type, "timestamp"))
+    return 8;
+  if (g_str_has_prefix(type, "int") || g_str_has_prefix(type, "float") || g_str_has_prefix(type, "date") ||
+      g_str_has_prefix(type, "time") || g_str_has_prefix(type, "year"))
+    return 4;
+  if (g_str_has_prefix(type, "decimal"))
+    return length / 2 + 1;
+  if (g_str_has_prefix(type, "char") || g_str_has_prefix(type, "varchar") ||
+      g_str_has_prefix(type, "binary") || g_str_has_prefix(type, "varbinary"))
+    return MAX(length, 1);
+  if (g_strrstr(type, "text") || g_strrstr(type, "blob") || g_str_has_prefix(type, "json"))
+    return 256;
+  return 8;
+}
+
+// Key width is the sum of the key columns, or of their prefix length, plus
+// the primary key reference that every secondary index entry has.
+static guint get_key_width(struct create_table_definition *definition, GHashTable *column_width){
+  guint width=8, i;
+  struct create_table_key_part *part;
+  for (i=0; definition->key_parts != NULL && i < definition->key_parts->len; i++){
+    part=&g_array_index(definition->key_parts, struct create_table_key_part, i);
+    if (part->prefix_length > 0)
+      width+=part->prefix_length;
+    else if (part->column != NULL)
+      width+=GPOINTER_TO_UINT(g_hash_table_lookup(column_width, part->column));
+    else
+      width+=8;
+  }
+  return width;
+}
+
+static gboolean key_starts_with_column(struct create_table_definition *definition, const gchar *column){
+  return column != NULL && definition->key_parts != NULL && definition->key_parts->len > 0 &&
+         g_strcmp0(g_array_index(definition->key_parts, struct create_table_key_part, 0).column, column) == 0;
+}
+
+// Keys, except the one that starts with the AUTO_INCREMENT column, are moved
+// to alter_table_statement and foreign keys to alter_table_constraint_statement.
+// Returns 0 when the statement could not be parsed and has to be used as it is.
 int process_create_table_statement (gchar * statement, GString *create_table_statement, GString *alter_table_statement, GString *alter_table_constraint_statement, struct db_table *dbt){
   int flag=0;
-  gchar** split_file= g_strsplit(statement, "\n", -1);
-  gchar *autoinc_column=NULL;
+  struct create_table *ct=parse_create_table(statement, identifier_quote_character);
+  struct create_table_definition *definition;
+  const gchar *autoinc_column=NULL;
+  gboolean first_definition=TRUE;
+  guint i, width;
+  if (ct == NULL)
+    return 0;
+  GHashTable *column_width=g_hash_table_new(g_str_hash, g_str_equal);
+  dbt->row_width=0;
+  dbt->index_key_width=0;
   append_alter_table(alter_table_statement, dbt->database->real_database,dbt->real_table);
   append_alter_table(alter_table_constraint_statement, dbt->database->real_database,dbt->real_table);
   int fulltext_counter=0;
-  int i=0;
-  for (i=0; i < (int)g_strv_length(split_file);i++){
-    if ( g_strstr_len(split_file[i],5,"  KEY")
-      || g_strstr_len(split_file[i],8,"  UNIQUE")
-      || g_strstr_len(split_file[i],9,"  SPATIAL")
-      || g_strstr_len(split_file[i],10,"  FULLTEXT")
-      || g_strstr_len(split_file[i],7,"  INDEX")
-      ){
-      // Ignore if the first column of the index is the AUTO_INCREMENT column
-      if ((autoinc_column != NULL) && (g_strrstr(split_file[i],autoinc_column))){
-        g_string_append(create_table_statement, split_file[i]);
-        g_string_append_c(create_table_statement,'\n');
-      }else{
-        flag|=IS_ALTER_TABLE_PRESENT;
-        if (g_strrstr(split_file[i],"  FULLTEXT")) fulltext_counter++;
-        if (fulltext_counter>1){
-          fulltext_counter=1;
-          finish_alter_table(alter_table_statement);
-          append_alter_table(alter_table_statement,dbt->database->real_database,dbt->real_table);
-        }
-        g_string_append(alter_table_statement,"\n ADD");
-        g_string_append(alter_table_statement, split_file[i]);
+  for (i=0; i < ct->definitions->len; i++){
+    definition=g_ptr_array_index(ct->definitions, i);
+    if (definition->type == CREATE_TABLE_COLUMN){
+      if (definition->auto_increment)
+        autoinc_column=definition->name;
+      width=definition->column_type != NULL ? get_column_width(definition->column_type) : 8;
+      g_hash_table_insert(column_width, definition->name, GUINT_TO_POINTER(width));
+      dbt->row_width+=width;
+    }
+  }
+  g_string_append_len(create_table_statement, ct->header, ct->header_length);
+  for (i=0; i < ct->definitions->len; i++){
+    definition=g_ptr_array_index(ct->definitions, i);
+    if (is_key_definition(definition) && !key_starts_with_column(definition, autoinc_column)){
+      flag|=IS_ALTER_TABLE_PRESENT;
+      // Only one FULLTEXT index can be added per ALTER TABLE
+      if (definition->type == CREATE_TABLE_FULLTEXT_KEY) fulltext_counter++;
+      if (fulltext_counter>1){
+        fulltext_counter=1;
+        finish_alter_table(alter_table_statement);
+        append_alter_table(alter_table_statement,dbt->database->real_database,dbt->real_table);
       }
+      g_string_append(alter_table_statement,"\n ADD ");
+      append_create_table_definition(alter_table_statement, definition);
+      g_string_append_c(alter_table_statement, ',');
+      dbt->index_key_width+=get_key_width(definition, column_width);
+    }else if (definition->type == CREATE_TABLE_FOREIGN_KEY){
+      flag|=INCLUDE_CONSTRAINT;
+      g_string_append(alter_table_constraint_statement,"\n ADD ");
+      append_create_table_definition(alter_table_constraint_statement, definition);
+      g_string_append_c(alter_table_constraint_statement, ',');
     }else{
-      if (g_strstr_len(split_file[i],12,"  CONSTRAINT")){
-        flag|=INCLUDE_CONSTRAINT;
-        g_string_append(alter_table_constraint_statement,"\n ADD");
-        g_string_append(alter_table_constraint_statement, split_file[i]);
-      }else{
-        if (g_strrstr(split_file[i],"AUTO_INCREMENT")){
-          gchar** autoinc_split=g_strsplit(split_file[i],"`",3);
-          autoinc_column=g_strdup_printf("(`%s`", autoinc_split[1]);
-        }
-        g_string_append(create_table_statement, split_file[i]);
-        g_string_append_c(create_table_statement,'\n');
-      }
+      g_string_append(create_table_statement, first_definition ? "\n  " : ",\n  ");
+      append_create_table_definition(create_table_statement, definition);
+      first_definition=FALSE;
     }
-    if (g_strrstr(split_file[i],"ENGINE=InnoDB")) flag|=IS_INNODB_TABLE;
   }
+  g_string_append_c(create_table_statement, '\n');
+  g_string_append(create_table_statement, ct->options);
+  if (ct->engine != NULL && g_ascii_strcasecmp(ct->engine, "InnoDB") == 0) flag|=IS_INNODB_TABLE;
+  g_hash_table_destroy(column_width);
+  free_create_table(ct);
   return flag;
 }
 
@@ -387,6 +458,10 @@ gint compare_dbt(gconstpointer a, gconstpointer b, gpointer table_hash){
 }
 
 gint compare_dbt_short(gconstpointer a, gconstpointer b){
+  // The size of the data files comes from the manifest, or from the files on
+  // disk without it
+  if (((struct db_table *)a)->data_size != ((struct db_table *)b)->data_size)
+    return ((struct db_table *)a)->data_size < ((struct db_table *)b)->data_size;
   return ((struct db_table *)a)->rows < ((struct db_table *)b)->rows;
 }
 
@@ -554,6 +629,72 @@ gboolean has_compession_extension(const gchar *filename){
   return g_str_has_suffix(filename, compress_extension);
 }
 
+// Dictionaries are read once and kept until the end, as the files only
+// reference them while they are open
+void load_compression_dictionaries(const gchar *dir){
+#ifdef ZWRAP_USE_ZSTD
+  GError *error=NULL;
+  GDir *d=g_dir_open(dir, 0, &error);
+  const gchar *filename;
+  gchar *path, *content;
+  gsize length;
+  if (d == NULL){
+    g_error_free(error);
+    return;
+  }
+  while ((filename=g_dir_read_name(d))){
+    if (!g_str_has_suffix(filename, "." DICTIONARY_EXTENSION))
+      continue;
+    path=g_build_filename(dir, filename, NULL);
+    if (g_file_get_contents(path, &content, &length, &error)){
+      if (compression_dictionaries == NULL)
+        compression_dictionaries=g_hash_table_new(g_str_hash, g_str_equal);
+      g_hash_table_insert(compression_dictionaries, g_strndup(filename, strlen(filename) - strlen(DICTIONARY_EXTENSION) - 1), g_string_new_len(content, length));
+      g_free(content);
+    }else{
+      g_critical("Could not read dictionary %s: %s", path, error->message);
+      g_clear_error(&error);
+      errors++;
+    }
+    g_free(path);
+  }
+  g_dir_close(d);
+  if (compression_dictionaries)
+    g_message("%u compression dictionaries loaded", g_hash_table_size(compression_dictionaries));
+#else
+  (void) dir;
+#endif
+}
+
+#ifdef ZWRAP_USE_ZSTD
+// Table schema files use the schema dictionary. Data files are named
+// database.table.part[.sub_part].extension, so the table dictionary is found
+// by removing the extension and the numbers.
+static GString *get_compression_dictionary(const gchar *filename){
+  gchar *basename=g_path_get_basename(filename);
+  GString *dictionary=NULL;
+  if (m_filename_has_suffix(basename, "-schema.sql")){
+    dictionary=g_hash_table_lookup(compression_dictionaries, SCHEMA_DICTIONARY);
+  }else{
+    gchar **parts=g_strsplit(basename, ".", 0);
+    guint n=g_strv_length(parts) - 2, numbers=0;
+    while (n > 2 && numbers < 2 && strspn(parts[n-1], "0123456789") == strlen(parts[n-1])){
+      n--;
+      numbers++;
+    }
+    gchar **table_parts=g_new0(gchar *, n + 1);
+    memcpy(table_parts, parts, n * sizeof(gchar *));
+    gchar *key=g_strjoinv(".", table_parts);
+    dictionary=g_hash_table_lookup(compression_dictionaries, key);
+    g_free(key);
+    g_free(table_parts);
+    g_strfreev(parts);
+  }
+  g_free(basename);
+  return dictionary;
+}
+#endif
+
 void ml_open(FILE **infile, const gchar *filename, gboolean *is_compressed){
   if (!has_compession_extension(filename)) {
     *infile = g_fopen(filename, "r");
@@ -561,5 +702,10 @@ void ml_open(FILE **infile, const gchar *filename, gboolean *is_compressed){
   } else {
     *infile = (void *)gzopen(filename, "r");
     *is_compressed = TRUE;
+#ifdef ZWRAP_USE_ZSTD
+    GString *dictionary;
+    if (*infile && compression_dictionaries && (dictionary=get_compression_dictionary(filename)))
+      gzsetdictionary((gzFile)*infile, dictionary->str, dictionary->len);
+#endif
   }
 }
@@ -43,6 +43,7 @@ void refresh_table_list_without_table_hash_lock(struct configuration *conf);
 void checksum_databases(struct thread_data *td);
 void checksum_table_filename(const gchar *filename, MYSQL *conn);
 void ml_open(FILE **infile, const gchar *filename, gboolean *is_compressed);
+void load_compression_dictionaries(const gchar *dir);
 gboolean has_compession_extension(const gchar *filename);
 gchar *build_dbt_key(gchar *a, gchar *b);
 gboolean m_query(  MYSQL *conn, const gchar *query, void log_fun(const char *, ...) , const char *fmt, ...);
@@ -25,6 +25,7 @@
 #include "myloader_jobs_manager.h"
 #include "myloader_global.h"
 #include "myloader_worker_index.h"
+#include "myloader_stripe.h"
 gboolean intermediate_queue_ended_local=FALSE;
 gboolean dont_wait_for_schema_create=FALSE;
 GAsyncQueue *refresh_db_queue = NULL, *here_is_your_job=NULL, *data_queue=NULL;
@@ -171,11 +172,31 @@ gboolean are_available_jobs(struct thread_data * td){
 gboolean create_index_job(struct configuration *conf, struct db_table * dbt, guint tdid){
   g_message("Thread %d: Enqueuing index for table: `%s`.`%s`", tdid, dbt->database->real_database, dbt->table);
   struct restore_job *rj = new_schema_restore_job(g_strdup("index"),JOB_RESTORE_STRING, dbt, dbt->database,dbt->indexes,"indexes");
-  g_async_queue_push(conf->index_queue, new_job(JOB_RESTORE,rj,dbt->database->real_database));
+  dbt->index_cost=estimate_index_cost(dbt);
+  enqueue_index_job(conf, new_job(JOB_RESTORE,rj,dbt->database->real_database));
   dbt->schema_state=INDEX_ENQUEUED;
   return TRUE;
 }
 
+// When the data files are striped, the next jobs of the table are checked to
+// start the one on the volume with less reads in progress
+static GList *pick_data_job(GList *restore_job_list){
+  GList *iter=restore_job_list, *best=restore_job_list;
+  gint reads, best_reads;
+  guint i;
+  if (!is_striped())
+    return restore_job_list;
+  best_reads=get_stripe_reads(((struct restore_job *)best->data)->filename);
+  for (i=1, iter=iter->next; iter != NULL && i < STRIPE_JOB_LOOKAHEAD && best_reads > 0; i++, iter=iter->next){
+    reads=get_stripe_reads(((struct restore_job *)iter->data)->filename);
+    if (reads < best_reads){
+      best=iter;
+      best_reads=reads;
+    }
+  }
+  return best;
+}
+
 gboolean give_me_next_data_job_conf(struct configuration *conf, gboolean test_condition, struct restore_job ** rj){
   gboolean giveup = TRUE;
   g_mutex_lock(conf->table_list_mutex);
@@ -215,10 +236,9 @@ gboolean give_me_next_data_job_conf(struct configuration *conf, gboolean test_co
 //      g_message("DB: %s Table: %s checking size %d", dbt->database->real_database,dbt->real_table, g_list_length(dbt->restore_job_list));
       if (g_list_length(dbt->restore_job_list) > 0){
         // We found a job that we can process!
-        job = dbt->restore_job_list->data;
-        next = dbt->restore_job_list->next;
-        g_list_free_1(dbt->restore_job_list);
-        dbt->restore_job_list = next;
+        next = pick_data_job(dbt->restore_job_list);
+        job = next->data;
+        dbt->restore_job_list = g_list_delete_link(dbt->restore_job_list, next);
         dbt->current_threads++;
         g_mutex_unlock(dbt->mutex);
         giveup=FALSE;
@@ -0,0 +1,358 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+#include <glib.h>
+#include <string.h>
+#include <stdlib.h>
+#include "myloader_create_table.h"
+
+// Tokenizer and parser for the CREATE TABLE statements that SHOW CREATE
+// TABLE returns. The rewrites copy slices of the statement, so whatever the
+// parser does not understand, like comments or partitioning, is kept as it is.
+
+struct sql_tokenizer {
+  const gchar *p;
+  const gchar *end;
+  gchar quote;
+};
+
+static gboolean is_word_character(guchar c){
+  return g_ascii_isalnum(c) || c == '_' || c == '$' || c >= 0x80;
+}
+
+static void skip_spaces_and_comments(struct sql_tokenizer *tk){
+  while (tk->p < tk->end){
+    if (g_ascii_isspace(*tk->p)){
+      tk->p++;
+    }else if (*tk->p == '/' && tk->p + 1 < tk->end && tk->p[1] == '*'){
+      const gchar *close=g_strstr_len(tk->p + 2, tk->end - tk->p - 2, "*/");
+      tk->p= close != NULL ? close + 2 : tk->end;
+    }else if (*tk->p == '#' || (*tk->p == '-' && tk->p + 2 < tk->end && tk->p[1] == '-' && g_ascii_isspace(tk->p[2]))){
+      while (tk->p < tk->end && *tk->p != '\n')
+        tk->p++;
+    }else
+      break;
+  }
+}
+
+// Quotes are escaped by doubling them, strings also with backslashes
+static const gchar *skip_quoted(const gchar *p, const gchar *end, gchar quote, gboolean backslash){
+  for (p++; p < end; p++){
+    if (backslash && *p == '\\' && p + 1 < end)
+      p++;
+    else if (*p == quote){
+      if (p + 1 < end && p[1] == quote)
+        p++;
+      else
+        return p + 1;
+    }
+  }
+  return end;
+}
+
+static void next_token(struct sql_tokenizer *tk, struct sql_token *token){
+  skip_spaces_and_comments(tk);
+  token->start=tk->p;
+  if (tk->p >= tk->end){
+    token->type=SQL_TOKEN_END;
+  }else if (*tk->p == tk->quote){
+    token->type=SQL_TOKEN_IDENTIFIER;
+    tk->p=skip_quoted(tk->p, tk->end, tk->quote, FALSE);
+  }else if (*tk->p == '\'' || *tk->p == '"'){
+    token->type=SQL_TOKEN_STRING;
+    tk->p=skip_quoted(tk->p, tk->end, *tk->p, TRUE);
+  }else if (is_word_character(*tk->p)){
+    token->type=SQL_TOKEN_WORD;
+    while (tk->p < tk->end && is_word_character(*tk->p))
+      tk->p++;
+  }else{
+    token->type=SQL_TOKEN_SYMBOL;
+    tk->p++;
+  }
+  token->length=tk->p - token->start;
+}
+
+static gboolean token_is(struct sql_token *token, const gchar *word){
+  return token->type == SQL_TOKEN_WORD && strlen(word) == token->length &&
+         g_ascii_strncasecmp(token->start, word, token->length) == 0;
+}
+
+static gboolean token_is_symbol(struct sql_token *token, gchar c){
+  return token->type == SQL_TOKEN_SYMBOL && *token->start == c;
+}
+
+static gboolean token_is_name(struct sql_token *token){
+  return token->type == SQL_TOKEN_IDENTIFIER || token->type == SQL_TOKEN_WORD;
+}
+
+static gchar *token_to_name(struct sql_token *token){
+  if (token->type != SQL_TOKEN_IDENTIFIER)
+    return g_strndup(token->start, token->length);
+  GString *name=g_string_sized_new(token->length);
+  const gchar *p;
+  for (p=token->start + 1; p < token->start + token->length - 1; p++){
+    g_string_append_c(name, *p);
+    if (*p == *token->start && p + 1 < token->start + token->length - 1)
+      p++;
+  }
+  return g_string_free(name, FALSE);
+}
+
+// Moves after the parenthesis that closes the one in token
+static void skip_parenthesis(struct sql_tokenizer *tk, struct sql_token *token){
+  guint depth=1;
+  while (depth > 0){
+    next_token(tk, token);
+    if (token->type == SQL_TOKEN_END)
+      return;
+    if (token_is_symbol(token, '('))
+      depth++;
+    else if (token_is_symbol(token, ')'))
+      depth--;
+  }
+}
+
+// CREATE [TEMPORARY] TABLE [IF NOT EXISTS] [db.]table, token is left on the
+// token after the name
+static gboolean parse_create_table_name(struct sql_tokenizer *tk, struct sql_token *token, gchar **database, gchar **table){
+  next_token(tk, token);
+  if (!token_is(token, "CREATE"))
+    return FALSE;
+  next_token(tk, token);
+  if (token_is(token, "TEMPORARY"))
+    next_token(tk, token);
+  if (!token_is(token, "TABLE"))
+    return FALSE;
+  next_token(tk, token);
+  if (token_is(token, "IF")){
+    next_token(tk, token);
+    next_token(tk, token);
+    next_token(tk, token);
+  }
+  if (!token_is_name(token))
+    return FALSE;
+  *table=token_to_name(token);
+  next_token(tk, token);
+  if (token_is_symbol(token, '.')){
+    next_token(tk, token);
+    if (!token_is_name(token)){
+      g_free(*table);
+      *table=NULL;
+      return FALSE;
+    }
+    *database=*table;
+    *table=token_to_name(token);
+    next_token(tk, token);
+  }
+  return TRUE;
+}
+
+gchar *get_create_table_name(const gchar *statement, gchar quote){
+  struct sql_tokenizer tk={ statement, statement + strlen(statement), quote };
+  struct sql_token token;
+  gchar *database=NULL, *table=NULL;
+  parse_create_table_name(&tk, &token, &database, &table);
+  g_free(database);
+  return table;
+}
+
+// ( part [, part ...] ), a part is a column with an optional prefix length or
+// an expression in parenthesis, both followed by ASC or DESC
+static void parse_key_parts(struct sql_tokenizer *tk, struct sql_token *token, GArray *key_parts){
+  struct create_table_key_part part;
+  gboolean expect_part=TRUE;
+  for (next_token(tk, token); token->type != SQL_TOKEN_END && !token_is_symbol(token, ')'); next_token(tk, token)){
+    if (token_is_symbol(token, ',')){
+      expect_part=TRUE;
+    }else if (expect_part){
+      part.column=NULL;
+      part.prefix_length=0;
+      if (token_is_symbol(token, '(')){
+        skip_parenthesis(tk, token);
+      }else if (token_is_name(token)){
+        part.column=token_to_name(token);
+        struct sql_tokenizer lookahead=*tk;
+        next_token(&lookahead, token);
+        if (token_is_symbol(token, '(')){
+          next_token(&lookahead, token);
+          part.prefix_length=strtoul(token->start, NULL, 10);
+          next_token(&lookahead, token);
+          *tk=lookahead;
+        }
+      }
+      g_array_append_val(key_parts, part);
+      expect_part=FALSE;
+    }else if (token_is_symbol(token, '(')){
+      skip_parenthesis(tk, token);
+    }
+  }
+}
+
+static void parse_key_definition(struct sql_tokenizer *tk, struct sql_token *token, struct create_table_definition *definition){
+  // The index name is before the key parts, it is optional
+  while (token->type != SQL_TOKEN_END && !token_is_symbol(token, '(') && !token_is_symbol(token, ',') && !token_is_symbol(token, ')')){
+    if (definition->name == NULL && token_is_name(token) &&
+        !token_is(token, "KEY") && !token_is(token, "INDEX") && !token_is(token, "USING") &&
+        !token_is(token, "BTREE") && !token_is(token, "HASH"))
+      definition->name=token_to_name(token);
+    next_token(tk, token);
+  }
+  if (token_is_symbol(token, '(')){
+    definition->key_parts=g_array_new(FALSE, FALSE, sizeof(struct create_table_key_part));
+    parse_key_parts(tk, token, definition->key_parts);
+    next_token(tk, token);
+  }
+}
+
+static void parse_column_definition(struct sql_tokenizer *tk, struct sql_token *token, struct create_table_definition *definition){
+  definition->name=token_to_name(token);
+  next_token(tk, token);
+  if (token->type == SQL_TOKEN_WORD){
+    const gchar *type_start=token->start, *type_end=tk->p;
+    next_token(tk, token);
+    if (token_is_symbol(token, '(')){
+      skip_parenthesis(tk, token);
+      type_end=tk->p;
+      next_token(tk, token);
+    }
+    definition->column_type=g_ascii_strdown(type_start, type_end - type_start);
+  }
+}
+
+static struct create_table_definition *parse_definition(struct sql_tokenizer *tk, struct sql_token *token){
+  struct create_table_definition *definition=g_new0(struct create_table_definition, 1);
+  definition->text=token->start;
+  definition->type=CREATE_TABLE_OTHER;
+  if (token_is(token, "CONSTRAINT")){
+    next_token(tk, token);
+    if (token_is_name(token) && !token_is(token, "PRIMARY") && !token_is(token, "UNIQUE") &&
+        !token_is(token, "FOREIGN") && !token_is(token, "CHECK")){
+      definition->name=token_to_name(token);
+      next_token(tk, token);
+    }
+  }
+  if (token_is(token, "PRIMARY")){
+    definition->type=CREATE_TABLE_PRIMARY_KEY;
+  }else if (token_is(token, "UNIQUE")){
+    definition->type=CREATE_TABLE_UNIQUE_KEY;
+  }else if (token_is(token, "KEY") || token_is(token, "INDEX")){
+    definition->type=CREATE_TABLE_KEY;
+  }else if (token_is(token, "FULLTEXT")){
+    definition->type=CREATE_TABLE_FULLTEXT_KEY;
+  }else if (token_is(token, "SPATIAL")){
+    definition->type=CREATE_TABLE_SPATIAL_KEY;
+  }else if (token_is(token, "FOREIGN")){
+    definition->type=CREATE_TABLE_FOREIGN_KEY;
+  }else if (token_is(token, "CHECK")){
+    definition->type=CREATE_TABLE_CHECK;
+  }else if (token_is_name(token) && definition->name == NULL){
+    definition->type=CREATE_TABLE_COLUMN;
+  }
+  switch (definition->type){
+    case CREATE_TABLE_COLUMN:
+      parse_column_definition(tk, token, definition);
+      break;
+    case CREATE_TABLE_PRIMARY_KEY:
+    case CREATE_TABLE_UNIQUE_KEY:
+    case CREATE_TABLE_KEY:
+    case CREATE_TABLE_FULLTEXT_KEY:
+    case CREATE_TABLE_SPATIAL_KEY:
+    case CREATE_TABLE_FOREIGN_KEY:
+      next_token(tk, token);
+      parse_key_definition(tk, token, definition);
+      break;
+    default:
+      break;
+  }
+  while (token->type != SQL_TOKEN_END && !token_is_symbol(token, ',') && !token_is_symbol(token, ')')){
+    if (token_is(token, "AUTO_INCREMENT"))
+      definition->auto_increment=TRUE;
+    if (token_is_symbol(token, '('))
+      skip_parenthesis(tk, token);
+    next_token(tk, token);
+  }
+  // Comments before the comma, like /*!80023 INVISIBLE */, are part of it
+  definition->length=token->start - definition->text;
+  while (definition->length > 0 && g_ascii_isspace(definition->text[definition->length - 1]))
+    definition->length--;
+  return definition;
+}
+
+static void free_create_table_definition(gpointer data){
+  struct create_table_definition *definition=data;
+  guint i;
+  g_free(definition->name);
+  g_free(definition->column_type);
+  if (definition->key_parts != NULL){
+    for (i=0; i < definition->key_parts->len; i++)
+      g_free(g_array_index(definition->key_parts, struct create_table_key_part, i).column);
+    g_array_free(definition->key_parts, TRUE);
+  }
+  g_free(definition);
+}
+
+void free_create_table(struct create_table *ct){
+  g_free(ct->database);
+  g_free(ct->table);
+  g_free(ct->engine);
+  g_ptr_array_free(ct->definitions, TRUE);
+  g_free(ct);
+}
+
+// Returns NULL when the statement is not a CREATE TABLE with definitions,
+// like CREATE TABLE ... LIKE, which then has to be used as it is
+struct create_table *parse_create_table(const gchar *statement, gchar quote){
+  struct sql_tokenizer tk={ statement, statement + strlen(statement), quote };
+  struct sql_token token;
+  struct create_table *ct=g_new0(struct create_table, 1);
+  ct->definitions=g_ptr_array_new_with_free_func(free_create_table_definition);
+  if (!parse_create_table_name(&tk, &token, &(ct->database), &(ct->table)) || !token_is_symbol(&token, '('))
+    goto not_parsed;
+  ct->header=statement;
+  ct->header_length=tk.p - statement;
+  next_token(&tk, &token);
+  while (token.type != SQL_TOKEN_END && !token_is_symbol(&token, ')')){
+    g_ptr_array_add(ct->definitions, parse_definition(&tk, &token));
+    if (token_is_symbol(&token, ','))
+      next_token(&tk, &token);
+  }
+  if (token.type == SQL_TOKEN_END || ct->definitions->len == 0)
+    goto not_parsed;
+  ct->options=token.start;
+  for (next_token(&tk, &token); token.type != SQL_TOKEN_END; next_token(&tk, &token)){
+    if (token_is(&token, "ENGINE")){
+      next_token(&tk, &token);
+      if (token_is_symbol(&token, '='))
+        next_token(&tk, &token);
+      if (token_is_name(&token))
+        ct->engine=token_to_name(&token);
+    }
+  }
+  return ct;
+
+not_parsed:
+  free_create_table(ct);
+  return NULL;
+}
+
+gboolean is_key_definition(struct create_table_definition *definition){
+  return definition->type == CREATE_TABLE_KEY || definition->type == CREATE_TABLE_UNIQUE_KEY ||
+         definition->type == CREATE_TABLE_FULLTEXT_KEY || definition->type == CREATE_TABLE_SPATIAL_KEY;
+}
+
+void append_create_table_definition(GString *str, struct create_table_definition *definition){
+  g_string_append_len(str, definition->text, definition->length);
+}
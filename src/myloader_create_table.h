@@ -0,0 +1,85 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+
+#ifndef _src_myloader_create_table_h
+#define _src_myloader_create_table_h
+
+#include <glib.h>
+
+enum sql_token_type {
+  SQL_TOKEN_END,
+  SQL_TOKEN_WORD,
+  SQL_TOKEN_IDENTIFIER,
+  SQL_TOKEN_STRING,
+  SQL_TOKEN_SYMBOL
+};
+
+// A token points into the statement, nothing is copied
+struct sql_token {
+  enum sql_token_type type;
+  const gchar *start;
+  gsize length;
+};
+
+enum create_table_definition_type {
+  CREATE_TABLE_COLUMN,
+  CREATE_TABLE_PRIMARY_KEY,
+  CREATE_TABLE_KEY,
+  CREATE_TABLE_UNIQUE_KEY,
+  CREATE_TABLE_FULLTEXT_KEY,
+  CREATE_TABLE_SPATIAL_KEY,
+  CREATE_TABLE_FOREIGN_KEY,
+  CREATE_TABLE_CHECK,
+  CREATE_TABLE_OTHER
+};
+
+// column is NULL for the expressions of the functional key parts
+struct create_table_key_part {
+  gchar *column;
+  guint prefix_length;
+};
+
+// text is the definition as it is in the statement, without the comma
+struct create_table_definition {
+  enum create_table_definition_type type;
+  const gchar *text;
+  gsize length;
+  gchar *name;
+  gchar *column_type;
+  gboolean auto_increment;
+  GArray *key_parts;
+};
+
+// header is from the start of the statement to the parenthesis that opens
+// the definitions, options from the one that closes them to the end
+struct create_table {
+  gchar *database;
+  gchar *table;
+  const gchar *header;
+  gsize header_length;
+  const gchar *options;
+  GPtrArray *definitions;
+  gchar *engine;
+};
+
+struct create_table *parse_create_table(const gchar *statement, gchar quote);
+void free_create_table(struct create_table *ct);
+gchar *get_create_table_name(const gchar *statement, gchar quote);
+gboolean is_key_definition(struct create_table_definition *definition);
+void append_create_table_definition(GString *str, struct create_table_definition *definition);
+
+#endif
@@ -23,10 +23,45 @@
 #include "myloader_common.h"
 #include <string.h>
 #include "myloader_global.h"
+#include "manifest.h"
+#include "myloader_stripe.h"
+
+static enum file_type get_file_type_from_manifest(enum manifest_file_type type){
+  switch (type){
+    case MANIFEST_SCHEMA_TABLESPACE: return SCHEMA_TABLESPACE;
+    case MANIFEST_SCHEMA_CREATE:     return SCHEMA_CREATE;
+    case MANIFEST_SCHEMA_TABLE:      return SCHEMA_TABLE;
+    case MANIFEST_DATA:              return DATA;
+    case MANIFEST_LOAD_DATA:         return LOAD_DATA;
+    case MANIFEST_METADATA_TABLE:    return METADATA_TABLE;
+    case MANIFEST_SCHEMA_SEQUENCE:   return SCHEMA_SEQUENCE;
+    case MANIFEST_SCHEMA_VIEW:       return SCHEMA_VIEW;
+    case MANIFEST_SCHEMA_TRIGGER:    return SCHEMA_TRIGGER;
+    case MANIFEST_SCHEMA_POST:       return SCHEMA_POST;
+    case MANIFEST_CHECKSUM:          return CHECKSUM;
+    case MANIFEST_METADATA_GLOBAL:   return METADATA_GLOBAL;
+    default:                         return INIT;
+  }
+}
+
+static void enqueue_manifest_entry(enum manifest_file_type type, const gchar *filename, const gchar *volume,
+                                   const gchar *database, const gchar *table, guint part, guint sub_part,
+                                   guint64 size, guint64 table_rows, gpointer user_data){
+  (void)user_data;
+  enum file_type ft=get_file_type_from_manifest(type);
+  if (volume != NULL)
+    add_stripe_file(filename, volume);
+  // Only the data files are not parsed again, they are most of the files
+  if (ft == DATA && database != NULL && table != NULL)
+    intermediate_queue_new_from_manifest(g_strdup(filename), ft, g_strdup(database), g_strdup(table), part, sub_part, size, table_rows);
+  else
+    intermediate_queue_new_from_manifest(g_strdup(filename), ft, NULL, NULL, 0, 0, 0, 0);
+}
 
 void *process_directory(struct configuration *conf){
   GError *error = NULL;
   const gchar *filename = NULL;
+  gchar *manifest_path = g_build_filename(directory, MANIFEST_FILENAME, NULL);
   if (resume){
     g_message("Using resume file");
     FILE *file = g_fopen("resume", "r");
@@ -49,12 +84,20 @@ void *process_directory(struct configuration *conf){
       g_string_set_size(data, 0);
     } 
     fclose(file);
+  }else if (!ignore_manifest && g_file_test(manifest_path, G_FILE_TEST_IS_REGULAR) &&
+             read_manifest(directory, get_stripe_volumes(), enqueue_manifest_entry, NULL)){
+    g_message("Using manifest");
   }else{
     GDir *dir = g_dir_open(directory, 0, &error);
     while ((filename = g_dir_read_name(dir))){
       intermediate_queue_new(g_strdup(filename));
     }
+    GPtrArray *volume_files=get_stripe_volume_files();
+    guint i;
+    for (i=0; volume_files != NULL && i < volume_files->len; i++)
+      intermediate_queue_new(g_strdup(g_ptr_array_index(volume_files, i)));
   }
+  g_free(manifest_path);
   intermediate_queue_end();
   guint n=0;
   for (n = 0; n < num_threads ; n++) {
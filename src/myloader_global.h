@@ -26,6 +26,7 @@ extern gboolean debug;
 
 extern gboolean disable_redo_log;
 extern gchar *purge_mode_str;
+extern gchar *transaction_size_str;
 extern GString *set_global;
 extern GString *set_global_back;
 extern gchar *defaults_file;
@@ -52,6 +53,7 @@ extern gboolean stream;
 extern gchar *compress_extension;
 extern gchar *db;
 extern gchar *directory;
+extern gboolean pmm;
 extern gchar *pmm_path;
 extern gchar *pmm_resolution ;
 extern gchar *set_names_str;
@@ -65,10 +67,20 @@ extern GString *set_session;
 extern guint commit_count;
 extern guint errors;
 extern guint max_threads_for_index_creation;
+extern guint max_threads_total;
+extern gboolean no_multi_statements;
+extern gboolean ignore_manifest;
+extern gchar *stripe_directories;
+extern guint64 min_transaction_size;
+extern guint64 max_transaction_size;
+extern guint commit_latency_target;
+extern guint retry_count;
+extern gint data_threads_running;
 extern guint max_threads_per_table;
 extern guint num_threads;
 extern guint rows;
 extern unsigned long long int total_data_sql_files;
+extern unsigned long long int progress;
 extern int detected_server;
 extern int (*m_close)(void *file);
 extern int (*m_write)(FILE * file, const char * buff, int len);
@@ -46,6 +46,21 @@ void intermediate_queue_new(gchar *filename){
   g_async_queue_push(intermediate_queue, iflnm);
 }
 
+void intermediate_queue_new_from_manifest(gchar *filename, enum file_type file_type, gchar *database, gchar *table,
+                                          guint part, guint sub_part, guint64 size, guint64 table_rows){
+  struct intermediate_filename * iflnm=g_new0(struct intermediate_filename, 1);
+  iflnm->filename = filename;
+  iflnm->iterations=0;
+  iflnm->file_type=file_type;
+  iflnm->database=database;
+  iflnm->table=table;
+  iflnm->part=part;
+  iflnm->sub_part=sub_part;
+  iflnm->size=size;
+  iflnm->rows=table_rows;
+  g_async_queue_push(intermediate_queue, iflnm);
+}
+
 void intermediate_queue_end(){
   gchar *e=g_strdup("END");
   intermediate_queue_new(e);
@@ -63,9 +78,10 @@ void intermediate_queue_incomplete(struct intermediate_filename * iflnm){
   g_async_queue_push(intermediate_queue, iflnm);
 }
 
-enum file_type process_filename(char *filename){
+enum file_type process_filename(struct intermediate_filename *iflnm){
+  gchar *filename=iflnm->filename;
 //  g_message("Filename: %s", filename);
-  enum file_type ft= get_file_type(filename);
+  enum file_type ft= iflnm->file_type != INIT ? iflnm->file_type : get_file_type(filename);
   if (!source_db ||
     g_str_has_prefix(filename, g_strdup_printf("%s.", source_db)) ||
     g_str_has_prefix(filename, g_strdup_printf("%s-schema-post.sql", source_db)) ||
@@ -127,7 +143,10 @@ enum file_type process_filename(char *filename){
         break;
       case DATA:
         if (!no_data){
-          if (!process_data_filename(filename))
+          if (iflnm->database != NULL && iflnm->table != NULL){
+            if (!process_data_file(filename, iflnm->database, iflnm->table, iflnm->part, iflnm->sub_part, iflnm->size, iflnm->rows))
+              return DO_NOT_ENQUEUE;
+          }else if (!process_data_filename(filename))
             return DO_NOT_ENQUEUE;
         }else
           m_remove(directory,filename);
@@ -158,7 +177,7 @@ enum file_type process_filename(char *filename){
 }
 
 void process_stream_filename(struct intermediate_filename  * iflnm){
-  enum file_type current_ft=process_filename(iflnm->filename);
+  enum file_type current_ft=process_filename(iflnm);
   if (current_ft == INCOMPLETE ){
     if (iflnm->iterations > 5){
       g_warning("Max renqueing reached for: %s", iflnm->filename);
@@ -222,6 +241,8 @@ void *intermediate_thread(){
 //  if (innodb_optimize_keys_all_tables)
 //    enqueue_all_index_jobs(intermediate_conf);
   g_message("Intermediate thread ended");
+  // The sizes of the tables are complete now
+  refresh_table_list(intermediate_conf);
   refresh_db_and_jobs(INTERMEDIATE_ENDED);
   return NULL;
 }
@@ -19,9 +19,20 @@
 struct intermediate_filename{
   gchar * filename;
   guint iterations;
+  // Known when the filename comes from the manifest, file_type is INIT
+  // when it has to be found from the filename
+  enum file_type file_type;
+  gchar *database;
+  gchar *table;
+  guint part;
+  guint sub_part;
+  guint64 size;
+  guint64 rows;
 };
 
 void intermediate_queue_incomplete(struct intermediate_filename * iflnm);
 void intermediate_queue_end();
 void intermediate_queue_new(gchar *filename);
+void intermediate_queue_new_from_manifest(gchar *filename, enum file_type file_type, gchar *database, gchar *table,
+                                          guint part, guint sub_part, guint64 size, guint64 table_rows);
 void initialize_intermediate_queue (struct configuration *c);
@@ -34,6 +34,8 @@
 #include "connection.h"
 #include <errno.h>
 #include "myloader_global.h"
+#include "myloader_pmm_thread.h"
+#include "myloader_local_infile.h"
 
 static GMutex *init_mutex=NULL;
 //static GMutex *index_mutex=NULL;
@@ -112,6 +114,8 @@ void *loader_thread(struct thread_data *td) {
   td->current_database=NULL;
 
   m_connect(td->thrconn, "myloader", NULL);
+  set_local_infile_handler(td->thrconn);
+  enable_multi_statements(td->thrconn);
 
 //  mysql_query(td->thrconn, set_names_statement);
 
@@ -166,6 +170,8 @@ void *loader_thread(struct thread_data *td) {
 
   if (td->thrconn)
     mysql_close(td->thrconn);
+  if (td->transaction)
+    g_ptr_array_free(td->transaction, TRUE);
   mysql_thread_end();
   g_debug("Thread %d: ending", td->thread_id);
   return NULL;
@@ -177,10 +183,13 @@ struct thread_data *td = NULL;
 void initialize_loader_threads(struct configuration *conf){
   guint n=0;
   threads = g_new(GThread *, num_threads);
-  td = g_new(struct thread_data, num_threads);
+  td = g_new0(struct thread_data, num_threads);
+  if (pmm)
+    register_pmm_threads("loader", td, num_threads);
   for (n = 0; n < num_threads; n++) {
     td[n].conf = conf;
     td[n].thread_id = n + 1;
+    td[n].trace = new_trace_buffer("loader", n + 1);
     threads[n] =
         g_thread_create((GThreadFunc)loader_thread, &td[n], TRUE, NULL);
     // Here, the ready queue is being used to serialize the connection to the database.
@@ -201,6 +210,8 @@ void wait_loader_threads_to_finish(){
 }
 
 void free_loader_threads(){
+  if (pmm)
+    unregister_pmm_threads(td);
   g_free(td);
   g_free(threads);
 }
@@ -0,0 +1,186 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+#include <mysql.h>
+#include <glib.h>
+#include <string.h>
+#include "common.h"
+#include "connection.h"
+#include "myloader.h"
+#include "myloader_lag_pacing.h"
+#include "myloader_global.h"
+
+guint replica_lag_target=0;
+gchar *replica_lag_host=NULL;
+guint replica_lag_port=0;
+gchar *replica_lag_query=NULL;
+
+static MYSQL *lag_conn=NULL;
+static GThread *lag_thread=NULL;
+static gboolean lag_pacing_running=FALSE;
+static GMutex *lag_mutex=NULL;
+static GCond *lag_cond=NULL;
+static gint active_threads=0;
+static gint transaction_divisor=1;
+
+static gboolean get_lag_from_query(gdouble *lag){
+  if (mysql_query(lag_conn, replica_lag_query)){
+    g_warning("Replica lag query failed: %s", mysql_error(lag_conn));
+    return FALSE;
+  }
+  MYSQL_RES *res=mysql_store_result(lag_conn);
+  if (res == NULL)
+    return FALSE;
+  MYSQL_ROW row=mysql_fetch_row(res);
+  gboolean found=row != NULL && row[0] != NULL;
+  if (found)
+    *lag=g_ascii_strtod(row[0], NULL);
+  mysql_free_result(res);
+  return found;
+}
+
+// The lag is unknown while the replication threads are stopped
+static gboolean get_lag_from_replica_status(gdouble *lag){
+  if (mysql_query(lag_conn, "SHOW REPLICA STATUS") && mysql_query(lag_conn, "SHOW SLAVE STATUS")){
+    g_warning("Replica status failed: %s", mysql_error(lag_conn));
+    return FALSE;
+  }
+  MYSQL_RES *res=mysql_store_result(lag_conn);
+  if (res == NULL)
+    return FALSE;
+  MYSQL_ROW row;
+  MYSQL_FIELD *fields=mysql_fetch_fields(res);
+  gboolean found=FALSE;
+  guint i;
+  *lag=0;
+  while ((row=mysql_fetch_row(res))){
+    for (i=0; i < mysql_num_fields(res); i++){
+      if (row[i] != NULL && (!g_ascii_strcasecmp(fields[i].name, "Seconds_Behind_Source") || !g_ascii_strcasecmp(fields[i].name, "Seconds_Behind_Master"))){
+        *lag=MAX(*lag, g_ascii_strtod(row[i], NULL));
+        found=TRUE;
+      }
+    }
+  }
+  mysql_free_result(res);
+  return found;
+}
+
+static void set_pacing(gint threads, gint divisor){
+  g_mutex_lock(lag_mutex);
+  g_atomic_int_set(&active_threads, threads);
+  g_atomic_int_set(&transaction_divisor, divisor);
+  g_cond_broadcast(lag_cond);
+  g_mutex_unlock(lag_mutex);
+}
+
+// A lost connection is found by the ping, the next check uses the new one
+static void check_lag_conn(){
+  if (!mysql_ping(lag_conn))
+    return;
+  g_warning("Replica lag connection lost: %s, reconnecting", mysql_error(lag_conn));
+  mysql_close(lag_conn);
+  lag_conn=mysql_init(NULL);
+  if (!m_try_connect_to_host(lag_conn, "myloader", replica_lag_host, replica_lag_port))
+    g_warning("Could not reconnect to check the replica lag: %s", mysql_error(lag_conn));
+}
+
+static void *lag_pacing_thread(void *data){
+  (void)data;
+  gdouble lag=0;
+  gboolean known;
+  guint unknown_checks=0;
+  gint threads, divisor;
+  while (g_atomic_int_get(&lag_pacing_running)){
+    g_usleep(LAG_PACING_INTERVAL);
+    threads=g_atomic_int_get(&active_threads);
+    divisor=g_atomic_int_get(&transaction_divisor);
+    known=replica_lag_query != NULL ? get_lag_from_query(&lag) : get_lag_from_replica_status(&lag);
+    if (known){
+      unknown_checks=0;
+    }else{
+      check_lag_conn();
+      unknown_checks++;
+      // The paused threads hold a job each, they can not wait for a lag that
+      // might never be known again
+      if (unknown_checks == LAG_PACING_MAX_UNKNOWN)
+        g_warning("Replica lag unknown for %u checks, adding the threads back", unknown_checks);
+    }
+    if (known && lag > replica_lag_target){
+      threads=MAX(threads / 2, 1);
+      divisor=MIN(divisor * 2, LAG_PACING_MAX_DIVISOR);
+    }else if ((known && lag < replica_lag_target * LAG_PACING_RECOVER) || unknown_checks >= LAG_PACING_MAX_UNKNOWN){
+      threads=MIN(threads + 1, (gint)num_threads);
+      divisor=MAX(divisor / 2, 1);
+    }
+    if (threads != g_atomic_int_get(&active_threads) || divisor != g_atomic_int_get(&transaction_divisor))
+      g_message("Replica lag %.0fs: %d threads restoring, transactions divided by %d", lag, threads, divisor);
+    // Also wakes up the paused threads when a shutdown has been triggered
+    set_pacing(threads, divisor);
+  }
+  return NULL;
+}
+
+void start_lag_pacing(){
+  active_threads=num_threads;
+  transaction_divisor=1;
+  if (replica_lag_target == 0)
+    return;
+  if (replica_lag_host == NULL && replica_lag_query == NULL)
+    m_critical("--replica-lag-target needs --replica-lag-host or --replica-lag-query");
+  lag_conn=mysql_init(NULL);
+  if (replica_lag_host != NULL)
+    m_connect_to_host(lag_conn, "myloader", replica_lag_host, replica_lag_port);
+  else
+    m_connect(lag_conn, "myloader", NULL);
+  lag_mutex=g_mutex_new();
+  lag_cond=g_cond_new();
+  lag_pacing_running=TRUE;
+  lag_thread=g_thread_create(lag_pacing_thread, NULL, TRUE, NULL);
+}
+
+void stop_lag_pacing(){
+  if (lag_thread == NULL)
+    return;
+  g_atomic_int_set(&lag_pacing_running, FALSE);
+  g_thread_join(lag_thread);
+  lag_thread=NULL;
+  set_pacing(num_threads, 1);
+  mysql_close(lag_conn);
+  lag_conn=NULL;
+}
+
+// Called by the loader threads before each job, next to the pause_resume
+// check. Threads over the active count wait until the lag allows them again.
+void wait_for_lag_pacing(struct thread_data *td){
+  if (lag_thread == NULL || (gint)td->thread_id <= g_atomic_int_get(&active_threads))
+    return;
+  g_mutex_lock(lag_mutex);
+  if ((gint)td->thread_id > g_atomic_int_get(&active_threads) && !shutdown_triggered){
+    g_message("Thread %d: Paused by replica lag", td->thread_id);
+    while ((gint)td->thread_id > g_atomic_int_get(&active_threads) && !shutdown_triggered)
+      g_cond_wait(lag_cond, lag_mutex);
+    g_message("Thread %d: Resumed", td->thread_id);
+  }
+  g_mutex_unlock(lag_mutex);
+}
+
+guint get_paced_commit_count(){
+  return MAX(commit_count / g_atomic_int_get(&transaction_divisor), 1);
+}
+
+guint64 get_paced_transaction_size(guint64 transaction_size){
+  return transaction_size / g_atomic_int_get(&transaction_divisor);
+}
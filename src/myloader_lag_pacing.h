@@ -0,0 +1,40 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+#ifndef _src_myloader_lag_pacing_h
+#define _src_myloader_lag_pacing_h
+#include "myloader.h"
+
+// The lag is checked every LAG_PACING_INTERVAL microseconds. Over the target,
+// the active threads are halved and the transactions made smaller; under
+// LAG_PACING_RECOVER of the target, one thread is added back.
+#define LAG_PACING_INTERVAL 2000000
+#define LAG_PACING_RECOVER 0.5
+#define LAG_PACING_MAX_DIVISOR 16
+// Consecutive checks without a lag after which it is handled as recovered
+#define LAG_PACING_MAX_UNKNOWN 5
+
+extern guint replica_lag_target;
+extern gchar *replica_lag_host;
+extern guint replica_lag_port;
+extern gchar *replica_lag_query;
+
+void start_lag_pacing();
+void stop_lag_pacing();
+void wait_for_lag_pacing(struct thread_data *td);
+guint get_paced_commit_count();
+guint64 get_paced_transaction_size(guint64 transaction_size);
+#endif
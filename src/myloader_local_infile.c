@@ -0,0 +1,159 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+
+#include <mysql.h>
+#include <errmsg.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include "common.h"
+#include "myloader_local_infile.h"
+#include "myloader_stripe.h"
+
+// LOAD DATA LOCAL INFILE reads every file through these callbacks. Files
+// written with --format=binary are transcoded into the default LOAD DATA
+// format (tab separated, \N for NULL), any other file is sent as it is.
+struct local_infile {
+  FILE *file;
+  gboolean binary;
+  GString *out;
+  gsize out_pos;
+  GString *value;
+  gchar error[256];
+};
+
+static int local_infile_fail(struct local_infile *li, const gchar *message){
+  g_strlcpy(li->error, message, sizeof(li->error));
+  return -1;
+}
+
+static int local_infile_init(void **ptr, const char *filename, void *userdata){
+  (void) userdata;
+  struct local_infile *li=g_new0(struct local_infile, 1);
+  gchar magic[BINARY_FORMAT_MAGIC_LENGTH];
+  size_t r;
+  *ptr=li;
+  li->out=g_string_sized_new(STREAM_BUFFER_SIZE);
+  li->value=g_string_new("");
+  // The data file can be in one of the --stripe-directories
+  gchar *path=build_stripe_path(filename);
+  li->file=g_fopen(path, "rb");
+  g_free(path);
+  if (!li->file){
+    g_snprintf(li->error, sizeof(li->error), "Could not open %s: %s", filename, g_strerror(errno));
+    return 1;
+  }
+  r=fread(magic, 1, BINARY_FORMAT_MAGIC_LENGTH, li->file);
+  if (r == BINARY_FORMAT_MAGIC_LENGTH && !memcmp(magic, BINARY_FORMAT_MAGIC, BINARY_FORMAT_MAGIC_LENGTH))
+    li->binary=TRUE;
+  else
+    // It might be a fifo, so the bytes that are already read must be sent
+    g_string_append_len(li->out, magic, r);
+  return 0;
+}
+
+static void append_escaped_value(GString *out, const gchar *value, gsize length){
+  const gchar *end=value+length;
+  for (; value < end; value++){
+    switch (*value){
+      case '\\': g_string_append(out, "\\\\"); break;
+      case '\t': g_string_append(out, "\\t"); break;
+      case '\n': g_string_append(out, "\\n"); break;
+      case '\0': g_string_append(out, "\\0"); break;
+      default: g_string_append_c(out, *value);
+    }
+  }
+}
+
+// Returns 1 when a row was appended, 0 at the end of the file and -1 on error
+static int transcode_row(struct local_infile *li){
+  guint16 column_count, i;
+  guint8 type;
+  guint32 length;
+  size_t r=fread(&column_count, 1, sizeof(column_count), li->file);
+  if (r == 0 && feof(li->file))
+    return 0;
+  if (r != sizeof(column_count))
+    return local_infile_fail(li, "Truncated row in binary data file");
+  column_count=GUINT16_FROM_LE(column_count);
+  for (i=0; i < column_count; i++){
+    if (fread(&type, 1, sizeof(type), li->file) != sizeof(type) ||
+        fread(&length, 1, sizeof(length), li->file) != sizeof(length))
+      return local_infile_fail(li, "Truncated column in binary data file");
+    if (i > 0)
+      g_string_append_c(li->out, '\t');
+    length=GUINT32_FROM_LE(length);
+    if (length == BINARY_FORMAT_NULL_LENGTH){
+      g_string_append(li->out, "\\N");
+      continue;
+    }
+    g_string_set_size(li->value, length);
+    if (fread(li->value->str, 1, length, li->file) != length)
+      return local_infile_fail(li, "Truncated value in binary data file");
+    append_escaped_value(li->out, li->value->str, length);
+  }
+  g_string_append_c(li->out, '\n');
+  return 1;
+}
+
+static int local_infile_read(void *ptr, char *buf, unsigned int buf_len){
+  struct local_infile *li=ptr;
+  gsize pending;
+  int r;
+  if (li->out_pos == li->out->len){
+    g_string_set_size(li->out, 0);
+    li->out_pos=0;
+    if (!li->binary){
+      r=fread(buf, 1, buf_len, li->file);
+      if (r == 0 && ferror(li->file))
+        return local_infile_fail(li, g_strerror(errno));
+      return r;
+    }
+    while (li->out->len < buf_len){
+      r=transcode_row(li);
+      if (r < 0)
+        return r;
+      if (r == 0)
+        break;
+    }
+  }
+  pending=MIN(li->out->len - li->out_pos, buf_len);
+  memcpy(buf, li->out->str + li->out_pos, pending);
+  li->out_pos+=pending;
+  return pending;
+}
+
+static void local_infile_end(void *ptr){
+  struct local_infile *li=ptr;
+  if (li->file)
+    fclose(li->file);
+  g_string_free(li->out, TRUE);
+  g_string_free(li->value, TRUE);
+  g_free(li);
+}
+
+static int local_infile_error(void *ptr, char *error_msg, unsigned int error_msg_len){
+  struct local_infile *li=ptr;
+  g_strlcpy(error_msg, li->error, error_msg_len);
+  return CR_UNKNOWN_ERROR;
+}
+
+void set_local_infile_handler(MYSQL *conn){
+  mysql_set_local_infile_handler(conn, local_infile_init, local_infile_read, local_infile_end, local_infile_error, NULL);
+}
@@ -17,6 +17,7 @@
 
 #include <stddef.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include <glib.h>
 #include <glib/gstdio.h>
@@ -27,26 +28,195 @@
 #include "myloader_global.h"
 
 gint kill_pmm = 0;
+static GMutex *pmm_groups_mutex = NULL;
+static GList *pmm_groups = NULL;
+static gint64 pmm_start_time = 0;
+// Data files restored by every thread, the schema files are not included
+static guint64 pmm_data_files_done = 0;
+
+// A group of threads sharing the same role. When the threads are freed their
+// counters are folded into retired, so totals keep being monotonic.
+struct pmm_thread_group {
+  const gchar *kind;
+  struct thread_data *td;
+  guint n;
+  struct thread_stats retired;
+};
 
 void kill_pmm_thread(){
   kill_pmm=1;
 }
 
+void initialize_pmm(){
+  pmm_groups_mutex=g_mutex_new();
+}
+
+void merge_thread_stats(struct thread_stats *to, struct thread_stats *from){
+  to->rows+=from->rows;
+  to->statements+=from->statements;
+  to->bytes+=from->bytes;
+  to->files+=from->files;
+  to->data_files+=from->data_files;
+  to->commits+=from->commits;
+  to->retries+=from->retries;
+  to->read_time+=from->read_time;
+  to->query_time+=from->query_time;
+  to->commit_time+=from->commit_time;
+  histogram_merge(&(to->query_latency), &(from->query_latency));
+  histogram_merge(&(to->commit_latency), &(from->commit_latency));
+}
+
+void register_pmm_threads(const gchar *kind, struct thread_data *td, guint n){
+  struct pmm_thread_group *g=g_new0(struct pmm_thread_group, 1);
+  g->kind=kind;
+  g->td=td;
+  g->n=n;
+  g_mutex_lock(pmm_groups_mutex);
+  pmm_groups=g_list_append(pmm_groups, g);
+  g_mutex_unlock(pmm_groups_mutex);
+}
+
+void unregister_pmm_threads(struct thread_data *td){
+  GList *l=NULL;
+  guint n=0;
+  g_mutex_lock(pmm_groups_mutex);
+  for (l=pmm_groups; l != NULL; l=l->next){
+    struct pmm_thread_group *g=l->data;
+    if (g->td == td){
+      for (n=0; n < g->n; n++)
+        merge_thread_stats(&(g->retired), &(g->td[n].stats));
+      g->td=NULL;
+      g->n=0;
+    }
+  }
+  g_mutex_unlock(pmm_groups_mutex);
+}
+
 void append_pmm_entry(GString *content, const gchar *key, GAsyncQueue * queue){
   if (queue != NULL)
     g_string_append_printf(content,"myloader_queue{name=\"%s\"} %d\n",key,g_async_queue_length(queue));
 }
 
+struct pmm_counter {
+  const gchar *name;
+  gsize offset;
+};
+
+static struct pmm_counter pmm_counters[] = {
+  { "statements", G_STRUCT_OFFSET(struct thread_stats, statements) },
+  { "rows",       G_STRUCT_OFFSET(struct thread_stats, rows) },
+  { "bytes",      G_STRUCT_OFFSET(struct thread_stats, bytes) },
+  { "files",      G_STRUCT_OFFSET(struct thread_stats, files) },
+  { "data_files", G_STRUCT_OFFSET(struct thread_stats, data_files) },
+  { "commits",    G_STRUCT_OFFSET(struct thread_stats, commits) },
+  { "retries",    G_STRUCT_OFFSET(struct thread_stats, retries) },
+  { NULL, 0 }
+};
+
+#define PMM_COUNTER(s,c) (*(guint64 *)((gchar *)(s) + (c)->offset))
+
+// Every metric family has to be written contiguously, so we loop over the
+// metrics first and over the thread groups after.
+void append_pmm_entry_threads(GString *content){
+  GList *l=NULL;
+  guint n=0, i=0, groups=0;
+  gchar labels[64], name[64];
+  struct pmm_counter *c=NULL;
+  g_mutex_lock(pmm_groups_mutex);
+  groups=g_list_length(pmm_groups);
+  struct thread_stats *total=g_new0(struct thread_stats, groups + 1);
+  for (l=pmm_groups, i=0; l != NULL; l=l->next, i++){
+    struct pmm_thread_group *g=l->data;
+    merge_thread_stats(&(total[i]), &(g->retired));
+    for (n=0; n < g->n; n++)
+      merge_thread_stats(&(total[i]), &(g->td[n].stats));
+    merge_thread_stats(&(total[groups]), &(total[i]));
+  }
+  for (c=pmm_counters; c->name != NULL; c++){
+    g_snprintf(name, sizeof(name), "myloader_thread_%s_total", c->name);
+    append_metric_type(content, name, "counter");
+    for (l=pmm_groups; l != NULL; l=l->next){
+      struct pmm_thread_group *g=l->data;
+      for (n=0; n < g->n; n++){
+        g_snprintf(labels, sizeof(labels), "kind=\"%s\",thread=\"%d\"", g->kind, g->td[n].thread_id);
+        append_metric_counter(content, name, labels, PMM_COUNTER(&(g->td[n].stats), c));
+      }
+    }
+    g_snprintf(name, sizeof(name), "myloader_%s_total", c->name);
+    append_metric_type(content, name, "counter");
+    for (l=pmm_groups, i=0; l != NULL; l=l->next, i++){
+      g_snprintf(labels, sizeof(labels), "kind=\"%s\"", ((struct pmm_thread_group *)l->data)->kind);
+      append_metric_counter(content, name, labels, PMM_COUNTER(&(total[i]), c));
+    }
+  }
+  append_metric_type(content, "myloader_thread_time_seconds_total", "counter");
+  for (l=pmm_groups; l != NULL; l=l->next){
+    struct pmm_thread_group *g=l->data;
+    for (n=0; n < g->n; n++){
+      struct thread_stats *s=&(g->td[n].stats);
+      g_snprintf(labels, sizeof(labels), "kind=\"%s\",thread=\"%d\",stage=\"read\"", g->kind, g->td[n].thread_id);
+      append_metric_seconds(content, "myloader_thread_time_seconds_total", labels, s->read_time);
+      g_snprintf(labels, sizeof(labels), "kind=\"%s\",thread=\"%d\",stage=\"query\"", g->kind, g->td[n].thread_id);
+      append_metric_seconds(content, "myloader_thread_time_seconds_total", labels, s->query_time);
+      g_snprintf(labels, sizeof(labels), "kind=\"%s\",thread=\"%d\",stage=\"commit\"", g->kind, g->td[n].thread_id);
+      append_metric_seconds(content, "myloader_thread_time_seconds_total", labels, s->commit_time);
+    }
+  }
+  append_metric_type(content, "myloader_query_latency_seconds", "histogram");
+  for (l=pmm_groups, i=0; l != NULL; l=l->next, i++){
+    g_snprintf(labels, sizeof(labels), "kind=\"%s\"", ((struct pmm_thread_group *)l->data)->kind);
+    append_metric_histogram(content, "myloader_query_latency_seconds", labels, &(total[i].query_latency));
+  }
+  append_metric_histogram(content, "myloader_query_latency_seconds", "kind=\"all\"", &(total[groups].query_latency));
+  append_metric_type(content, "myloader_commit_latency_seconds", "histogram");
+  append_metric_histogram(content, "myloader_commit_latency_seconds", "kind=\"all\"", &(total[groups].commit_latency));
+  pmm_data_files_done=total[groups].data_files;
+  g_mutex_unlock(pmm_groups_mutex);
+  g_free(total);
+}
+
 void append_pmm_entry_tables(GString *content,struct configuration *conf){
-  (void) content;
   GHashTableIter iter;
   gchar * lkey;
+  gchar *labels=NULL;
+  GString *files_done=g_string_new("# TYPE myloader_table_files_done counter\n");
+  GString *files_remaining=g_string_new("# TYPE myloader_table_files_remaining gauge\n");
+  GString *current_threads=g_string_new("# TYPE myloader_table_current_threads gauge\n");
+  GString *schema_state=g_string_new("# TYPE myloader_table_schema_state gauge\n");
   if (conf->table_hash){
+    append_metric_type(content, "myloader_table_bytes_total", "counter");
+    g_mutex_lock(conf->table_hash_mutex);
     g_hash_table_iter_init ( &iter, conf->table_hash );
     struct db_table *dbt=NULL;
     while ( g_hash_table_iter_next ( &iter, (gpointer *) &lkey, (gpointer *) &dbt ) ) {
-//      g_string_append_printf(content,"myloader_table{name=\"%s\"} %d\n",lkey,stream?(guint)g_list_length(dbt->restore_job_list):(guint)g_async_queue_length(dbt->queue));
+      labels=g_strdup_printf("table=\"%s\"",lkey);
+      append_metric_counter(content, "myloader_table_bytes_total", labels, dbt->bytes);
+      append_metric_counter(files_done, "myloader_table_files_done", labels, (gint)dbt->count > dbt->remaining_jobs ? (guint64)((gint)dbt->count - dbt->remaining_jobs) : 0);
+      append_metric_gauge(files_remaining, "myloader_table_files_remaining", labels, dbt->remaining_jobs);
+      append_metric_gauge(current_threads, "myloader_table_current_threads", labels, dbt->current_threads);
+      append_metric_gauge(schema_state, "myloader_table_schema_state", labels, dbt->schema_state);
+      g_free(labels);
     }
+    g_mutex_unlock(conf->table_hash_mutex);
+    g_string_append(content, files_done->str);
+    g_string_append(content, files_remaining->str);
+    g_string_append(content, current_threads->str);
+    g_string_append(content, schema_state->str);
+  }
+  g_string_free(files_done, TRUE);
+  g_string_free(files_remaining, TRUE);
+  g_string_free(current_threads, TRUE);
+  g_string_free(schema_state, TRUE);
+  // Only data files are compared against total_data_sql_files, the schema
+  // files would make the ETA too optimistic
+  guint64 done=pmm_data_files_done;
+  guint64 total=total_data_sql_files;
+  gdouble eta=estimate_remaining_seconds(done, total > done ? total - done : 0, g_get_monotonic_time() - pmm_start_time);
+  append_metric_type(content, "myloader_files_remaining", "gauge");
+  append_metric_gauge(content, "myloader_files_remaining", "", total > done ? total - done : 0);
+  if (eta >= 0){
+    append_metric_type(content, "myloader_eta_seconds", "gauge");
+    append_metric_gauge(content, "myloader_eta_seconds", "", eta);
   }
 }
 
@@ -61,6 +231,7 @@ void write_pmm_entries(const gchar* filename, GString *content, struct configura
   append_pmm_entry(content,"pause_resume",      conf->pause_resume);
   append_pmm_entry(content,"stream_queue",      conf->stream_queue);
   append_pmm_entry(content,"ready",             conf->ready);
+  append_pmm_entry_threads(content);
   append_pmm_entry_tables(content,conf);
   g_file_set_contents( filename , content->str, content->len, NULL);
 }
@@ -68,6 +239,7 @@ void write_pmm_entries(const gchar* filename, GString *content, struct configura
 void *pmm_thread(void *conf){
   const gchar* filename=g_strdup_printf("%s/myloader.prom",pmm_path);
   GString *content = g_string_sized_new(200);
+  pmm_start_time=g_get_monotonic_time();
   while (!kill_pmm){
     write_pmm_entries(filename, content, (struct configuration*)conf);
     sleep(1);
@@ -17,3 +17,6 @@
 
 void *pmm_thread(void *data);
 void kill_pmm_thread();
+void initialize_pmm();
+void register_pmm_threads(const gchar *kind, struct thread_data *td, guint n);
+void unregister_pmm_threads(struct thread_data *td);
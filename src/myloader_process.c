@@ -34,6 +34,7 @@
 #include "myloader_control_job.h"
 #include "myloader_restore_job.h"
 #include "myloader_global.h"
+#include "myloader_create_table.h"
 
 GString *change_master_statement=NULL;
 gboolean append_if_not_exist=FALSE;
@@ -68,6 +69,7 @@ struct db_table* append_new_db_table(char * filename, gchar * database, gchar *t
       dbt->table=table;
       dbt->real_table=dbt->table;
       dbt->rows=number_rows;
+      dbt->bytes=0;
       dbt->restore_job_list = NULL;
 //      dbt->queue=g_async_queue_new();
       dbt->current_threads=0;
@@ -84,6 +86,11 @@ struct db_table* append_new_db_table(char * filename, gchar * database, gchar *t
       dbt->index_enqueued=FALSE;
       dbt->remaining_jobs = 0;
       dbt->constraints=NULL;
+      dbt->row_width=0;
+      dbt->index_key_width=0;
+      dbt->index_cost=0;
+      dbt->transaction_size=min_transaction_size;
+      dbt->data_size=0;
       dbt->count=0;
       g_hash_table_insert(conf->table_hash, lkey, dbt);
       refresh_table_list_without_table_hash_lock(conf);
@@ -142,7 +149,7 @@ void free_table_hash(GHashTable *table_hash){
 }
 
 struct control_job * load_schema(struct db_table *dbt, gchar *filename){
-  void *infile;
+  FILE *infile;
   gboolean is_compressed = FALSE;
   gboolean eof = FALSE;
   GString *data=g_string_sized_new(512);
@@ -150,13 +157,7 @@ struct control_job * load_schema(struct db_table *dbt, gchar *filename){
   g_string_set_size(data,0);
   g_string_set_size(create_table_statement,0);
   guint line=0;
-  if (!g_str_has_suffix(filename, compress_extension)) {
-    infile = g_fopen(filename, "r");
-    is_compressed = FALSE;
-  } else {
-    infile = (void *)gzopen(filename, "r");
-    is_compressed = TRUE;
-  }
+  ml_open(&infile,filename,&is_compressed);
   if (!infile) {
     g_critical("cannot open schema file %s (%d)", filename, errno);
     errors++;
@@ -166,14 +167,14 @@ struct control_job * load_schema(struct db_table *dbt, gchar *filename){
     if (read_data(infile, is_compressed, data, &eof,&line)) {
       if (g_strrstr(&data->str[data->len >= 5 ? data->len - 5 : 0], ";\n")) {
         if (g_strstr_len(data->str,13,"CREATE TABLE ")){
-          gchar** create_table= g_strsplit(data->str, identifier_quote_character_str, 3);
-          dbt->real_table=g_strdup(create_table[1]);
+          gchar *real_table=get_create_table_name(data->str, identifier_quote_character);
+          if (real_table != NULL)
+            dbt->real_table=real_table;
           if ( g_str_has_prefix(dbt->table,"mydumper_")){
             g_hash_table_insert(tbl_hash, dbt->table, dbt->real_table);
           }else{
             g_hash_table_insert(tbl_hash, dbt->real_table, dbt->real_table);
           }
-          g_strfreev(create_table);
           if (append_if_not_exist){
             if ((g_strstr_len(data->str,13,"CREATE TABLE ")) && !(g_strstr_len(data->str,15,"CREATE TABLE IF"))){
               GString *tmp_data=g_string_sized_new(data->len);
@@ -203,9 +204,10 @@ struct control_job * load_schema(struct db_table *dbt, gchar *filename){
                 g_string_free(alter_table_statement,TRUE);
                 alter_table_statement=NULL;
               }
-              g_string_append(create_table_statement,g_strjoinv("\n)",g_strsplit(new_create_table_statement->str,",\n)",-1)));
+              g_string_append_len(create_table_statement, new_create_table_statement->str, new_create_table_statement->len);
               dbt->indexes=alter_table_statement;
               if (flag & INCLUDE_CONSTRAINT){
+                finish_alter_table(alter_table_constraint_statement);
                 struct restore_job *rj = new_schema_restore_job(strdup(filename),JOB_RESTORE_STRING,dbt, dbt->database, alter_table_constraint_statement, "constraint");
                 g_async_queue_push(conf->post_table_queue, new_job(JOB_RESTORE,rj,dbt->database->real_database));
                 dbt->constraints=alter_table_constraint_statement;
@@ -218,6 +220,7 @@ struct control_job * load_schema(struct db_table *dbt, gchar *filename){
               g_string_free(alter_table_constraint_statement,TRUE);
               g_string_append(create_table_statement,data->str);
             }
+            g_string_free(new_create_table_statement,TRUE);
           }
         }else{
           g_string_append(create_table_statement,data->str);
@@ -572,18 +575,35 @@ gboolean process_data_filename(char * filename){
   if (db_name == NULL || table_name == NULL){
     m_critical("It was not possible to process file: %s (3)",filename);
   }
+  return process_data_file(filename, db_name, table_name, part, sub_part, 0, 0);
+}
+
+// Used when the dump has no manifest. It is the compressed size when the dump
+// is compressed, which still tells the large tables from the small ones.
+static guint64 get_data_file_size(const gchar *filename){
+  GStatBuf st;
+  gchar *path=g_build_filename(directory, filename, NULL);
+  guint64 size=g_stat(path, &st) == 0 ? (guint64)st.st_size : 0;
+  g_free(path);
+  return size;
+}
 
+// size and rows are 0 when they are not known, the rows are the ones of the table
+gboolean process_data_file(char * filename, gchar *db_name, gchar *table_name, guint part, guint sub_part, guint64 size, guint64 table_rows){
   struct database *real_db_name=get_db_hash(db_name,db_name);
   if (!eval_table(real_db_name->name, table_name, conf->table_list_mutex)){
     g_warning("Skiping table: `%s`.`%s`",real_db_name->name, table_name);
     return FALSE;
   }
 
-  struct db_table *dbt=append_new_db_table(filename, db_name, table_name,0,NULL);
+  struct db_table *dbt=append_new_db_table(filename, db_name, table_name,table_rows,NULL);
   struct restore_job *rj = new_data_restore_job( g_strdup(filename), JOB_RESTORE_FILENAME, dbt, part, sub_part);
+  if (size == 0)
+    size=get_data_file_size(filename);
   g_mutex_lock(dbt->mutex);
   g_atomic_int_add(&(dbt->remaining_jobs), 1);
   dbt->count++; 
+  dbt->data_size+=size;
   dbt->restore_job_list=g_list_insert_sorted(dbt->restore_job_list,rj,&cmp_restore_job);
 //  dbt->restore_job_list=g_list_append(dbt->restore_job_list,rj);
   g_mutex_unlock(dbt->mutex);
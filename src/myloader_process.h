@@ -25,6 +25,7 @@ gboolean process_metadata_filename(char * filename);
 gboolean process_schema_filename(gchar *filename, const char * object);
 //void process_data_filename(char * filename);
 gboolean process_data_filename(char * filename);
+gboolean process_data_file(char * filename, gchar *db_name, gchar *table_name, guint part, guint sub_part, guint64 size, guint64 table_rows);
 gboolean process_checksum_filename(char * filename);
 //struct job * new_job (enum job_type type, void *job_data, char *use_database);
 //struct db_table* append_new_db_table(char * filename, gchar * database, gchar *table, guint64 number_rows, GHashTable *table_hash, GString *alter_table_statement);
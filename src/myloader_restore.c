@@ -20,6 +20,7 @@
 #include <glib/gstdio.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 #ifdef ZWRAP_USE_ZSTD
 #include "../zstd/zstd_zlibwrapper.h"
 #else
@@ -32,41 +33,193 @@
 #include "myloader_common.h"
 #include "myloader_global.h"
 #include "connection.h"
+#include "myloader_restore.h"
+#include "myloader_lag_pacing.h"
+#include "myloader_local_infile.h"
+#include "myloader_stripe.h"
 gboolean skip_definer = FALSE;
+
+static void free_statement(gpointer data){
+  g_string_free(data, TRUE);
+}
+
+// The statements of the current transaction are kept until the COMMIT as the
+// server rolls all of them back on a deadlock or a disconnection
+static void remember_statement(struct thread_data *td, const gchar *statement, gsize len){
+  if (td->transaction == NULL)
+    td->transaction=g_ptr_array_new_with_free_func(free_statement);
+  g_ptr_array_add(td->transaction, g_string_new_len(statement, len));
+}
+
+static void forget_transaction(struct thread_data *td){
+  if (td->transaction != NULL)
+    g_ptr_array_set_size(td->transaction, 0);
+}
+
+// Additive increase and multiplicative decrease of the bytes per transaction
+// of the table, between the --transaction-size bounds.
+static void grow_transaction_size(struct db_table *dbt){
+  g_mutex_lock(dbt->mutex);
+  dbt->transaction_size=MIN(dbt->transaction_size + TRANSACTION_SIZE_STEP, max_transaction_size);
+  g_mutex_unlock(dbt->mutex);
+}
+
+static void shrink_transaction_size(struct db_table *dbt){
+  g_mutex_lock(dbt->mutex);
+  dbt->transaction_size=MAX(dbt->transaction_size / 2, min_transaction_size);
+  g_mutex_unlock(dbt->mutex);
+}
+
+static gboolean transaction_is_full(struct thread_data *td, guint query_counter){
+  if (query_counter >= get_paced_commit_count() || td->transaction_bytes >= TRANSACTION_REPLAY_SIZE)
+    return TRUE;
+  if (max_transaction_size == 0 || td->dbt == NULL)
+    return FALSE;
+  return td->transaction_bytes >= get_paced_transaction_size(td->dbt->transaction_size);
+}
+
+gboolean commit_and_measure(struct thread_data *td){
+  gint64 start=g_get_monotonic_time();
+  gboolean r=m_query(td->thrconn, "COMMIT", m_warning, "COMMIT failed");
+  gint64 elapsed=g_get_monotonic_time()-start;
+  td->stats.commit_time+=elapsed;
+  td->stats.commits++;
+  histogram_observe(&(td->stats.commit_latency), elapsed);
+  trace_span(td->trace, "commit", td->current_database, NULL, -1, start);
+  // Only full transactions tell if the server keeps up with the current size
+  if (max_transaction_size > 0 && td->dbt != NULL){
+    if (!r || elapsed > (gint64)commit_latency_target * 1000)
+      shrink_transaction_size(td->dbt);
+    else if (td->transaction_bytes >= td->dbt->transaction_size)
+      grow_transaction_size(td->dbt);
+  }
+  td->transaction_bytes=0;
+  forget_transaction(td);
+  return r;
+}
+
+static gboolean is_server_gone(guint en){
+  return en == CR_SERVER_GONE_ERROR || en == CR_SERVER_LOST;
+}
+
+// Errors after which the statement, or the whole transaction it was part of,
+// can be executed again
+static gboolean is_retryable_error(guint en){
+  return en == 1205 || en == 1213 || is_server_gone(en);
+}
+
+static void reconnect_thread(struct thread_data *td){
+  g_warning("Thread %d: Reconnecting", td->thread_id);
+  mysql_close(td->thrconn);
+  td->thrconn=mysql_init(NULL);
+  m_connect(td->thrconn, "myloader", NULL);
+  set_local_infile_handler(td->thrconn);
+  enable_multi_statements(td->thrconn);
+  execute_gstring(td->thrconn, set_session);
+  if (td->current_database != NULL)
+    execute_use(td);
+}
+
+// Exponential backoff with jitter, so the threads that deadlocked
+// against each other do not collide again
+static void wait_before_retry(guint attempt){
+  gint32 backoff=MIN(RETRY_BACKOFF_BASE << MIN(attempt - 1, 10), RETRY_BACKOFF_MAX);
+  usleep(g_random_int_range(backoff / 2, backoff + 1));
+}
+
+// Executes again the statements of the current transaction followed by the
+// failed statement
+static gboolean replay_transaction(struct thread_data *td, GString *data, gboolean in_transaction, guint en){
+  guint attempt, i, statements= in_transaction && td->transaction != NULL ? td->transaction->len : 0;
+  for (attempt=1; attempt <= retry_count; attempt++){
+    wait_before_retry(attempt);
+    if (is_server_gone(en) || mysql_ping(td->thrconn))
+      reconnect_thread(td);
+    td->stats.retries++;
+    g_warning("Thread %d: Retrying the last %u statements, attempt %u of %u", td->thread_id, statements + 1, attempt, retry_count);
+    if (in_transaction){
+      mysql_query(td->thrconn, "ROLLBACK");
+      m_query(td->thrconn, "START TRANSACTION", m_warning, "START TRANSACTION failed");
+    }
+    en=0;
+    for (i=0; i < statements && en == 0; i++){
+      GString *statement=g_ptr_array_index(td->transaction, i);
+      if (mysql_real_query(td->thrconn, statement->str, statement->len))
+        en=mysql_errno(td->thrconn);
+    }
+    if (en == 0 && mysql_real_query(td->thrconn, data->str, data->len))
+      en=mysql_errno(td->thrconn);
+    if (en == 0)
+      return TRUE;
+    g_warning("Thread %d: Error retrying %u: %s", td->thread_id, en, mysql_error(td->thrconn));
+    if (!is_retryable_error(en))
+      return FALSE;
+  }
+  return FALSE;
+}
+
+static int statement_restored(struct thread_data *td, GString *data, gboolean is_schema, guint *query_counter);
+
 int restore_data_in_gstring_by_statement(struct thread_data *td, GString *data, gboolean is_schema, guint *query_counter)
 {
+  gboolean in_transaction= !is_schema && commit_count > 1;
+  gint64 start=g_get_monotonic_time();
   guint en=mysql_real_query(td->thrconn, data->str, data->len);
+  gint64 elapsed=g_get_monotonic_time()-start;
+  td->stats.query_time+=elapsed;
+  td->stats.statements++;
+  td->stats.bytes+=data->len;
+  histogram_observe(&(td->stats.query_latency), elapsed);
+  trace_span(td->trace, "statement", td->current_database, NULL, -1, start);
   if (en) {
     if (is_schema)
       g_warning("Thread %d: Error restoring %d: %s %s", td->thread_id, en, data->str, mysql_error(td->thrconn));
     else{
       g_warning("Thread %d: Error restoring %d: %s", td->thread_id, en, mysql_error(td->thrconn));
     }
+    en=mysql_errno(td->thrconn);
+    if (max_transaction_size > 0 && td->dbt != NULL && !is_schema && (en == 1205 || en == 1213))
+      shrink_transaction_size(td->dbt);
 
-//    if (en == CR_SERVER_GONE_ERROR || en == CR_SERVER_LOST){
-//      m_connect(td->thrconn, "myloader", NULL);
-    mysql_ping(td->thrconn);
-    execute_gstring(td->thrconn, set_session);
-    execute_use(td);
-//    }
-
-    g_warning("Thread %d: Retrying last failed executed statement", td->thread_id);
-    if (mysql_real_query(td->thrconn, data->str, data->len)) {
-      if (is_schema)
-        g_critical("Thread %d: Error restoring: %s %s", td->thread_id, data->str, mysql_error(td->thrconn));
-      else{
+    if (is_retryable_error(en)){
+      if (!replay_transaction(td, data, in_transaction, en)){
         g_critical("Thread %d: Error restoring: %s", td->thread_id, mysql_error(td->thrconn));
+        errors++;
+        forget_transaction(td);
+        return 1;
+      }
+    }else{
+      mysql_ping(td->thrconn);
+      execute_gstring(td->thrconn, set_session);
+      execute_use(td);
+
+      g_warning("Thread %d: Retrying last failed executed statement", td->thread_id);
+      if (mysql_real_query(td->thrconn, data->str, data->len)) {
+        if (is_schema)
+          g_critical("Thread %d: Error restoring: %s %s", td->thread_id, data->str, mysql_error(td->thrconn));
+        else{
+          g_critical("Thread %d: Error restoring: %s", td->thread_id, mysql_error(td->thrconn));
+        }
+        errors++;
+        return 1;
       }
-      errors++;
-      return 1;
     }
   }
+  return statement_restored(td, data, is_schema, query_counter);
+}
+
+// Accounts a statement that has been executed and commits when the
+// transaction is full
+static int statement_restored(struct thread_data *td, GString *data, gboolean is_schema, guint *query_counter){
   *query_counter=*query_counter+1;
   if (is_schema==FALSE) {
+    td->stats.rows+=mysql_affected_rows(td->thrconn);
     if (commit_count > 1) {
-      if (*query_counter == commit_count) {
+      td->transaction_bytes+=data->len;
+      remember_statement(td, data->str, data->len);
+      if (transaction_is_full(td, *query_counter)) {
         *query_counter= 0;
-        if (!m_query(td->thrconn, "COMMIT", m_warning, "COMMIT failed")) {
+        if (!commit_and_measure(td)) {
           errors++;
           return 2;
         }
@@ -78,25 +231,111 @@ int restore_data_in_gstring_by_statement(struct thread_data *td, GString *data,
   return 0;
 }
 
+void enable_multi_statements(MYSQL *conn){
+  if (!no_multi_statements && mysql_set_server_option(conn, MYSQL_OPTION_MULTI_STATEMENTS_ON))
+    g_warning("Multi statements could not be enabled: %s", mysql_error(conn));
+}
+
+GPtrArray *new_statement_batch(){
+  return g_ptr_array_new_with_free_func(free_statement);
+}
+
+// Sends the statements in one round trip. The server stops at the first
+// statement that fails. On a deadlock, a lock wait timeout or a lost
+// connection the transaction is already rolled back, so it is replayed with
+// the failed statement. On any other error the failed statement and the ones
+// after it are executed one by one, which retries it once.
+int restore_statements_in_batch(struct thread_data *td, GPtrArray *statements, gboolean is_schema, guint *query_counter){
+  guint i, en, executed=0;
+  int r=0, status;
+  MYSQL_RES *result;
+  // Data statements are not batched over a commit, at the paced commit count
+  if (statements->len > 1 && !no_multi_statements &&
+      (is_schema || commit_count <= 1 || (max_transaction_size == 0 && *query_counter + statements->len < get_paced_commit_count()))){
+    GString *batch=g_string_sized_new(STATEMENT_BATCH_SIZE);
+    for (i=0; i < statements->len; i++){
+      GString *statement=g_ptr_array_index(statements, i);
+      g_string_append_len(batch, statement->str, statement->len);
+      g_string_append_c(batch, '\n');
+    }
+    gint64 start=g_get_monotonic_time();
+    status=mysql_real_query(td->thrconn, batch->str, batch->len);
+    while (status == 0){
+      if (!is_schema){
+        td->stats.rows+=mysql_affected_rows(td->thrconn);
+        if (commit_count > 1){
+          GString *statement=g_ptr_array_index(statements, executed);
+          td->transaction_bytes+=statement->len;
+          remember_statement(td, statement->str, statement->len);
+        }
+      }
+      executed++;
+      result=mysql_store_result(td->thrconn);
+      if (result)
+        mysql_free_result(result);
+      status=mysql_next_result(td->thrconn);
+    }
+    gint64 elapsed=g_get_monotonic_time()-start;
+    td->stats.query_time+=elapsed;
+    td->stats.statements+=executed;
+    td->stats.bytes+=batch->len;
+    histogram_observe(&(td->stats.query_latency), elapsed);
+    trace_span(td->trace, "statement_batch", td->current_database, NULL, -1, start);
+    *query_counter+=executed;
+    g_string_free(batch, TRUE);
+    if (executed < statements->len){
+      GString *statement=g_ptr_array_index(statements, executed);
+      en=mysql_errno(td->thrconn);
+      g_warning("Thread %d: Error restoring %d: %s", td->thread_id, en, mysql_error(td->thrconn));
+      if (is_retryable_error(en)){
+        if (replay_transaction(td, statement, !is_schema && commit_count > 1, en)){
+          r+=statement_restored(td, statement, is_schema, query_counter);
+        }else{
+          g_critical("Thread %d: Error restoring: %s", td->thread_id, mysql_error(td->thrconn));
+          errors++;
+          forget_transaction(td);
+          r++;
+        }
+        executed++;
+      }
+    }
+  }
+  for (i=executed; i < statements->len; i++)
+    r+=restore_data_in_gstring_by_statement(td, g_ptr_array_index(statements, i), is_schema, query_counter);
+  g_ptr_array_set_size(statements, 0);
+  return r;
+}
+
 int restore_data_in_gstring(struct thread_data *td, GString *data, gboolean is_schema, guint *query_counter)
 {
   int i=0;
   int r=0;
   if (data != NULL && data->len > 4){
     gchar** line=g_strsplit(data->str, ";\n", -1);
+    GPtrArray *statements=new_statement_batch();
     for (i=0; i < (int)g_strv_length(line);i++){
        if (strlen(line[i])>2){
          GString *str=g_string_new(line[i]);
          g_string_append_c(str,';');
-         r+=restore_data_in_gstring_by_statement(td, str, is_schema, query_counter);
-         g_string_free(str,TRUE);
+         g_ptr_array_add(statements, str);
+         if (statements->len >= STATEMENT_BATCH_STATEMENTS)
+           r+=restore_statements_in_batch(td, statements, is_schema, query_counter);
        }
     }
+    r+=restore_statements_in_batch(td, statements, is_schema, query_counter);
+    g_ptr_array_free(statements, TRUE);
     g_strfreev(line);
   }
   return r;
 }
 
+static int flush_statement_batch(struct thread_data *td, GPtrArray *statements, gboolean is_schema, guint *query_counter, guint preline, guint line, const char *filename){
+  int tr=restore_statements_in_batch(td, statements, is_schema, query_counter);
+  if (tr > 0)
+    g_critical("Error occurs between lines: %d and %d on file %s: %s",preline,line,filename,mysql_error(td->thrconn));
+  return tr;
+}
+
 int split_and_restore_data_in_gstring_by_statement(struct thread_data *td,
                   GString *data, gboolean is_schema, guint *query_counter, guint offset_line)
 {
@@ -145,7 +384,7 @@ void *send_file_to_fifo(gchar *compressed_filename){
   FILE * fd = g_fopen(fifo_name, "w");
   FILE *file=NULL;
   gboolean is_compressed = FALSE;
-  gchar *path = g_build_filename(directory, compressed_filename, NULL);
+  gchar *path = build_stripe_path(compressed_filename);
   ml_open(&file,path,&is_compressed);
   char buffer[256];
   gboolean eof=FALSE;
@@ -210,8 +449,9 @@ int restore_data_from_file(struct thread_data *td, char *database, char *table,
   gboolean eof = FALSE;
   guint query_counter = 0;
   GString *data = g_string_sized_new(256);
-  guint line=0,preline=0;
-  gchar *path = g_build_filename(directory, filename, NULL);
+  GPtrArray *statements = new_statement_batch();
+  guint line=0,preline=0,batch_preline=0;
+  gchar *path = build_stripe_path(filename);
   ml_open(&infile,path,&is_compressed);
 
 /*  if (!g_str_has_suffix(path, compress_extension)) {
@@ -227,19 +467,37 @@ int restore_data_from_file(struct thread_data *td, char *database, char *table,
     errors++;
     return 1;
   }
-  if (!is_schema && (commit_count > 1) )
+  start_stripe_read(filename);
+  if (!is_schema && (commit_count > 1) ){
     m_query(td->thrconn, "START TRANSACTION", m_warning, "START TRANSACTION failed");
+    td->transaction_bytes=0;
+    forget_transaction(td);
+  }
   guint tr=0;
+  gint64 read_start=0;
   while (eof == FALSE) {
-    if (read_data(infile, is_compressed, data, &eof, &line)) {
+    read_start=g_get_monotonic_time();
+    gboolean read_ok=read_data(infile, is_compressed, data, &eof, &line);
+    td->stats.read_time+=g_get_monotonic_time()-read_start;
+    if (read_ok) {
       if (g_strrstr(&data->str[data->len >= 5 ? data->len - 5 : 0], ";\n")) {
         if ( skip_definer && g_str_has_prefix(data->str,"CREATE")){
           remove_definer(data);
         }
-        if (rows > 0 && g_strrstr_len(data->str,6,"INSERT"))
+        if (rows > 0 && g_strrstr_len(data->str,6,"INSERT")){
+          r+=flush_statement_batch(td, statements, is_schema, &query_counter, batch_preline, preline, filename);
           tr=split_and_restore_data_in_gstring_by_statement(td,
             data, is_schema, &query_counter,preline);
-        else{
+        }else if (is_schema && !g_strrstr_len(data->str,10,"LOAD DATA ")){
+          // Schema statements are independent of each other, they are sent in batches
+          if (statements->len == 0)
+            batch_preline=preline;
+          g_ptr_array_add(statements, g_string_new_len(data->str, data->len));
+          tr=0;
+          if (statements->len >= STATEMENT_BATCH_STATEMENTS)
+            r+=flush_statement_batch(td, statements, is_schema, &query_counter, batch_preline, line, filename);
+        }else{
+          r+=flush_statement_batch(td, statements, is_schema, &query_counter, batch_preline, preline, filename);
           if (g_strrstr_len(data->str,10,"LOAD DATA ")){
             gchar *from = g_strstr_len(data->str, -1, "'");
             from++;
@@ -269,10 +527,13 @@ int restore_data_from_file(struct thread_data *td, char *database, char *table,
     } else {
       g_critical("error reading file %s (%d)", filename, errno);
       errors++;
+      g_ptr_array_free(statements, TRUE);
       return r;
     }
   }
-  if (!is_schema && (commit_count > 1) && !m_query(td->thrconn, "COMMIT", m_warning, "COMMIT failed")) {
+  r+=flush_statement_batch(td, statements, is_schema, &query_counter, batch_preline, line, filename);
+  g_ptr_array_free(statements, TRUE);
+  if (!is_schema && (commit_count > 1) && !commit_and_measure(td)) {
     g_critical("Error committing data for %s.%s from file %s: %s",
                database, table, filename, mysql_error(td->thrconn));
     errors++;
@@ -284,6 +545,10 @@ int restore_data_from_file(struct thread_data *td, char *database, char *table,
     gzclose((gzFile)infile);
   }
 
+  end_stripe_read(filename);
+  td->stats.files++;
+  if (!is_schema)
+    td->stats.data_files++;
   m_remove(directory,filename);
   g_free(path);
   return r;
@@ -19,4 +19,7 @@ int restore_data_from_file(struct thread_data *td, char *database, char *table,
                   const char *filename, gboolean is_schema);
 int restore_data_in_gstring_by_statement(struct thread_data *td, GString *data, gboolean is_schema, guint *query_counter);
 int restore_data_in_gstring(struct thread_data *td, GString *data, gboolean is_schema, guint *query_counter);
+void enable_multi_statements(MYSQL *conn);
+GPtrArray *new_statement_batch();
+int restore_statements_in_batch(struct thread_data *td, GPtrArray *statements, gboolean is_schema, guint *query_counter);
 void release_load_data_as_it_is_close( gchar * filename );
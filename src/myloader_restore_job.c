@@ -29,6 +29,8 @@ unsigned long long int total_data_sql_files = 0;
 #include "myloader_global.h"
 #include "myloader_common.h"
 #include "myloader_control_job.h"
+#include "myloader_lag_pacing.h"
+#include "myloader_worker_index.h"
 gboolean shutdown_triggered=FALSE;
 GAsyncQueue *file_list_to_do=NULL;
 static GMutex *progress_mutex = NULL;
@@ -151,6 +153,7 @@ void process_restore_job(struct thread_data *td, struct restore_job *rj){
       resume_mutex=NULL;
     }
   }
+  wait_for_lag_pacing(td);
   if (shutdown_triggered){
 //    g_message("file enqueued to allow resume: %s", rj->filename);
     g_async_queue_push(file_list_to_do,g_strdup(rj->filename));
@@ -159,11 +162,13 @@ void process_restore_job(struct thread_data *td, struct restore_job *rj){
   struct db_table *dbt=rj->dbt;
   guint query_counter=0;
   guint i=0;
+  gint64 trace_start=trace_time(td->trace);
   switch (rj->type) {
     case JOB_RESTORE_STRING:
       g_message("Thread %d: restoring %s `%s`.`%s` from %s", td->thread_id, rj->data.srj->object,
                 dbt->database->real_database, dbt->real_table, rj->filename);
       restore_data_in_gstring(td, rj->data.srj->statement, FALSE, &query_counter);
+      trace_span(td->trace, rj->data.srj->object, dbt->database->real_database, dbt->real_table, -1, trace_start);
       free_schema_restore_job(rj->data.srj);
       break;
     case JOB_RESTORE_SCHEMA_STRING:
@@ -185,6 +190,7 @@ void process_restore_job(struct thread_data *td, struct restore_job *rj){
       }
       dbt->schema_state=CREATED;
       if (serial_tbl_creation) g_mutex_unlock(single_threaded_create_table);
+      trace_span(td->trace, "schema", dbt->database->real_database, dbt->real_table, -1, trace_start);
       free_schema_restore_job(rj->data.srj);
       break;
     case JOB_RESTORE_FILENAME:
@@ -206,9 +212,18 @@ void process_restore_job(struct thread_data *td, struct restore_job *rj){
           m_critical("Table has not been created in more than 10 seconds");
         }
       }
+      guint64 bytes=td->stats.bytes;
+      start_data_thread_budget();
+      td->dbt=dbt;
       if (restore_data_from_file(td, dbt->database->real_database, dbt->real_table, rj->filename, FALSE) > 0){
         g_critical("Thread %d: issue restoring %s: %s",td->thread_id,rj->filename, mysql_error(td->thrconn));
       }
+      td->dbt=NULL;
+      end_data_thread_budget();
+      g_mutex_lock(dbt->mutex);
+      dbt->bytes+=td->stats.bytes-bytes;
+      g_mutex_unlock(dbt->mutex);
+      trace_span(td->trace, "restore_file", dbt->database->real_database, dbt->real_table, rj->data.drj->index, trace_start);
       g_atomic_int_dec_and_test(&(dbt->remaining_jobs));
       g_free(rj->data.drj);
       break;
@@ -216,6 +231,7 @@ void process_restore_job(struct thread_data *td, struct restore_job *rj){
       g_message("Thread %d: restoring %s on `%s` from %s", td->thread_id, rj->data.srj->object,
                 rj->data.srj->database->real_database, rj->filename);
       restore_data_from_file(td, rj->data.srj->database->real_database, NULL, rj->filename, TRUE );
+      trace_span(td->trace, rj->data.srj->object, rj->data.srj->database->real_database, NULL, -1, trace_start);
       free_schema_restore_job(rj->data.srj);
       break;
     default:
@@ -21,11 +21,14 @@
 #include "myloader_control_job.h"
 #include "myloader_intermediate_queue.h"
 #include "myloader_global.h"
+#include "uring_writer.h"
 
 GThread *stream_thread = NULL;
 void *process_stream();
 
 void initialize_stream (struct configuration *c){
+  if (use_io_uring && !initialize_uring_writer())
+    use_io_uring=FALSE;
   stream_thread = g_thread_create((GThreadFunc)process_stream, c, TRUE, NULL);
 }
 
@@ -36,7 +39,7 @@ void wait_stream_to_finish(){
 int read_stream_line(char *buffer, gboolean *eof,FILE *file,int c_to_read){
     size_t bytes = fread(buffer, sizeof(char), c_to_read, stdin);
     if( !bytes ){
-      if (file != NULL && feof(file)){
+      if (file != NULL && !use_io_uring && feof(file)){
         *eof = TRUE;
         buffer[0] = '\0';
         m_close(file);
@@ -138,9 +141,15 @@ read_more:    buffer_len=read_stream_line(&(buffer[diff]),&eof,file,STREAM_BUFFE
                 last_pos++;
                 file = NULL;
               }else{
-                file = g_fopen(real_filename, "w");
-                m_write=(void *)&write_file;
-                m_close=(void *) &fclose;
+                if (use_io_uring){
+                  file = uring_open(real_filename, "w");
+                  m_write=&uring_write;
+                  m_close=&uring_close;
+                }else{
+                  file = g_fopen(real_filename, "w");
+                  m_write=(void *)&write_file;
+                  m_close=(void *) &fclose;
+                }
               }
             }else{
               g_debug("Not a mydumper file: %s", filename);
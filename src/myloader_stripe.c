@@ -0,0 +1,121 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include "common.h"
+#include "myloader_stripe.h"
+#include "myloader_global.h"
+
+// mydumper --stripe-directories spreads the data files over several
+// directories. Their location comes from the manifest, or from scanning the
+// directories in --stripe-directories, and the reads in progress are counted
+// per directory so that the threads are spread over the volumes.
+struct stripe {
+  gchar *directory;
+  gint reads;
+};
+
+gchar *stripe_directories=NULL;
+static gchar **stripe_volumes=NULL;
+static GPtrArray *stripe_volume_files=NULL;
+static GHashTable *stripe_files=NULL;
+static GHashTable *stripes=NULL;
+static struct stripe *main_stripe=NULL;
+static GMutex *stripe_mutex=NULL;
+
+static struct stripe *get_stripe(const gchar *volume){
+  struct stripe *s=g_hash_table_lookup(stripes, volume);
+  if (s == NULL){
+    s=g_new0(struct stripe, 1);
+    s->directory=g_strdup(volume);
+    g_hash_table_insert(stripes, s->directory, s);
+  }
+  return s;
+}
+
+void initialize_stripes(){
+  GError *error=NULL;
+  GDir *dir;
+  const gchar *filename;
+  guint i;
+  stripe_mutex=g_mutex_new();
+  stripe_files=g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+  stripes=g_hash_table_new(g_str_hash, g_str_equal);
+  main_stripe=get_stripe(directory);
+  if (stripe_directories == NULL)
+    return;
+  stripe_volumes=g_strsplit(stripe_directories, ",", 0);
+  stripe_volume_files=g_ptr_array_new();
+  for (i=0; stripe_volumes[i] != NULL; i++){
+    g_strstrip(stripe_volumes[i]);
+    dir=g_dir_open(stripe_volumes[i], 0, &error);
+    if (dir == NULL)
+      m_critical("Stripe directory %s could not be opened: %s", stripe_volumes[i], error->message);
+    while ((filename=g_dir_read_name(dir))){
+      add_stripe_file(filename, stripe_volumes[i]);
+      g_ptr_array_add(stripe_volume_files, g_strdup(filename));
+    }
+    g_dir_close(dir);
+  }
+}
+
+gboolean is_striped(){
+  return g_hash_table_size(stripes) > 1;
+}
+
+// Replaces the directories of the volumes in the manifest
+gchar **get_stripe_volumes(){
+  return stripe_volumes;
+}
+
+// The files found in --stripe-directories
+GPtrArray *get_stripe_volume_files(){
+  return stripe_volume_files;
+}
+
+void add_stripe_file(const gchar *filename, const gchar *volume){
+  g_mutex_lock(stripe_mutex);
+  g_hash_table_insert(stripe_files, g_strdup(filename), get_stripe(volume));
+  g_mutex_unlock(stripe_mutex);
+}
+
+static struct stripe *lookup_stripe_file(const gchar *filename){
+  struct stripe *s;
+  g_mutex_lock(stripe_mutex);
+  s=g_hash_table_lookup(stripe_files, filename);
+  g_mutex_unlock(stripe_mutex);
+  return s != NULL ? s : main_stripe;
+}
+
+gchar *build_stripe_path(const gchar *filename){
+  if (g_path_is_absolute(filename))
+    return g_strdup(filename);
+  return g_build_filename(lookup_stripe_file(filename)->directory, filename, NULL);
+}
+
+gint get_stripe_reads(const gchar *filename){
+  return g_atomic_int_get(&(lookup_stripe_file(filename)->reads));
+}
+
+void start_stripe_read(const gchar *filename){
+  g_atomic_int_inc(&(lookup_stripe_file(filename)->reads));
+}
+
+void end_stripe_read(const gchar *filename){
+  g_atomic_int_add(&(lookup_stripe_file(filename)->reads), -1);
+}
@@ -0,0 +1,32 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+#ifndef _src_myloader_stripe_h
+#define _src_myloader_stripe_h
+
+// Jobs of a table that are looked at to find one on the least busy volume
+#define STRIPE_JOB_LOOKAHEAD 8
+
+void initialize_stripes();
+gboolean is_striped();
+gchar **get_stripe_volumes();
+GPtrArray *get_stripe_volume_files();
+void add_stripe_file(const gchar *filename, const gchar *volume);
+gchar *build_stripe_path(const gchar *filename);
+gint get_stripe_reads(const gchar *filename);
+void start_stripe_read(const gchar *filename);
+void end_stripe_read(const gchar *filename);
+#endif
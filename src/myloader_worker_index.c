@@ -20,6 +20,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include "myloader_stream.h"
 #include "common.h"
 #include "server_detect.h"
@@ -35,19 +36,84 @@
 #include <errno.h>
 #include "myloader_global.h"
 #include "myloader_worker_index.h"
+#include "myloader_pmm_thread.h"
 
 
 GMutex * innodb_optimize_keys_all_tables_mutex=NULL;
 
+// Building an index sorts every row by the key and the primary key, so the
+// cost is the bytes to sort. When the rows are unknown they are estimated
+// from the bytes loaded.
+guint64 estimate_index_cost(struct db_table *dbt){
+  guint64 table_rows=dbt->rows;
+  if (table_rows == 0 && dbt->row_width > 0)
+    table_rows=dbt->bytes / dbt->row_width;
+  return MAX(table_rows, 1) * MAX(dbt->index_key_width, 1);
+}
+
+// The most expensive index goes first, shutdown jobs go last
+static gint compare_index_job_cost(gconstpointer a, gconstpointer b, gpointer user_data){
+  const struct control_job *job_a=a, *job_b=b;
+  (void) user_data;
+  if (job_a->type == JOB_SHUTDOWN || job_b->type == JOB_SHUTDOWN)
+    return (job_a->type == JOB_SHUTDOWN) - (job_b->type == JOB_SHUTDOWN);
+  guint64 cost_a=job_a->data.restore_job->dbt->index_cost, cost_b=job_b->data.restore_job->dbt->index_cost;
+  return cost_a < cost_b ? 1 : cost_a > cost_b ? -1 : 0;
+}
+
+void enqueue_index_job(struct configuration *conf, struct control_job *job){
+  g_async_queue_push_sorted(conf->index_queue, job, compare_index_job_cost, NULL);
+}
+
+// Data and index threads share --max-threads-total, both counters are
+// changed holding index_mutex and budget_cond is signaled when one drops.
+static GCond *budget_cond=NULL;
+static guint index_threads_waiting=0;
+
+static gboolean is_thread_budget_full(){
+  return max_threads_total > 0 &&
+         (guint)g_atomic_int_get(&data_threads_running) + index_threads_counter >= max_threads_total;
+}
+
+// While an index waits and none is being created, the data threads leave it
+// the next free thread, otherwise busy data threads would leave all of them
+// for the end.
+void start_data_thread_budget(){
+  g_mutex_lock(index_mutex);
+  while (is_thread_budget_full() ||
+         (max_threads_total > 0 && index_threads_waiting > 0 && index_threads_counter == 0))
+    g_cond_wait(budget_cond, index_mutex);
+  g_atomic_int_inc(&data_threads_running);
+  g_mutex_unlock(index_mutex);
+}
+
+void end_data_thread_budget(){
+  g_mutex_lock(index_mutex);
+  g_atomic_int_add(&data_threads_running, -1);
+  g_cond_broadcast(budget_cond);
+  g_mutex_unlock(index_mutex);
+}
+
+static void wait_for_index_budget(){
+  g_mutex_lock(index_mutex);
+  index_threads_waiting++;
+  while (is_thread_budget_full())
+    g_cond_wait(budget_cond, index_mutex);
+  index_threads_waiting--;
+  index_threads_counter++;
+  g_mutex_unlock(index_mutex);
+}
+
 gboolean process_index(struct thread_data * td){
   struct control_job *job=g_async_queue_pop(td->conf->index_queue);
   if (job->type==JOB_SHUTDOWN)
     return FALSE;
 
   struct db_table *dbt=job->data.restore_job->dbt;
+    wait_for_index_budget();
     execute_use_if_needs_to(td, job->use_database, "Restoring index");
     dbt->start_index_time=g_date_time_new_now_local();
-    g_message("restoring index: %s.%s", dbt->database->name, dbt->table);
+    g_message("restoring index: %s.%s, estimated cost %"G_GUINT64_FORMAT, dbt->database->name, dbt->table, dbt->index_cost);
     process_job(td, job);
     dbt->finish_time=g_date_time_new_now_local();
     g_mutex_lock(job->data.restore_job->dbt->mutex);
@@ -55,6 +121,7 @@ gboolean process_index(struct thread_data * td){
     g_mutex_unlock(job->data.restore_job->dbt->mutex);
     g_mutex_lock(index_mutex);
     index_threads_counter--;
+    g_cond_broadcast(budget_cond);
     g_mutex_unlock(index_mutex);
   return TRUE;
 }
@@ -63,7 +130,7 @@ gboolean process_index(struct thread_data * td){
 void create_index_shutdown_job(struct configuration *conf){
   guint n=0;
   for (n = 0; n < max_threads_for_index_creation; n++) {
-    g_async_queue_push(conf->index_queue, new_job(JOB_SHUTDOWN,NULL,NULL));
+    enqueue_index_job(conf, new_job(JOB_SHUTDOWN,NULL,NULL));
   }
 }
 
@@ -77,6 +144,7 @@ void *worker_index_thread(struct thread_data *td) {
   td->current_database=NULL;
 
   m_connect(td->thrconn, "myloader", NULL);
+  enable_multi_statements(td->thrconn);
 
   execute_gstring(td->thrconn, set_session);
   g_async_queue_push(conf->ready, GINT_TO_POINTER(1));
@@ -107,13 +175,17 @@ struct thread_data *index_td = NULL;
 void initialize_worker_index(struct configuration *conf){
   guint n=0;
   init_connection_mutex = g_mutex_new();
+  budget_cond = g_cond_new();
   index_threads = g_new(GThread *, max_threads_for_index_creation);
-  index_td = g_new(struct thread_data, max_threads_for_index_creation);
+  index_td = g_new0(struct thread_data, max_threads_for_index_creation);
+  if (pmm)
+    register_pmm_threads("index", index_td, max_threads_for_index_creation);
   innodb_optimize_keys_all_tables_mutex=g_mutex_new();
   g_mutex_lock(innodb_optimize_keys_all_tables_mutex);
   for (n = 0; n < max_threads_for_index_creation; n++) {
     index_td[n].conf = conf;
     index_td[n].thread_id = n + 1;
+    index_td[n].trace = new_trace_buffer("index", n + 1);
     index_threads[n] =
         g_thread_create((GThreadFunc)worker_index_thread, &index_td[n], TRUE, NULL);
   }
@@ -131,6 +203,8 @@ void start_innodb_optimize_keys_all_tables(){
 }
 
 void free_index_worker_threads(){
+  if (pmm)
+    unregister_pmm_threads(index_td);
   g_free(index_td);
   g_free(index_threads);
 }
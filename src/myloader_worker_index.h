@@ -16,7 +16,13 @@
 */
 #include "myloader.h"
 
+struct control_job;
+
 void initialize_worker_index(struct configuration *conf);
 void wait_index_worker_to_finish();
 void create_index_shutdown_job(struct configuration *conf);
 void start_innodb_optimize_keys_all_tables();
+guint64 estimate_index_cost(struct db_table *dbt);
+void enqueue_index_job(struct configuration *conf, struct control_job *job);
+void start_data_thread_budget();
+void end_data_thread_budget();
@@ -100,4 +100,6 @@ void set_verbose(guint verbosity) {
           write_log_file, NULL);
     break;
   }
+  if (logfile)
+    start_async_log();
 }
@@ -0,0 +1,197 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include "trace.h"
+
+gchar *trace_file = NULL;
+
+static FILE *trace_out = NULL;
+static GMutex *trace_buffers_mutex = NULL;
+static GList *trace_buffers = NULL;
+static GThread *trace_thread = NULL;
+static gint trace_stop = 0;
+static gint64 trace_start_time = 0;
+static guint trace_next_tid = 0;
+static gboolean trace_first_event = TRUE;
+
+static void trace_append_escaped(GString *out, const gchar *s){
+  for (; *s != '\0'; s++){
+    switch (*s){
+      case '"':
+      case '\\':
+        g_string_append_c(out, '\\');
+        g_string_append_c(out, *s);
+        break;
+      default:
+        if ((guchar)*s < 0x20)
+          g_string_append_printf(out, "\\u%04x", (guchar)*s);
+        else
+          g_string_append_c(out, *s);
+    }
+  }
+}
+
+static void trace_append_separator(GString *out){
+  if (!trace_first_event)
+    g_string_append(out, ",\n");
+  trace_first_event=FALSE;
+}
+
+static void flush_trace_buffer(struct trace_buffer *tb, GString *out){
+  gint tail=g_atomic_int_get(&(tb->tail));
+  gint head=g_atomic_int_get(&(tb->head));
+  struct trace_event *e=NULL;
+  if (!tb->named){
+    trace_append_separator(out);
+    g_string_append_printf(out, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":\"", getpid(), tb->tid);
+    trace_append_escaped(out, tb->label);
+    g_string_append(out, "\"}}");
+    tb->named=TRUE;
+  }
+  for (; tail != head; tail=(gint)((guint)tail + 1)){
+    e=&(tb->events[(guint)tail % TRACE_BUFFER_SIZE]);
+    trace_append_separator(out);
+    g_string_append(out, "{\"name\":\"");
+    trace_append_escaped(out, e->name);
+    g_string_append_printf(out, "\",\"ph\":\"X\",\"pid\":%d,\"tid\":%u,\"ts\":%"G_GINT64_FORMAT",\"dur\":%"G_GINT64_FORMAT",\"args\":{\"table\":\"",
+                           getpid(), tb->tid, e->start - trace_start_time, e->duration);
+    trace_append_escaped(out, e->table);
+    g_string_append_printf(out, "\",\"chunk\":%"G_GINT64_FORMAT"}}", e->chunk);
+  }
+  g_atomic_int_set(&(tb->tail), tail);
+}
+
+static void flush_trace_buffers(){
+  GString *out=g_string_sized_new(4096);
+  GList *l=NULL;
+  g_mutex_lock(trace_buffers_mutex);
+  for (l=trace_buffers; l != NULL; l=l->next)
+    flush_trace_buffer(l->data, out);
+  g_mutex_unlock(trace_buffers_mutex);
+  if (out->len > 0 && fwrite(out->str, 1, out->len, trace_out) != out->len)
+    g_warning("Error writing trace file %s: %s", trace_file, g_strerror(errno));
+  fflush(trace_out);
+  g_string_free(out, TRUE);
+}
+
+static void *trace_flush_thread(void *data){
+  (void) data;
+  while (!g_atomic_int_get(&trace_stop)){
+    g_usleep(TRACE_FLUSH_INTERVAL);
+    flush_trace_buffers();
+  }
+  return NULL;
+}
+
+void initialize_trace(const gchar *program){
+  GError *serror=NULL;
+  if (trace_file == NULL)
+    return;
+  trace_out=g_fopen(trace_file, "w");
+  if (trace_out == NULL){
+    g_critical("Error opening trace file %s: %s", trace_file, g_strerror(errno));
+    trace_file=NULL;
+    return;
+  }
+  trace_buffers_mutex=g_mutex_new();
+  trace_start_time=g_get_monotonic_time();
+  fprintf(trace_out, "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"program\":\"%s\"},\"traceEvents\":[\n", program);
+  trace_thread=g_thread_create((GThreadFunc)trace_flush_thread, NULL, TRUE, &serror);
+  if (trace_thread == NULL){
+    g_critical("Could not create trace thread: %s", serror->message);
+    g_error_free(serror);
+  }
+}
+
+void finalize_trace(){
+  GList *l=NULL;
+  guint dropped=0;
+  if (trace_out == NULL)
+    return;
+  g_atomic_int_set(&trace_stop, 1);
+  if (trace_thread != NULL)
+    g_thread_join(trace_thread);
+  flush_trace_buffers();
+  fprintf(trace_out, "\n]}\n");
+  fclose(trace_out);
+  trace_out=NULL;
+  for (l=trace_buffers; l != NULL; l=l->next)
+    dropped+=((struct trace_buffer *)l->data)->dropped;
+  if (dropped > 0)
+    g_warning("%u trace events were dropped, the trace file is incomplete", dropped);
+  g_list_free_full(trace_buffers, g_free);
+  trace_buffers=NULL;
+}
+
+struct trace_buffer *new_trace_buffer(const gchar *kind, guint thread_id){
+  struct trace_buffer *tb=NULL;
+  if (trace_out == NULL)
+    return NULL;
+  tb=g_new0(struct trace_buffer, 1);
+  g_snprintf(tb->label, sizeof(tb->label), "%s %u", kind, thread_id);
+  g_mutex_lock(trace_buffers_mutex);
+  tb->tid=trace_next_tid++;
+  trace_buffers=g_list_append(trace_buffers, tb);
+  g_mutex_unlock(trace_buffers_mutex);
+  return tb;
+}
+
+gint64 trace_time(struct trace_buffer *tb){
+  return tb == NULL ? 0 : g_get_monotonic_time();
+}
+
+void trace_span(struct trace_buffer *tb, const gchar *name, const gchar *database, const gchar *table, gint64 chunk, gint64 start){
+  struct trace_event *e=NULL;
+  gint head=0;
+  if (tb == NULL)
+    return;
+  head=g_atomic_int_get(&(tb->head));
+  if ((guint)head - (guint)g_atomic_int_get(&(tb->tail)) >= TRACE_BUFFER_SIZE){
+    tb->dropped++;
+    return;
+  }
+  e=&(tb->events[(guint)head % TRACE_BUFFER_SIZE]);
+  g_strlcpy(e->name, name, sizeof(e->name));
+  if (database != NULL && table != NULL)
+    g_snprintf(e->table, sizeof(e->table), "%s.%s", database, table);
+  else
+    g_strlcpy(e->table, database != NULL ? database : "", sizeof(e->table));
+  e->chunk=chunk;
+  e->start=start;
+  e->duration=g_get_monotonic_time() - start;
+  g_atomic_int_set(&(tb->head), (gint)((guint)head + 1));
+}
+
+void trace_mark(struct trace_buffer *tb){
+  if (tb != NULL)
+    tb->mark=g_get_monotonic_time();
+}
+
+// Used for the work that happens between two other spans, like fetching and
+// encoding rows between two writes.
+void trace_span_from_mark(struct trace_buffer *tb, const gchar *name, const gchar *database, const gchar *table, gint64 chunk){
+  if (tb == NULL)
+    return;
+  if (tb->mark != 0)
+    trace_span(tb, name, database, table, chunk, tb->mark);
+  tb->mark=g_get_monotonic_time();
+}
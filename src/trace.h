@@ -0,0 +1,57 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+
+#ifndef _src_trace_h
+#define _src_trace_h
+
+#include <glib.h>
+
+// Events that do not fit in the ring buffer before the next flush are dropped
+#define TRACE_BUFFER_SIZE 4096
+#define TRACE_FLUSH_INTERVAL 200000
+
+extern gchar *trace_file;
+
+struct trace_event {
+  gchar name[24];
+  gchar table[128];
+  gint64 chunk;
+  gint64 start;
+  gint64 duration;
+};
+
+// Single producer ring buffer: only the owner thread writes events and moves
+// head, only the trace thread reads them and moves tail.
+struct trace_buffer {
+  guint tid;
+  gchar label[32];
+  struct trace_event events[TRACE_BUFFER_SIZE];
+  volatile gint head;
+  volatile gint tail;
+  guint dropped;
+  gboolean named;
+  gint64 mark;
+};
+
+void initialize_trace(const gchar *program);
+void finalize_trace();
+struct trace_buffer *new_trace_buffer(const gchar *kind, guint thread_id);
+gint64 trace_time(struct trace_buffer *tb);
+void trace_span(struct trace_buffer *tb, const gchar *name, const gchar *database, const gchar *table, gint64 chunk, gint64 start);
+void trace_mark(struct trace_buffer *tb);
+void trace_span_from_mark(struct trace_buffer *tb, const gchar *name, const gchar *database, const gchar *table, gint64 chunk);
+#endif
@@ -0,0 +1,384 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+
+#define _GNU_SOURCE
+
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "config.h"
+#ifdef WITH_IO_URING
+#include <liburing.h>
+#endif
+#include "uring_writer.h"
+
+gboolean use_io_uring=FALSE;
+gboolean io_uring_direct=FALSE;
+
+#ifdef WITH_IO_URING
+
+enum uring_request_type {
+  URING_WRITE,
+  URING_FSYNC
+};
+
+struct uring_writer {
+  struct io_uring ring;
+  gboolean registered;
+  struct iovec iovecs[URING_BUFFERS];
+  gint free_buffers[URING_BUFFERS];
+  guint free_count;
+  // Prepared and not submitted yet, and submitted and not completed
+  guint queued;
+  guint in_flight;
+};
+
+// A file has to be written and closed by the thread that opened it, as it
+// uses the ring of that thread. When the thread has no ring, the writes are
+// done with write(2).
+struct uring_file {
+  struct uring_writer *writer;
+  int fd;
+  gboolean direct;
+  off_t offset;
+  gint buffer;
+  gsize used;
+  guint pending;
+  int error;
+};
+
+// done is what was written of the buffer by the previous requests, when the
+// kernel did a short write
+struct uring_request {
+  enum uring_request_type type;
+  struct uring_file *file;
+  gint buffer;
+  off_t offset;
+  gsize len;
+  gsize done;
+};
+
+// The ring is freed when the thread exits, after the pending requests. The
+// destroy notify is not called for the main thread, see stop_uring_writer.
+static void free_uring_writer(struct uring_writer *writer);
+static GPrivate uring_writer_key = G_PRIVATE_INIT((GDestroyNotify)free_uring_writer);
+
+static struct uring_writer *new_uring_writer(){
+  struct uring_writer *writer=g_new0(struct uring_writer, 1);
+  guint i;
+  if (io_uring_queue_init(URING_QUEUE_DEPTH, &(writer->ring), 0) < 0){
+    g_free(writer);
+    return NULL;
+  }
+  for (i=0; i < URING_BUFFERS; i++){
+    if (posix_memalign(&(writer->iovecs[i].iov_base), URING_ALIGNMENT, URING_BUFFER_SIZE))
+      g_error("Could not allocate the io_uring buffers");
+    writer->iovecs[i].iov_len=URING_BUFFER_SIZE;
+    writer->free_buffers[i]=i;
+  }
+  writer->free_count=URING_BUFFERS;
+  // Registering can fail when the buffers are over RLIMIT_MEMLOCK, they are
+  // still used, only mapped by the kernel on every write
+  writer->registered=io_uring_register_buffers(&(writer->ring), writer->iovecs, URING_BUFFERS) == 0;
+  return writer;
+}
+
+static void submit_requests(struct uring_writer *writer){
+  if (writer->queued == 0)
+    return;
+  int r=io_uring_submit(&(writer->ring));
+  if (r < 0)
+    g_error("io_uring submit failed: %s", strerror(-r));
+  writer->in_flight+=writer->queued;
+  writer->queued=0;
+}
+
+static void prep_write(struct uring_writer *writer, struct io_uring_sqe *sqe, struct uring_file *file, gint buffer, gsize from, gsize len, off_t offset){
+  gchar *data=(gchar *)writer->iovecs[buffer].iov_base + from;
+  if (writer->registered)
+    io_uring_prep_write_fixed(sqe, file->fd, data, len, offset, buffer);
+  else
+    io_uring_prep_write(sqe, file->fd, data, len, offset);
+}
+
+// The rest of the buffer is written from where the short write stopped. It
+// is submitted right away, as the completion that is being handled could be
+// the last one in flight.
+static gboolean resubmit_write(struct uring_writer *writer, struct uring_request *req){
+  struct uring_file *file=req->file;
+  struct io_uring_sqe *sqe=io_uring_get_sqe(&(writer->ring));
+  if (sqe == NULL){
+    submit_requests(writer);
+    if ((sqe=io_uring_get_sqe(&(writer->ring))) == NULL)
+      return FALSE;
+  }
+  if (file->direct && req->done % URING_ALIGNMENT != 0){
+    fcntl(file->fd, F_SETFL, fcntl(file->fd, F_GETFL) & ~O_DIRECT);
+    file->direct=FALSE;
+  }
+  prep_write(writer, sqe, file, req->buffer, req->done, req->len - req->done, req->offset + req->done);
+  io_uring_sqe_set_data(sqe, req);
+  writer->queued++;
+  submit_requests(writer);
+  return TRUE;
+}
+
+static void handle_completion(struct uring_writer *writer, struct io_uring_cqe *cqe){
+  struct uring_request *req=io_uring_cqe_get_data(cqe);
+  struct uring_file *file=req->file;
+  switch (req->type){
+    case URING_WRITE:
+      if (cqe->res < 0){
+        file->error=-cqe->res;
+      }else if ((gsize)cqe->res < req->len - req->done){
+        req->done+=cqe->res;
+        if (cqe->res > 0 && resubmit_write(writer, req)){
+          writer->in_flight--;
+          return;
+        }
+        file->error=EIO;
+      }
+      file->pending--;
+      writer->free_buffers[writer->free_count++]=req->buffer;
+      break;
+    case URING_FSYNC:
+      if (cqe->res < 0)
+        g_warning("fsync failed: %s", strerror(-cqe->res));
+      close(file->fd);
+      g_free(file);
+      break;
+  }
+  g_free(req);
+  writer->in_flight--;
+}
+
+// Processes the completions available, waiting for one if wait is set
+static void reap_completions(struct uring_writer *writer, gboolean wait){
+  struct io_uring_cqe *cqe=NULL;
+  if (wait && writer->in_flight > 0){
+    submit_requests(writer);
+    if (io_uring_wait_cqe(&(writer->ring), &cqe) == 0){
+      handle_completion(writer, cqe);
+      io_uring_cqe_seen(&(writer->ring), cqe);
+    }
+  }
+  while (writer->in_flight > 0 && io_uring_peek_cqe(&(writer->ring), &cqe) == 0){
+    handle_completion(writer, cqe);
+    io_uring_cqe_seen(&(writer->ring), cqe);
+  }
+}
+
+static struct io_uring_sqe *get_sqe(struct uring_writer *writer){
+  struct io_uring_sqe *sqe;
+  while ((sqe=io_uring_get_sqe(&(writer->ring))) == NULL){
+    submit_requests(writer);
+    reap_completions(writer, TRUE);
+  }
+  return sqe;
+}
+
+static void queue_request(struct uring_writer *writer, struct io_uring_sqe *sqe, enum uring_request_type type, struct uring_file *file, gint buffer, off_t offset, gsize len){
+  struct uring_request *req=g_new(struct uring_request, 1);
+  req->type=type;
+  req->file=file;
+  req->buffer=buffer;
+  req->offset=offset;
+  req->len=len;
+  req->done=0;
+  io_uring_sqe_set_data(sqe, req);
+  writer->queued++;
+  if (writer->queued >= URING_SUBMIT_BATCH)
+    submit_requests(writer);
+}
+
+static void free_uring_writer(struct uring_writer *writer){
+  guint i;
+  submit_requests(writer);
+  while (writer->in_flight > 0)
+    reap_completions(writer, TRUE);
+  if (writer->registered)
+    io_uring_unregister_buffers(&(writer->ring));
+  io_uring_queue_exit(&(writer->ring));
+  for (i=0; i < URING_BUFFERS; i++)
+    free(writer->iovecs[i].iov_base);
+  g_free(writer);
+}
+
+static struct uring_writer *get_uring_writer(){
+  struct uring_writer *writer=g_private_get(&uring_writer_key);
+  if (writer == NULL){
+    writer=new_uring_writer();
+    g_private_set(&uring_writer_key, writer);
+  }
+  return writer;
+}
+
+static void flush_buffer(struct uring_file *file){
+  struct uring_writer *writer=file->writer;
+  // O_DIRECT needs aligned sizes, only the last write of the file can be
+  // shorter, and it is done through the page cache
+  if (file->direct && file->used % URING_ALIGNMENT != 0){
+    fcntl(file->fd, F_SETFL, fcntl(file->fd, F_GETFL) & ~O_DIRECT);
+    file->direct=FALSE;
+  }
+  struct io_uring_sqe *sqe=get_sqe(writer);
+  prep_write(writer, sqe, file, file->buffer, 0, file->used, file->offset);
+  queue_request(writer, sqe, URING_WRITE, file, file->buffer, file->offset, file->used);
+  file->offset+=file->used;
+  file->pending++;
+  file->buffer=-1;
+  file->used=0;
+}
+
+gboolean initialize_uring_writer(){
+  struct io_uring ring;
+  int r=io_uring_queue_init(1, &ring, 0);
+  if (r < 0){
+    g_warning("io_uring is not available, using the regular writes: %s", strerror(-r));
+    return FALSE;
+  }
+  io_uring_queue_exit(&ring);
+  return TRUE;
+}
+
+// Completes the fsync and close of the files written by the calling thread
+// and frees its ring
+void stop_uring_writer(){
+  struct uring_writer *writer=g_private_get(&uring_writer_key);
+  if (writer == NULL)
+    return;
+  g_private_set(&uring_writer_key, NULL);
+  free_uring_writer(writer);
+}
+
+FILE *uring_open(const char *filename, const char *mode){
+  (void)mode;
+  struct uring_file *file=g_new0(struct uring_file, 1);
+  file->direct=io_uring_direct;
+  file->buffer=-1;
+  file->fd=open(filename, O_WRONLY | O_CREAT | O_TRUNC | (file->direct ? O_DIRECT : 0), 0666);
+  // Some filesystems, like tmpfs, do not support O_DIRECT
+  if (file->fd < 0 && file->direct && errno == EINVAL){
+    file->direct=FALSE;
+    file->fd=open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  }
+  if (file->fd < 0){
+    g_free(file);
+    return NULL;
+  }
+  file->writer=get_uring_writer();
+  if (file->writer == NULL && file->direct){
+    fcntl(file->fd, F_SETFL, fcntl(file->fd, F_GETFL) & ~O_DIRECT);
+    file->direct=FALSE;
+  }
+  return (FILE *)file;
+}
+
+int uring_write(FILE *f, const char *buff, int len){
+  struct uring_file *file=(struct uring_file *)f;
+  struct uring_writer *writer=file->writer;
+  gsize n, written=0;
+  if (file->error){
+    errno=file->error;
+    return -1;
+  }
+  if (writer == NULL){
+    ssize_t r;
+    while (written < (gsize)len){
+      r=write(file->fd, buff + written, len - written);
+      if (r < 0)
+        return -1;
+      written+=r;
+    }
+    return len;
+  }
+  while (written < (gsize)len){
+    if (file->buffer < 0){
+      while (writer->free_count == 0)
+        reap_completions(writer, TRUE);
+      file->buffer=writer->free_buffers[--writer->free_count];
+    }
+    n=MIN((gsize)len - written, URING_BUFFER_SIZE - file->used);
+    memcpy((gchar *)writer->iovecs[file->buffer].iov_base + file->used, buff + written, n);
+    file->used+=n;
+    written+=n;
+    if (file->used == URING_BUFFER_SIZE)
+      flush_buffer(file);
+  }
+  reap_completions(writer, FALSE);
+  return len;
+}
+
+// Waits for the writes of the file, as the file can be streamed or read by
+// the next step as soon as it is closed. The fsync and the close(2) of the
+// descriptor are completed in the background.
+int uring_close(void *f){
+  struct uring_file *file=(struct uring_file *)f;
+  struct uring_writer *writer=file->writer;
+  int error;
+  if (writer == NULL){
+    error=file->error;
+    if (close(file->fd))
+      error=errno;
+    g_free(file);
+    errno=error;
+    return error ? EOF : 0;
+  }
+  if (file->used > 0)
+    flush_buffer(file);
+  submit_requests(writer);
+  while (file->pending > 0)
+    reap_completions(writer, TRUE);
+  error=file->error;
+  struct io_uring_sqe *sqe=get_sqe(writer);
+  io_uring_prep_fsync(sqe, file->fd, 0);
+  queue_request(writer, sqe, URING_FSYNC, file, -1, 0, 0);
+  submit_requests(writer);
+  if (error){
+    errno=error;
+    return EOF;
+  }
+  return 0;
+}
+
+#else
+
+gboolean initialize_uring_writer(){
+  g_warning("Built without io_uring support, using the regular writes");
+  return FALSE;
+}
+
+void stop_uring_writer(){
+}
+
+FILE *uring_open(const char *filename, const char *mode){
+  return fopen(filename, mode);
+}
+
+int uring_write(FILE *file, const char *buff, int len){
+  return fwrite(buff, 1, len, file);
+}
+
+int uring_close(void *file){
+  return fclose(file);
+}
+
+#endif
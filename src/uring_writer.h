@@ -0,0 +1,39 @@
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+        Authors:    David Ducos, Percona (david dot ducos at percona dot com)
+*/
+#ifndef _src_uring_writer_h
+#define _src_uring_writer_h
+#include <stdio.h>
+#include <glib.h>
+
+// Every thread that writes files has its own ring with URING_BUFFERS buffers
+// of URING_BUFFER_SIZE bytes, registered with the kernel when it allows it.
+// The buffers are aligned to URING_ALIGNMENT, so they can be used with O_DIRECT.
+#define URING_QUEUE_DEPTH 32
+#define URING_BUFFERS 8
+#define URING_BUFFER_SIZE 1048576
+#define URING_ALIGNMENT 4096
+#define URING_SUBMIT_BATCH 4
+
+extern gboolean use_io_uring;
+extern gboolean io_uring_direct;
+
+gboolean initialize_uring_writer();
+void stop_uring_writer();
+FILE *uring_open(const char *filename, const char *mode);
+int uring_write(FILE *file, const char *buff, int len);
+int uring_close(void *file);
+#endif
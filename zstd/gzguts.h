@@ -197,6 +197,9 @@ typedef struct {
         /* just for writing */
     int level;              /* compression level */
     int strategy;           /* compression strategy */
+        /* preset dictionary, used when reading if inflate() needs it */
+    const void *dict;       /* see gzsetdictionary() */
+    unsigned dict_length;
         /* seek request */
     z_off64_t skip;         /* amount to skip (already rewound if backwards) */
     int seek;               /* true if seek request pending */
@@ -117,6 +117,8 @@ local gzFile gz_open(path, fd, mode)
     state.state->size = 0;            /* no buffers allocated yet */
     state.state->want = GZBUFSIZE;    /* requested buffer size */
     state.state->msg = NULL;          /* no error message yet */
+    state.state->dict = NULL;         /* no preset dictionary */
+    state.state->dict_length = 0;
 
     /* interpret mode */
     state.state->mode = GZ_NONE;
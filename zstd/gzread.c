@@ -204,6 +204,16 @@ local int gz_decomp(state)
 
         /* decompress and handle errors */
         ret = inflate(strm, Z_NO_FLUSH);
+        if (ret == Z_NEED_DICT && state.state->dict != NULL) {
+            /* the zstd frame was compressed with the preset dictionary */
+            if (inflateSetDictionary(strm, state.state->dict,
+                                     state.state->dict_length) != Z_OK) {
+                gz_error(state, Z_DATA_ERROR, "wrong dictionary");
+                return -1;
+            }
+            ret = Z_OK;
+            continue;
+        }
         if (ret == Z_STREAM_ERROR || ret == Z_NEED_DICT) {
             gz_error(state, Z_STREAM_ERROR,
                      "internal error: inflate stream corrupt");
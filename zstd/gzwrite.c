@@ -669,3 +669,41 @@ int ZEXPORT gzclose_w(file)
     free(state.state);
     return ret;
 }
+
+/* -- not in zlib.h --
+   Sets the preset dictionary of a gzip file. When writing it has to be called
+   before anything is written, and the dictionary is copied. When reading the
+   dictionary is used if the stream asks for it, so it must remain valid until
+   the file is closed. */
+int ZEXPORT gzsetdictionary(file, dictionary, length)
+    gzFile file;
+    const void *dictionary;
+    unsigned length;
+{
+    gz_statep state;
+
+    /* get internal structure */
+    if (file == NULL)
+        return Z_STREAM_ERROR;
+    state.file = file;
+
+    if (state.state->mode == GZ_READ) {
+        state.state->dict = dictionary;
+        state.state->dict_length = length;
+        return Z_OK;
+    }
+
+    /* check that we're writing, that there's no error and nothing written */
+    if (state.state->mode != GZ_WRITE || state.state->err != Z_OK ||
+        state.state->x.pos != 0)
+        return Z_STREAM_ERROR;
+
+    /* a file written without compression has no use for it */
+    if (state.state->direct)
+        return Z_OK;
+
+    if (state.state->size == 0 && gz_init(state) == -1)
+        return state.state->err;
+    return deflateSetDictionary(&(state.state->strm), (const Bytef *)dictionary,
+                                length);
+}
@@ -80,6 +80,9 @@ int ZWRAP_isUsingZSTDdecompression(z_streamp strm);
    For zlib streams this method redirects to inflateReset. */
 int ZWRAP_inflateReset_keepDict(z_streamp strm);
 
+/* Sets the preset dictionary of a file opened with gzopen(), see gzwrite.c */
+ZEXTERN int ZEXPORT gzsetdictionary OF((gzFile file, const void *dictionary, unsigned length));
+
 
 #if defined (__cplusplus)
 }